@@ -4,20 +4,58 @@
  * @details Implementations of the primary functions defined in cuf.h. Lots of
  * dynamic memory, and other questionables here...
  */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "cuf.h"
+#include "cuf_alloc.h"
+#include "cuf_arena.h"
+#include "cuf_bench.h"
+#include "cuf_cache.h"
+#include "cuf_guard.h"
+#include "cuf_iso.h"
+#include "cuf_order.h"
+#include "cuf_perf.h"
+#include "cuf_prof.h"
+#include "cuf_shard.h"
 #include "cuf_util.h"
+#include "cuf_watch.h"
+
+
+// serializes progress output when suites are run from several threads
+static pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+// testcase the calling thread is currently running, if any
+static _Thread_local TestCase *active_case = NULL;
+// process wide observer of stored failure messages
+static FailHook fail_hook = NULL;
+
+static bool site_matches(Failure *site, const char *file, int line);
+static void testcase_body(TestSuite *suite, TestCase *testcase, void *uut);
+static const char *option_value(const char *arg, const char *name);
+static int set_path(char **dst, const char *arg, const char *value);
 
 TestCase *testcase_create(TestFunc funct, char* test_name, Dependency *deps, void *args) {
     TestCase *testcase = (TestCase *) malloc(sizeof(TestCase));
     testcase->testfunc = funct;
     testcase->status = 0;
-    testcase->err_msgs = NULL;
+    testcase->failures = NULL;
+    testcase->last_failure = NULL;
     testcase->err_msg_count = 0;
-    testcase->err_size = 0;
+    testcase->benchfunc = NULL;
+    testcase->bench = NULL;
+    memset(&testcase->times, 0, sizeof(CaseTimes));
+    testcase->timeout = 0;
+    testcase->done = false;
+    testcase->perf = NULL;
+    testcase->alloc = NULL;
+    testcase->peak_rss = 0;
+    testcase->cached = false;
+    testcase->skip_reason = NULL;
+    testcase->run_order = 0;
     testcase->args  = args;
     testcase->test_name = malloc(sizeof(char) * (strlen(test_name)+1));
     strcpy(testcase->test_name, test_name);
@@ -26,11 +64,11 @@ TestCase *testcase_create(TestFunc funct, char* test_name, Dependency *deps, voi
 }
 
 void testcase_destroy(TestCase *testcase) {
-    for(int i = 0; i < testcase->err_msg_count; ++i) {
-        free(testcase->err_msgs[i]);
-    }
-    if(testcase->err_msgs) free(testcase->err_msgs);
+    // failure records live in the run's arena, testrunner_destroy frees them
     if(testcase->test_name) free(testcase->test_name);
+    if(testcase->bench) free(testcase->bench);
+    if(testcase->perf) free(testcase->perf);
+    if(testcase->alloc) free(testcase->alloc);
     free(testcase);
 }
 
@@ -51,9 +89,19 @@ TestSuite *testsuite_create(char* name, SetupFunc setup, TeardownFunc teardown,
     suite->passed = 0;
     suite->failed = 0;
     suite->skipped = 0;
+    suite->flags = 0;
+    memset(&suite->times, 0, sizeof(CaseTimes));
+    suite->timeout = 0;
+    suite->peak_rss = 0;
+    suite->mem_budget = 0;
+    suite->deselected = 0;
     return suite;
 }
 
+void testsuite_set_flags(TestSuite *suite, int flags) {
+    suite->flags = flags;
+}
+
 int testsuite_reg_case(TestSuite *suite, TestFunc test, Dependency *deps,
                        char *test_name, void *args) {
     // create from params and specified arguments and enter it into the suite's
@@ -73,77 +121,324 @@ int testsuite_reg_case(TestSuite *suite, TestFunc test, Dependency *deps,
     }
     return 0;
 }
+
+int testsuite_reg_case_timeout(TestSuite *suite, TestFunc test,
+                               Dependency *deps, char *test_name, void *args,
+                               double timeout) {
+    testsuite_reg_case(suite, test, deps, test_name, args);
+    suite->testcases[suite->test_count - 1]->timeout = timeout;
+    return 0;
+}
+
+void testsuite_set_timeout(TestSuite *suite, double timeout) {
+    suite->timeout = timeout;
+}
+
+void testsuite_set_mem_budget(TestSuite *suite, uint64_t bytes) {
+    suite->mem_budget = bytes;
+}
+
+double testcase_get_timeout(TestSuite *suite, TestCase *testcase) {
+    if(testcase->timeout > 0) return testcase->timeout;
+    return suite->timeout;
+}
+
+TestCase *testsuite_current_case(TestSuite *suite) {
+    if(active_case) return active_case;
+    return suite->testcases[suite->current_test];
+}
+
 int testsuite_record_fail(TestSuite *suite, char* err_msg) {
-    // convinience pointer
-    TestCase *c_case = suite->testcases[suite->current_test];
-    // reallocate buffers if there isn't one or we hit the end
-    if(c_case->err_msg_count == c_case->err_size) {
-        if(c_case->err_size == 0) {
-            c_case->err_size = 2;
-            c_case->err_msgs = 
-                (char **) malloc(sizeof(char*) *  c_case->err_size);
-        } else {
-            c_case->err_size *= 2;
-            c_case->err_msgs = 
-                (char **) realloc(c_case->err_msgs,
-                                  sizeof(char*) * c_case->err_size);
-        }
-    }
-    // create dynamic error message buffer
-    c_case->err_msgs[c_case->err_msg_count] = 
-        malloc(sizeof(char) * (strlen(err_msg)+1));
-    strcpy(c_case->err_msgs[c_case->err_msg_count], err_msg);
-    ++(c_case->err_msg_count);
+    return testcase_record_fail(testsuite_current_case(suite), err_msg);
+}
+
+int testsuite_record_check(TestSuite *suite, const char *file, int line,
+                           const char *what, const char *expr_a,
+                           const char *expr_b) {
+    FailureMsg msg = {.what = what, .expr_a = expr_a, .expr_b = expr_b};
+    return testcase_record(testsuite_current_case(suite), file, line, &msg);
+}
+
+int testsuite_record_values(TestSuite *suite, const char *file, int line,
+                            const char *what, const char *expr_a,
+                            const char *expr_b, CufValue val_a,
+                            CufValue val_b) {
+    FailureMsg msg = {NULL, what, expr_a, expr_b, NULL, val_a, val_b};
+    return testcase_record(testsuite_current_case(suite), file, line, &msg);
+}
+
+int testsuite_record_detail(TestSuite *suite, const char *file, int line,
+                            const char *what, const char *expr_a,
+                            const char *expr_b, const char *detail) {
+    FailureMsg msg = {.what = what, .expr_a = expr_a, .expr_b = expr_b,
+                      .detail = detail};
+    return testcase_record(testsuite_current_case(suite), file, line, &msg);
+}
+
+int testcase_record_fail(TestCase *c_case, char* err_msg) {
+    FailureMsg msg = {.detail = err_msg};
+    return testcase_record(c_case, NULL, 0, &msg);
+}
+
+int testcase_record(TestCase *c_case, const char *file, int line,
+                    const FailureMsg *msg) {
+    // a timeout is aborting the run, see cuf_watch.h
+    watchdog_hold();
     c_case->status = CUF_TC_FAIL;
+    // the record is ours, not the testcase's, keep it out of its heap usage
+    alloc_pause();
+    Failure *site = testcase_fail_site(c_case, file, line);
+    ++(site->count);
+    ++(c_case->err_msg_count);
+    // past the limit only the count goes up, so a failure storm costs nothing
+    if(site->stored >= CUF_ERR_LIMIT) {
+        alloc_resume();
+        return 0;
+    }
+    // keep the record as is, it only points at static strings. Formatting is
+    // left to the report, and only dynamic detail text needs copying
+    Arena *arena = arena_local();
+    FailureMsg *copy = arena_alloc(arena, sizeof(FailureMsg));
+    *copy = *msg;
+    copy->next = NULL;
+    if(msg->detail) copy->detail = arena_strdup(arena, msg->detail);
+    if(site->last_msg) {
+        site->last_msg->next = copy;
+    } else {
+        site->msgs = copy;
+    }
+    site->last_msg = copy;
+    ++(site->stored);
+    // let whoever collects failures for us know about it
+    if(fail_hook) fail_hook(c_case, site, copy);
+    alloc_resume();
     return 0;
 }
 
+Failure *testcase_fail_site(TestCase *c_case, const char *file, int line) {
+    // assertions in loops tend to hit the same site over and over
+    Failure *site = c_case->last_failure;
+    if(site && site_matches(site, file, line)) return site;
+    for(site = c_case->failures; site; site = site->next) {
+        if(site_matches(site, file, line)) return site;
+    }
+    site = arena_alloc(arena_local(), sizeof(Failure));
+    site->next = NULL;
+    site->file = file;
+    site->line = line;
+    site->count = 0;
+    site->stored = 0;
+    site->msgs = NULL;
+    site->last_msg = NULL;
+    if(c_case->last_failure) {
+        c_case->last_failure->next = site;
+    } else {
+        c_case->failures = site;
+    }
+    c_case->last_failure = site;
+    return site;
+}
+
+void testcase_set_fail_hook(FailHook hook) {
+    fail_hook = hook;
+}
+
+void testcase_print_failure(FILE *out, TestCase *testcase, Failure *site,
+                            FailureMsg *msg) {
+    // plain messages carry their own location
+    if(!msg->what) {
+        fputs(msg->detail, out);
+        return;
+    }
+    fprintf(out, msg->what, msg->expr_a? msg->expr_a : "",
+            msg->expr_b? msg->expr_b : "");
+    if(msg->detail) {
+        // drop trailing newlines, the location goes on the next line anyway
+        int len = strlen(msg->detail);
+        while(len > 0 && msg->detail[len-1] == '\n') --len;
+        fprintf(out, "\n%.*s", len, msg->detail);
+    }
+    if(msg->val_a.kind != CUF_VAL_NONE) {
+        fprintf(out, "\nWhere `%s` = ", msg->expr_a);
+        value_print(out, msg->val_a);
+        if(msg->val_b.kind != CUF_VAL_NONE) {
+            fprintf(out, ", `%s` = ", msg->expr_b);
+            value_print(out, msg->val_b);
+        }
+    }
+    if(site->file) {
+        fprintf(out, "\nAt %s:%d; in TestCase: %s", site->file, site->line,
+                testcase->test_name);
+    } else {
+        fprintf(out, "\nIn TestCase: %s", testcase->test_name);
+    }
+}
+
+void testcase_print_failures(FILE *out, TestCase *testcase) {
+    Failure *site = testcase->failures;
+    for(; site; site = site->next) {
+        FailureMsg *msg = site->msgs;
+        for(; msg; msg = msg->next) {
+            fprintf(out, "\n");
+            testcase_print_failure(out, testcase, site, msg);
+            fprintf(out, "\n");
+        }
+        if(site->count > site->stored && site->file) {
+            fprintf(out, "\n... x %ld more at %s:%d\n",
+                    site->count - site->stored, site->file, site->line);
+        } else if(site->count > site->stored) {
+            fprintf(out, "\n... x %ld more\n", site->count - site->stored);
+        }
+    }
+}
+
 int testsuite_run(TestSuite *suite) {
+    return testsuite_exec(suite, true);
+}
+
+int testsuite_exec(TestSuite *suite, bool progress) {
     // run init func
     if(suite->init) suite->init(suite);
-    // convenience pointer
+    // convenience pointer. Assertions find their case through the thread's
+    // active case, the cursor is only kept up to date for external callers
     int *ctest = &(suite->current_test);
-    // iterate over all testcases and run them, recording results
-    for(*ctest = 0; *ctest < suite->test_count; ++(*ctest)) {
+    // zygote suites share one setup between consecutive cases
+    Zygote *zygote = NULL;
+    // iterate over all testcases in the run's order, recording results
+    int *order = order_cases(suite);
+    for(int k = 0; k < suite->test_count && !order_stopped(); ++k) {
+        *ctest = order[k];
         TestCase *c_case = suite->testcases[*ctest];
-        bool deps_ok = dependency_check(c_case->deps);
-        if(deps_ok){
-            void *uut = NULL;
-            if(suite->setup) {
-                suite->setup(&uut,
-                             (suite->testcases[*ctest]->args),
-                             c_case);
-            }
-            suite->testcases[*ctest]->testfunc(uut, suite);
-            if(suite->teardown) {
-                suite->teardown(uut,
-                                (suite->testcases[*ctest]->args),
-                                c_case);
-            }
+        if(suite->flags & CUF_SUITE_ZYGOTE) {
+            testcase_run_zygote(suite, c_case, &zygote);
         } else {
-            c_case->status = -2;
+            testcase_run(suite, c_case);
         }
         switch(c_case->status) {
             case CUF_TC_PASS:
                 ++(suite->passed);
-                putchar('.');
                 break;
             case CUF_TC_FAIL:
                 ++(suite->failed);
-                putchar('x');
                 break;
             case CUF_TC_SKIP:
                 ++(suite->skipped);
-                putchar('s');
                 break;
         }
-        fflush(stdout);
+        if(progress) testcase_print_progress(c_case);
     }
+    free(order);
+    zygote_release(suite, zygote);
     // run the termination function
     if(suite->term) suite->term(suite);
     return 0;
 }
 
+int testcase_run(TestSuite *suite, TestCase *testcase) {
+    watchdog_hold();
+    // another shard runs this one, see cuf_shard.h
+    if(testcase->status == CUF_TC_DESELECTED) return testcase->status;
+    if(!testcase_check_deps(testcase)) return testcase->status;
+    // passed before with the same inputs, see cuf_cache.h
+    if(testcase->cached) {
+        testcase->status = CUF_TC_PASS;
+        testcase->done = true;
+        return testcase->status;
+    }
+    void *uut = NULL;
+    int watch = watchdog_arm(suite, testcase);
+    alloc_case_begin();
+    uint64_t rss = prof_rss_begin();
+    uint64_t start = cuf_now_ns();
+    int crashed = guard_setup(suite, testcase, &uut);
+    testcase->times.setup_ns = cuf_now_ns() - start;
+    // a crashed setup leaves no uut to test or tear down
+    if(!crashed) {
+        testcase_call(suite, testcase, uut);
+        start = cuf_now_ns();
+        guard_teardown(suite, testcase, uut);
+        testcase->times.teardown_ns = cuf_now_ns() - start;
+    }
+    prof_rss_end(suite, testcase, rss);
+    alloc_case_end(testcase);
+    watchdog_disarm(watch);
+    watchdog_hold();
+    testcase->done = true;
+    order_case_done(testcase);
+    return testcase->status;
+}
+
+bool testcase_check_deps(TestCase *testcase) {
+    const char *reason = NULL;
+    if(dependency_state(testcase, &reason) == CUF_DEP_READY) {
+        if(dependency_check(testcase->deps)) return true;
+        reason = NULL;
+    }
+    testcase->skip_reason = reason;
+    testcase->status = CUF_TC_SKIP;
+    testcase->done = true;
+    return false;
+}
+
+void testcase_call(TestSuite *suite, TestCase *testcase, void *uut) {
+    // route assertions made on this thread to this case
+    active_case = testcase;
+    uint64_t user, sys;
+    cuf_cpu_ns(&user, &sys);
+    PerfGroup group;
+    bool counting = perf_start(&group);
+    uint64_t start = cuf_now_ns();
+    // REQUIRE checks and caught crashes come back here, see cuf_guard.h
+    guard_call(&testcase_body, suite, testcase, uut);
+    testcase->times.wall_ns = cuf_now_ns() - start;
+    if(counting) perf_stop(&group, testcase);
+    uint64_t user_end, sys_end;
+    cuf_cpu_ns(&user_end, &sys_end);
+    testcase->times.user_ns = user_end - user;
+    testcase->times.sys_ns = sys_end - sys;
+    active_case = NULL;
+}
+
+void testsuite_tally(TestSuite *suite) {
+    suite->passed = 0;
+    suite->failed = 0;
+    suite->skipped = 0;
+    for(int i = 0; i < suite->test_count; ++i) {
+        // left out by fail-fast, see cuf_order.h
+        if(!suite->testcases[i]->done) continue;
+        switch(suite->testcases[i]->status) {
+            case CUF_TC_PASS:
+                ++(suite->passed);
+                break;
+            case CUF_TC_FAIL:
+                ++(suite->failed);
+                break;
+            case CUF_TC_SKIP:
+                ++(suite->skipped);
+                break;
+        }
+    }
+}
+
+void testcase_print_progress(TestCase *testcase) {
+    // left out by fail-fast
+    if(!testcase->done) return;
+    pthread_mutex_lock(&progress_lock);
+    switch(testcase->status) {
+        case CUF_TC_PASS:
+            putchar(testcase->cached? 'c' : '.');
+            break;
+        case CUF_TC_FAIL:
+            putchar('x');
+            break;
+        case CUF_TC_SKIP:
+            putchar('s');
+            break;
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&progress_lock);
+}
+
 int testsuite_destroy(TestSuite *suite) {
     // recursive call into the testcases to clean them up
     for(int i = 0; i < suite->test_count; ++i) {
@@ -158,12 +453,66 @@ int testsuite_destroy(TestSuite *suite) {
 TestRunner *testrunner_create() {
     TestRunner *test = (TestRunner *) malloc(sizeof(TestRunner));
     test->suites = (TestSuite **) malloc(sizeof(TestSuite*) * 8);
-    test->arr_size = 0;
+    test->arr_size = 8;
     test->suite_count = 0;
     test->current_suite = 0;
+    test->name_width = 0;
+    test->report_level = CUF_REPORT_FULL;
+    test->slowest = CUF_SLOWEST_COUNT;
+    test->timings_path = NULL;
+    test->shard_index = 1;
+    test->shard_count = 1;
+    test->shard_timings = NULL;
+    test->results_path = NULL;
+    test->history_path = NULL;
+    test->fail_fast = false;
+    test->crash_recovery = false;
     return test;
 }
 
+int testrunner_parse_args(TestRunner *runner, int argc, char **argv) {
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value;
+        if((value = option_value(arg, "--shard="))) {
+            int index, count;
+            char extra;
+            if(sscanf(value, "%d/%d%c", &index, &count, &extra) != 2 ||
+               testrunner_set_shard(runner, index, count)) {
+                fprintf(stderr, "Bad shard `%s`, expected i/n with i from 1 "
+                        "to n\n", value);
+                return -1;
+            }
+        } else if((value = option_value(arg, "--shard-timings="))) {
+            if(set_path(&runner->shard_timings, arg, value)) return -1;
+        } else if((value = option_value(arg, "--results="))) {
+            if(set_path(&runner->results_path, arg, value)) return -1;
+        } else if((value = option_value(arg, "--timings="))) {
+            if(set_path(&runner->timings_path, arg, value)) return -1;
+        } else if((value = option_value(arg, "--history="))) {
+            if(set_path(&runner->history_path, arg, value)) return -1;
+        } else if(strcmp(arg, "--fail-fast") == 0) {
+            testrunner_set_fail_fast(runner, true);
+        } else if(strcmp(arg, "--catch-crashes") == 0) {
+            testrunner_set_crash_recovery(runner, true);
+        }
+    }
+    return 0;
+}
+
+void testrunner_set_report_level(TestRunner *runner, int level) {
+    runner->report_level = level;
+}
+
+void testrunner_set_slowest(TestRunner *runner, int count) {
+    runner->slowest = count;
+}
+
+void testrunner_set_timings_file(TestRunner *runner, const char *path) {
+    free(runner->timings_path);
+    runner->timings_path = path? strdup(path) : NULL;
+}
+
 void testrunner_reg_suite(TestRunner *runner, TestSuite **suite) {
     runner->suites[runner->suite_count] = *suite;
     ++(runner->suite_count);
@@ -177,52 +526,95 @@ void testrunner_reg_suite(TestRunner *runner, TestSuite **suite) {
     }
 }
 
-int testrunner_run(TestRunner *runner) {
+void testrunner_print_header(TestRunner *runner) {
     int total_tests = 0;
-    int total_failed = 0;
-    int total_passed = 0;
-    int total_skipped = 0;
-    int longest_suite_name = 0;
+    int selected = 0;
+    // before the split, which keeps dependent cases in one shard
+    dependency_resolve(runner);
+    shard_select(runner);
+    runner->name_width = 0;
     // determine correct text alignment offsets
     for(int i = 0; i < runner->suite_count; ++i) {
-        int length = strlen(runner->suites[i]->name)
-                     + runner->suites[i]->test_count;
-        total_tests += runner->suites[i]->test_count;
-        if(length > longest_suite_name) { 
-            longest_suite_name = length;
+        TestSuite *suite = runner->suites[i];
+        int length = strlen(suite->name) + suite->test_count
+                     - suite->deselected;
+        total_tests += suite->test_count;
+        selected += suite->test_count - suite->deselected;
+        if(length > runner->name_width) {
+            runner->name_width = length;
         }
     }
+    // files may have come or gone since the last run
+    dependency_new_run();
+    cache_prepare(runner);
+    order_prepare(runner);
+    guard_prepare(runner);
+    prof_set_shared(false);
     printf("\nRegistered %d tests. Starting testing.\n", total_tests);
+    if(runner->shard_count > 1) {
+        printf("Running %d of them in shard %d/%d.\n", selected,
+               runner->shard_index, runner->shard_count);
+    }
+    printf("\n--------Test Progress:---------\n\n");
+}
 
-    // run each suite, sequentially
+void testrunner_print_status(TestRunner *runner, TestSuite *suite) {
+    // right align pass/fail messages
+    int name_diff = runner->name_width -
+                    (strlen(suite->name) + suite->test_count -
+                     suite->deselected);
+    while(name_diff) {
+        fputc(' ', stdout);
+        --name_diff;
+    }
+    // print pass/fail
+    if(suite->failed > 0) {
+        printf("    FAILED\n");
+    } else {
+        printf("    PASSED\n");
+    }
+    fflush(stdout);
+}
+
+int testrunner_run(TestRunner *runner) {
+    testrunner_print_header(runner);
+    watchdog_start(runner);
+    // run each suite, sequentially, in the order of their first cases
     int *csuite = &(runner->current_suite);
-    printf("\n--------Test Progress:---------\n\n");
-    for(*csuite = 0; *csuite < runner->suite_count; ++(*csuite)) {
+    int *order = order_suites(runner);
+    for(int k = 0; k < runner->suite_count && !order_stopped(); ++k) {
+        *csuite = order[k];
         TestSuite *suite = runner->suites[*csuite];
+        if(shard_skips_suite(suite)) continue;
         printf("Test Suite: %s ", runner->suites[*csuite]->name);
         // run currnet suite
         testsuite_run(suite);
-        // right align pass/fail messages
-        int name_diff = longest_suite_name -
-                        (strlen(runner->suites[*csuite]->name) +
-                         runner->suites[*csuite]->test_count);
-        while(name_diff) {
-            fputc(' ', stdout);
-            --name_diff;
-        }
-        // print pass/fail
-        if(suite->failed > 0) {
-            printf("    FAILED\n");
-        } else {
-            printf("    PASSED\n");
-        }
-        // update running counters
+        testrunner_print_status(runner, suite);
+    }
+    free(order);
+    watchdog_stop();
+    return testrunner_report(runner);
+}
+
+int testrunner_report(TestRunner *runner) {
+    // every case is done, a crash from here on is the runner's own
+    guard_release();
+    int total_tests = 0;
+    int total_failed = 0;
+    int total_passed = 0;
+    int total_skipped = 0;
+    int total_cached = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        // cases that never got to run (an aborted run) don't count
+        total_tests += suite->passed + suite->failed + suite->skipped;
         total_passed += suite->passed;
         total_failed += suite->failed;
         total_skipped += suite->skipped;
+        for(int j = 0; j < suite->test_count; ++j) {
+            total_cached += suite->testcases[j]->cached;
+        }
     }
-    // remove csuite ref so we don't accidentally use it later
-    csuite = NULL;
     // print failures
     bool first_fail = true;
     for(int i = 0; i < runner->suite_count; ++i) {
@@ -233,9 +625,19 @@ int testrunner_run(TestRunner *runner) {
                 first_fail = false;
             }
             for(int j = 0; j < suite->test_count; ++j) {
-                for(int k = 0; k < suite->testcases[j]->err_msg_count; ++k) {
-                    printf("\n%s\n", suite->testcases[j]->err_msgs[k]);
+                TestCase *c_case = suite->testcases[j];
+                // still running when a timeout aborted the run
+                if(!c_case->done) continue;
+                // counts only: don't spend any time formatting
+                if(runner->report_level == CUF_REPORT_COUNTS) {
+                    if(c_case->err_msg_count > 0) {
+                        printf("\nIn suite: %s, testcase: %s failed %d "
+                               "assertions\n", suite->name,
+                               c_case->test_name, c_case->err_msg_count);
+                    }
+                    continue;
                 }
+                testcase_print_failures(stdout, c_case);
             }
         }
     }
@@ -249,18 +651,51 @@ int testrunner_run(TestRunner *runner) {
                 first_skip = false;
             }
             for(int j = 0; j < suite->test_count; ++j) {
-                if(suite->testcases[j]->status == -2) {
-                    printf("\nIn suite: %s, skipped testcase: %s due to "
-                           "missing test files", suite->name,
-                           suite->testcases[j]->test_name);
+                TestCase *c_case = suite->testcases[j];
+                if(c_case->status == -2) {
+                    printf("\nIn suite: %s, skipped testcase: %s due to %s",
+                           suite->name, c_case->test_name,
+                           c_case->skip_reason? c_case->skip_reason :
+                           "missing test files");
                 }
             }
             printf("\n");
         }
     }
+    bench_report(runner);
+    // an aborted run leaves the files it would persist as they were
+    bool aborted = watchdog_aborted();
+    if(!aborted && bench_save_baseline(runner)) {
+        printf("\nCould not write the benchmark baseline file\n");
+    }
+    if(!aborted && cache_save(runner)) {
+        printf("\nCould not write the result cache file\n");
+    }
+    perf_report(runner);
+    alloc_report(runner);
+    prof_report(runner);
+    if(runner->timings_path && prof_write_json(runner, runner->timings_path)) {
+        printf("\nCould not write the timings file %s\n",
+               runner->timings_path);
+    }
+    if(!aborted && runner->results_path && shard_write_results(runner)) {
+        printf("\nCould not write the results file %s\n",
+               runner->results_path);
+    }
+    if(!aborted && order_save(runner)) {
+        printf("\nCould not write the history file %s\n",
+               runner->history_path);
+    }
+    order_report(runner);
     printf("\n------------RESULTS:------------\n");
-    printf("\n%d Tests completed, %d passed, %d skipped, %d failed\n\n", 
-           total_tests, total_passed, total_skipped, total_failed);
+    if(total_cached > 0) {
+        printf("\n%d Tests completed, %d passed (%d cached), %d skipped, "
+               "%d failed\n\n", total_tests, total_passed, total_cached,
+               total_skipped, total_failed);
+    } else {
+        printf("\n%d Tests completed, %d passed, %d skipped, %d failed\n\n", 
+               total_tests, total_passed, total_skipped, total_failed);
+    }
     if(total_failed == 0) {
         return 0;
     } else {
@@ -268,11 +703,48 @@ int testrunner_run(TestRunner *runner) {
     }
 }
 
+static bool site_matches(Failure *site, const char *file, int line) {
+    if(site->line != line) return false;
+    if(site->file == file) return true;
+    return site->file && file && strcmp(site->file, file) == 0;
+}
+
+static void testcase_body(TestSuite *suite, TestCase *testcase, void *uut) {
+    if(testcase->benchfunc) {
+        bench_run(suite, testcase, uut);
+    } else {
+        testcase->testfunc(uut, suite);
+    }
+}
+
+static const char *option_value(const char *arg, const char *name) {
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0? arg + len : NULL;
+}
+
+static int set_path(char **dst, const char *arg, const char *value) {
+    if(!value[0]) {
+        fprintf(stderr, "Missing file name in `%s`\n", arg);
+        return -1;
+    }
+    free(*dst);
+    *dst = strdup(value);
+    return 0;
+}
+
 void testrunner_destroy(TestRunner *runner) {
     // recursive call into suites to destroy them all
     for(int i = 0; i < runner->suite_count; ++i) {
         testsuite_destroy(runner->suites[i]);
     }
     if(runner->suites) free(runner->suites);
+    free(runner->timings_path);
+    free(runner->shard_timings);
+    free(runner->results_path);
+    free(runner->history_path);
     free(runner);
+    // every failure message of the run goes in one step
+    arena_release_all();
+    bench_clear_baseline();
+    cache_clear();
 }
@@ -12,9 +12,11 @@
 #ifndef __TEST_H__
 #define __TEST_H__
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "cuf_dep.h"
+#include "cuf_value.h"
 
 
 /**
@@ -32,6 +34,17 @@
  */
 #define REGISTER_TESTCASE(suite, testcase, deps, args)\
             testsuite_reg_case(suite, testcase, deps, #testcase, args)
+/**
+ * shortcut macro to register a testcase with its own timeout to a testsuite
+ *
+ * @param suite TestSuite object to register testcase to
+ * @param testcase TestFunc function to register
+ * @param args argument object for given case
+ * @param timeout seconds the case may take, see `testsuite_set_timeout()`
+ */
+#define REGISTER_TESTCASE_TIMEOUT(suite, testcase, deps, args, timeout)\
+            testsuite_reg_case_timeout(suite, testcase, deps, #testcase,\
+                                       args, timeout)
 /**
  * Another handy macro to register test suties to test runner (TestRunner) objects
  * 
@@ -69,12 +82,46 @@
 #define CUF_ARRAY_SIZE 8
 #define CUF_BUF_SIZE 250
 #define CUF_ERR_LIMIT 10
+// default length of the SLOWEST TESTS list, see `testrunner_set_slowest()`
+#define CUF_SLOWEST_COUNT 10
+
+
+/**
+ * listing of option flags for testsuites, see `testsuite_set_flags()`
+ */
+enum cuf_suite_flags {
+    /**
+     * Zygote fixtures: run setup once, then fork every case from the process
+     * that holds the ready uut. Each case gets a copy-on-write view of the
+     * uut, so it can't see what earlier cases did to it, and the cost of an
+     * expensive setup is paid once instead of once per case. Consecutive
+     * cases registered with the same `args` share one setup; setup and
+     * teardown are called with the first case of that run. Teardown runs
+     * once in the parent, never in the forked cases. A case that crashes is
+     * recorded as failed instead of bringing down the runner.
+     *
+     * Honored by `testrunner_run` and `testrunner_run_parallel`. The latter
+     * forks from a worker thread while others keep running: the locks the
+     * framework needs in the forked case are taken around the fork, but locks
+     * the test code holds on other threads are not, so such a suite must not
+     * share locks with suites running alongside it. `testrunner_run_stealing`,
+     * `testrunner_run_graph` and the isolated runners schedule individual
+     * cases and fall back to a setup per case.
+     */
+    CUF_SUITE_ZYGOTE = 1 << 0
+};
 
 
 // Typedefs to make life easiser
 typedef struct testcase_t TestCase;
 typedef struct testsuite_t TestSuite;
 typedef struct testrunner_t TestRunner;
+typedef struct failure_t Failure;
+typedef struct failure_msg_t FailureMsg;
+typedef struct bench_stats_t BenchStats;
+typedef struct case_times_t CaseTimes;
+typedef struct perf_counts_t PerfCounts;
+typedef struct alloc_stats_t AllocStats;
 /**
  * a function pointer to a testcase function
  * 
@@ -82,6 +129,14 @@ typedef struct testrunner_t TestRunner;
  * @param suite testcuite that is running this function
  */
 typedef void (*TestFunc) (void *uut, TestSuite *suite);
+/**
+ * a function pointer to a benchmark function, see cuf_bench.h
+ *
+ * @param uut custom uut object supplied to each case
+ * @param suite testsuite that is running this function
+ * @param iters number of times to run the measured code
+ */
+typedef void (*BenchFunc) (void *uut, TestSuite *suite, size_t iters);
 /**
  * a function pointer to a setup function, run before EACH testcase is run
  * 
@@ -113,16 +168,46 @@ typedef void (*SuiteInitFunc) (TestSuite *suite);
  * @param suite pointer to current testsuite
  */
 typedef void (*SuiteTermFunc) (TestSuite *suite);
+/**
+ * a function pointer to a failure hook, which is told about every failure
+ * record that gets stored. Internal use.
+ *
+ * @param tc testcase the failure was recorded to
+ * @param site assertion site the failure was grouped under
+ * @param msg the stored failure record
+ */
+typedef void (*FailHook) (TestCase *tc, Failure *site, FailureMsg *msg);
 
 
 /**
  * listing of valid state codes for testcases
  */
 enum cuf_tc_codes {
+    CUF_TC_DESELECTED = -3,/**< code for a testcase left to another shard */
     CUF_TC_SKIP = -2,      /**< code for a testcase that was skipped */
     CUF_TC_FAIL = -1,      /**< code for a testcase that had failed assertation */
     CUF_TC_PASS = 0        /**< code for a testcase that passed all asserts */
 };
+/**
+ * listing of how much detail the FAILURES section of a report goes into
+ */
+enum cuf_report_levels {
+    CUF_REPORT_FULL,       /**< print every stored failure message */
+    CUF_REPORT_COUNTS      /**< only print the number of failures per case */
+};
+
+
+/**
+ * Where the time of a testcase went. Cpu times are those of the thread that
+ * ran the case. For a suite, the sum over its cases.
+ */
+struct case_times_t {
+    uint64_t wall_ns;      /**< wall time of the test function */
+    uint64_t user_ns;      /**< user cpu time of the test function */
+    uint64_t sys_ns;       /**< system cpu time of the test function */
+    uint64_t setup_ns;     /**< wall time of the setup function */
+    uint64_t teardown_ns;  /**< wall time of the teardown function */
+};
 
 
 // TestCase object def
@@ -140,9 +225,54 @@ struct testcase_t {
     void *args;            /**< pointer to a object that hold changle params for this case */
     int status;            /**< status code of the test */
     Dependency *deps;      /**< Pointer to `Dependency` object initialized with deps*/
-    char **err_msgs;       /**< list of errors registered by assert statements */
-    int err_msg_count;     /**< number of of discrete error messages */
-    int err_size;          /**< size of the err_msgs buffer */
+    Failure *failures;     /**< failures recorded by assertions, per site */
+    Failure *last_failure; /**< tail of the `failures` list */
+    int err_msg_count;     /**< number of failures recorded, stored or not */
+    BenchFunc benchfunc;   /**< benchmark to run instead of `testfunc` */
+    BenchStats *bench;     /**< benchmark results, NULL for plain testcases */
+    CaseTimes times;       /**< timings of the last run, zero if skipped */
+    double timeout;        /**< seconds the case may take, 0 for the suite's */
+    bool done;             /**< whether the case has finished running */
+    PerfCounts *perf;      /**< event counts, NULL unless counted */
+    AllocStats *alloc;     /**< heap usage, NULL unless counted */
+    uint64_t peak_rss;     /**< bytes the peak RSS grew by while running */
+    bool cached;           /**< passed from the result cache, not run */
+    const char *skip_reason; /**< why the case was skipped, NULL for
+                                  missing test files */
+    int run_order;         /**< position in the order of the run, see
+                                cuf_order.h */
+};
+/**
+ * The failures recorded to a testcase from a single assertion site (file and
+ * line). Only the first `CUF_ERR_LIMIT` messages are kept, the rest are just
+ * counted, so an assertion failing in a hot loop uses constant memory.
+ * Records are kept in the run's arena (see cuf_arena.h) and released all at
+ * once by `testrunner_destroy()`.
+ */
+struct failure_t {
+    Failure *next;         /**< next failure site of the same testcase */
+    const char *file;      /**< source file of the assertion, NULL if unknown */
+    int line;              /**< source line of the assertion */
+    long count;            /**< number of times this site failed */
+    int stored;            /**< number of messages kept in `msgs` */
+    FailureMsg *msgs;      /**< first messages recorded at this site */
+    FailureMsg *last_msg;  /**< tail of the `msgs` list */
+};
+/**
+ * A single stored failure. Assertions don't format anything when they fail:
+ * the record only points at static strings, and the message is put together
+ * when (and if) the report prints it.
+ */
+struct failure_msg_t {
+    FailureMsg *next;      /**< next failure recorded at the same site */
+    const char *what;      /**< static printf format describing the failed
+                                check, filled with `expr_a` and `expr_b`.
+                                NULL for plain messages held in `detail` */
+    const char *expr_a;    /**< static source text of the first operand */
+    const char *expr_b;    /**< static source text of the second operand */
+    const char *detail;    /**< extra text owned by the run's arena, or NULL */
+    CufValue val_a;        /**< captured value of the first operand */
+    CufValue val_b;        /**< captured value of the second operand */
 };
 // TestCase object manipulators
 /**
@@ -158,7 +288,8 @@ struct testcase_t {
 TestCase *testcase_create(TestFunc funct, char* test_name, Dependency *deps,
                           void *args);
 /**
- * deallocate dynamically allocated testcases
+ * deallocate dynamically allocated testcases. Failure records are owned by the
+ * run and are freed by `testrunner_destroy()` instead.
  * 
  * @param testcase testcase to destroy
  */
@@ -181,6 +312,12 @@ struct testsuite_t {
     int passed;             /**< number of passed tests */
     int failed;             /**< number of failed tests */
     int skipped;            /**< number of skipped tests */
+    int flags;              /**< bitmask of `cuf_suite_flags` options */
+    CaseTimes times;        /**< timings summed over the testcases */
+    double timeout;         /**< default timeout of its cases, 0 for none */
+    uint64_t peak_rss;      /**< largest `peak_rss` of its testcases */
+    uint64_t mem_budget;    /**< `peak_rss` a case may reach, 0 for no limit */
+    int deselected;         /**< number of testcases left to other shards */
 };
 // TestSuite object manipulators
 /**
@@ -191,6 +328,13 @@ struct testsuite_t {
  */
 TestSuite *testsuite_create(char* name, SetupFunc setup, TeardownFunc teardown,
                             SuiteTermFunc init, SuiteTermFunc term);
+/**
+ * Set the option flags of a testsuite, replacing any previously set.
+ *
+ * @param suite TestSuite object to configure
+ * @param flags bitwise or of `cuf_suite_flags` values
+ */
+void testsuite_set_flags(TestSuite *suite, int flags);
 /**
  * Register function to testsuite
  * 
@@ -202,6 +346,50 @@ TestSuite *testsuite_create(char* name, SetupFunc setup, TeardownFunc teardown,
  */
 int testsuite_reg_case(TestSuite *suite, TestFunc test, Dependency *file_deps,
                        char *test_name, void *args);
+/**
+ * Register function to testsuite, with a timeout overriding the suite's
+ *
+ * @param suite TestSuite object to register testcase to
+ * @param test TestFunc object to register
+ * @param file_deps newline delimited string of all files this case depends on
+ * @param test_name name to call this test case
+ * @param args argument object for given case
+ * @param timeout seconds the case may take from setup to teardown
+ */
+int testsuite_reg_case_timeout(TestSuite *suite, TestFunc test,
+                               Dependency *file_deps, char *test_name,
+                               void *args, double timeout);
+/**
+ * Set the default timeout of a suite's testcases. A case that runs longer
+ * (setup and teardown included) fails with a "timed out" message. Isolated
+ * runners kill the case's process and go on with the run; the in-process
+ * runners can't stop a thread, so they print the report of what ran so far
+ * and exit.
+ *
+ * @param suite suite to configure
+ * @param timeout seconds a testcase may take, 0 for no limit
+ */
+void testsuite_set_timeout(TestSuite *suite, double timeout);
+/**
+ * Set a memory budget for a suite's testcases. A case whose setup, test
+ * function and teardown together grow the peak RSS of the process by more
+ * than `bytes` fails with a "Memory:" message. The growth is measured per
+ * process, so budgets are only checked where a case has the process to
+ * itself: in `testrunner_run()`, the isolated runners and zygote suites. The
+ * thread pool runners don't check them, see cuf_prof.h.
+ *
+ * @param suite suite to configure
+ * @param bytes peak RSS growth a testcase may cause, 0 for no limit
+ */
+void testsuite_set_mem_budget(TestSuite *suite, uint64_t bytes);
+/**
+ * Get the timeout that applies to a testcase. Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase to look up
+ * @return seconds the case may take, 0 for no limit
+ */
+double testcase_get_timeout(TestSuite *suite, TestCase *testcase);
 /**
  * Record a failure to current test. Internal use function.
  * 
@@ -211,12 +399,182 @@ int testsuite_reg_case(TestSuite *suite, TestFunc test, Dependency *file_deps,
  * @param err_msg error message to log
  */
 int testsuite_record_fail(TestSuite *suite, char* err_msg);
+/**
+ * Record a failed check to the current test without formatting anything.
+ * Internal use function; this is what the assertion macros call.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion, usually `__FILE__`
+ * @param line source line of the assertion, usually `__LINE__`
+ * @param what static printf format describing the check, taking `expr_a`
+ *             and `expr_b` as its `%s` arguments
+ * @param expr_a static source text of the first operand
+ * @param expr_b static source text of the second operand, may be NULL
+ */
+int testsuite_record_check(TestSuite *suite, const char *file, int line,
+                           const char *what, const char *expr_a,
+                           const char *expr_b);
+/**
+ * Like `testsuite_record_check()`, also keeping the values the operands had
+ * so the report can show them. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion, usually `__FILE__`
+ * @param line source line of the assertion, usually `__LINE__`
+ * @param what static printf format describing the check
+ * @param expr_a static source text of the first operand
+ * @param expr_b static source text of the second operand
+ * @param val_a captured value of the first operand
+ * @param val_b captured value of the second operand
+ */
+int testsuite_record_values(TestSuite *suite, const char *file, int line,
+                            const char *what, const char *expr_a,
+                            const char *expr_b, CufValue val_a,
+                            CufValue val_b);
+/**
+ * Like `testsuite_record_check()`, with extra text printed below the check's
+ * description. The text is only copied if the record is stored. Internal use
+ * function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion, usually `__FILE__`
+ * @param line source line of the assertion, usually `__LINE__`
+ * @param what static printf format describing the check
+ * @param expr_a static source text of the first operand
+ * @param expr_b static source text of the second operand, may be NULL
+ * @param detail extra text to show with the failure
+ */
+int testsuite_record_detail(TestSuite *suite, const char *file, int line,
+                            const char *what, const char *expr_a,
+                            const char *expr_b, const char *detail);
+/**
+ * Get the testcase currently being run for the suite on the calling thread.
+ * Internal use function; the assertion macros use it to find the case to
+ * record to, which stays correct when the cases of one suite are spread over
+ * several threads.
+ *
+ * @param suite suite the running testcase belongs to
+ * @return the testcase being run by this thread
+ */
+TestCase *testsuite_current_case(TestSuite *suite);
+/**
+ * Record a failure to the given testcase. Internal use function.
+ *
+ * @param testcase testcase object to record the failure to
+ * @param err_msg error message to log
+ */
+int testcase_record_fail(TestCase *testcase, char* err_msg);
+/**
+ * Record a failure to the given testcase, grouped by the assertion site it
+ * came from. The record is copied into the run's arena (together with its
+ * detail text, if any) unless the site already stored `CUF_ERR_LIMIT`
+ * records, in which case it is only counted. Internal use function.
+ *
+ * @param testcase testcase object to record the failure to
+ * @param file source file of the assertion, or NULL if unknown
+ * @param line source line of the assertion
+ * @param msg failure record to store
+ */
+int testcase_record(TestCase *testcase, const char *file, int line,
+                    const FailureMsg *msg);
+/**
+ * Format a stored failure record. Internal use function.
+ *
+ * @param out stream to print to
+ * @param testcase testcase the failure was recorded to
+ * @param site assertion site the failure was grouped under
+ * @param msg failure record to format
+ */
+void testcase_print_failure(FILE *out, TestCase *testcase, Failure *site,
+                            FailureMsg *msg);
+/**
+ * Print every stored failure of a testcase the way the FAILURES section of
+ * the report does, including the counts of messages that weren't stored.
+ * Internal use function.
+ *
+ * @param out stream to print to
+ * @param testcase testcase whose failures to print
+ */
+void testcase_print_failures(FILE *out, TestCase *testcase);
+/**
+ * Find the failure site record of a testcase for the given file and line,
+ * creating an empty one if the site has not failed yet. Internal use function.
+ *
+ * @param testcase testcase object the site belongs to
+ * @param file source file of the assertion, or NULL if unknown
+ * @param line source line of the assertion
+ * @return the site record
+ */
+Failure *testcase_fail_site(TestCase *testcase, const char *file, int line);
+/**
+ * Install a process wide hook that is called for every failure message that
+ * gets stored (i.e. not for failures only counted past `CUF_ERR_LIMIT`).
+ * Internal use function.
+ *
+ * @param hook hook to install, or NULL to remove it
+ */
+void testcase_set_fail_hook(FailHook hook);
 /**
  * Run a single test suite and cllect results
  * 
  * @param suite suite to run
  */
 int testsuite_run(TestSuite *suite);
+/**
+ * Run a single test suite, optionally printing a progress marker per case.
+ * Internal use function; parallel runners use this to run suites quietly and
+ * print the progress line themselves, in registration order.
+ *
+ * @param suite suite to run
+ * @param progress print a progress marker to stdout after each case
+ */
+int testsuite_exec(TestSuite *suite, bool progress);
+/**
+ * Run a single testcase of a suite: check its dependencies, then call setup,
+ * the testcase, and teardown, timing each of them into the testcase's
+ * `times`. Does not run the suite init/term functions or update the suite
+ * counters. Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase to run
+ * @return the resulting status code of the testcase
+ */
+int testcase_run(TestSuite *suite, TestCase *testcase);
+/**
+ * Check the testcases and the files a testcase depends on, and mark it as
+ * skipped and done if it can't run. A case whose testcases haven't all run
+ * yet is skipped too, so only call this once they have had their chance.
+ * Internal use function.
+ *
+ * @param testcase testcase about to be run
+ * @return true if the case may run
+ */
+bool testcase_check_deps(TestCase *testcase);
+/**
+ * Call a testcase's function with an already set up uut, routing the
+ * assertions it makes on this thread to the testcase and recording its wall
+ * and cpu time. A failed REQUIRE check or a caught crash ends the function
+ * early, see cuf_guard.h. Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase to call
+ * @param uut uut produced by the suite's setup function
+ */
+void testcase_call(TestSuite *suite, TestCase *testcase, void *uut);
+/**
+ * Recount the passed/failed/skipped counters of a suite from the status of
+ * its testcases that finished. Internal use function.
+ *
+ * @param suite suite to recount
+ */
+void testsuite_tally(TestSuite *suite);
+/**
+ * Print the progress marker (`.`, `x`, or `s`) of a testcase, nothing if it
+ * didn't run. Internal use function, safe to call from multiple threads.
+ *
+ * @param testcase testcase to print the marker for
+ */
+void testcase_print_progress(TestCase *testcase);
 /**
  * Deallocate a heap allocate testsuite and all child testcases
  * 
@@ -234,12 +592,64 @@ struct testrunner_t {
     int arr_size;          /**< size of dynamic buffers in number of elements */
     int suite_count;       /**< number of TestSuite objects in runner */
     int current_suite;     /**< index of current suite in array */
+    int name_width;        /**< alignment width of the progress lines */
+    int report_level;      /**< one of the `cuf_report_levels` */
+    int slowest;           /**< length of the SLOWEST TESTS list */
+    char *timings_path;    /**< file to export timings to, NULL for none */
+    int shard_index;       /**< shard to run, counting from 1 */
+    int shard_count;       /**< number of shards, 1 to run every testcase */
+    char *shard_timings;   /**< results of an earlier run to balance the
+                                shards with, NULL for round-robin */
+    char *results_path;    /**< file to write the results to, NULL for none */
+    char *history_path;    /**< file keeping the outcomes of earlier runs to
+                                order the run by, NULL for none */
+    bool fail_fast;        /**< stop starting cases after the first failure */
+    bool crash_recovery;   /**< record crashing test functions as failures */
 };
 // TestRunner object manipulators
 /**
  * Creates a testrunner on the heap and returns a pointer to it
  */
 TestRunner* testrunner_create();
+/**
+ * Configure a runner from the command line of the test binary. Recognizes
+ * `--shard=i/n`, `--shard-timings=FILE` and `--results=FILE` (see
+ * cuf_shard.h), `--timings=FILE` (see `testrunner_set_timings_file()`),
+ * `--history=FILE` and `--fail-fast` (see cuf_order.h), `--catch-crashes`
+ * (see cuf_guard.h) and leaves any other argument alone, so the binary may
+ * take its own too.
+ *
+ * @param runner testrunner to configure
+ * @param argc argument count, as passed to `main()`
+ * @param argv argument vector, as passed to `main()`
+ * @return 0 on success, -1 after printing a message to stderr if one of the
+ *         recognized options has a bad value
+ */
+int testrunner_parse_args(TestRunner *runner, int argc, char **argv);
+/**
+ * Choose how much detail the FAILURES section of the report goes into.
+ * `CUF_REPORT_COUNTS` skips formatting failure messages altogether.
+ *
+ * @param runner testrunner to configure
+ * @param level one of the `cuf_report_levels`
+ */
+void testrunner_set_report_level(TestRunner *runner, int level);
+/**
+ * Choose how many of the slowest testcases the report lists. Defaults to
+ * `CUF_SLOWEST_COUNT`.
+ *
+ * @param runner testrunner to configure
+ * @param count number of testcases to list, 0 to leave the section out
+ */
+void testrunner_set_slowest(TestRunner *runner, int count);
+/**
+ * Export the timings of every testcase and suite as JSON when the report is
+ * printed, see `prof_write_json()`.
+ *
+ * @param runner testrunner to configure
+ * @param path file to write, NULL to not export
+ */
+void testrunner_set_timings_file(TestRunner *runner, const char *path);
 /**
  * Register a TestSuite to the given testrunner
  * 
@@ -255,7 +665,34 @@ void testrunner_reg_suite(TestRunner *runner, TestSuite **suite);
  */
 int testrunner_run(TestRunner *runner);
 /**
- * deallocate heap allocated test runner
+ * Print the run header, look up the testcases each case depends on, pick the
+ * testcases of the runner's shard, compute the progress line alignment,
+ * start a new run of dependency checks, look the testcases up in the result
+ * cache and order them by their history.
+ * Internal use function.
+ *
+ * @param runner testrunner about to be run
+ */
+void testrunner_print_header(TestRunner *runner);
+/**
+ * Print the right aligned PASSED/FAILED tail of a suite's progress line.
+ * Internal use function.
+ *
+ * @param runner testrunner the suite belongs to
+ * @param suite suite that has finished running
+ */
+void testrunner_print_status(TestRunner *runner, TestSuite *suite);
+/**
+ * Print the FAILURES, SKIPPED TESTS and RESULTS sections for a finished run.
+ * Internal use function.
+ *
+ * @param runner testrunner that has finished running
+ * @return 0 if no tests failed, 1 otherwise
+ */
+int testrunner_report(TestRunner *runner);
+/**
+ * deallocate heap allocated test runner, along with the failure records of
+ * every testcase that was run
  * 
  * @param runner testrunner object to testcase_destroy
  */
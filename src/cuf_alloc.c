@@ -0,0 +1,173 @@
+/**
+ * @file cuf_alloc.c
+ * @brief CUnitFramework (CUF): Allocation Accounting Implementation
+ * @details Counters are kept per thread, so the wrappers never take a lock
+ * and cases run by the thread pool runners don't see each other's
+ * allocations. Block sizes come from `malloc_usable_size()` rather than the
+ * requested size, since that is the only size known again when the block is
+ * freed; live and peak bytes therefore include the allocator's rounding.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef CUF_ALLOC_WRAP
+#include <malloc.h>
+#endif
+
+#include "cuf_alloc.h"
+#include "cuf_value.h"
+
+#ifdef CUF_ALLOC_WRAP
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void __wrap_free(void *ptr);
+
+static void note_alloc(void *ptr);
+static void note_free(size_t size);
+#endif
+
+// counts of the testcase the calling thread is running
+static _Thread_local AllocStats current;
+// whether the calling thread is running a testcase
+static _Thread_local bool counting = false;
+// nesting depth of alloc_pause() on the calling thread
+static _Thread_local int paused = 0;
+
+
+bool alloc_tracking(void) {
+#ifdef CUF_ALLOC_WRAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+void alloc_pause(void) {
+    ++paused;
+}
+
+void alloc_resume(void) {
+    --paused;
+}
+
+int alloc_pause_depth(void) {
+    return paused;
+}
+
+void alloc_set_pause_depth(int depth) {
+    paused = depth;
+}
+
+void alloc_case_begin(void) {
+    memset(&current, 0, sizeof(current));
+    counting = alloc_tracking();
+}
+
+void alloc_case_end(TestCase *testcase) {
+    if(!counting) return;
+    counting = false;
+    if(!testcase->alloc) testcase->alloc = malloc(sizeof(AllocStats));
+    *testcase->alloc = current;
+}
+
+AllocScope alloc_scope_begin(void) {
+    AllocScope scope = {current.allocs, false};
+    return scope;
+}
+
+bool alloc_scope_check(TestSuite *suite, const char *file, int line,
+                       const char *expr, uint64_t limit, AllocScope *scope) {
+    if(!scope->entered) {
+        scope->entered = true;
+        return true;
+    }
+    if(!counting) return false;
+    uint64_t allocs = current.allocs - scope->allocs;
+    if(allocs <= limit) return false;
+    testsuite_record_values(suite, file, line, "Assertion failure: `%s` in "
+                            "block should be AT MOST `%s`", "allocations",
+                            expr, value_from_u64(allocs),
+                            value_from_u64(limit));
+    return false;
+}
+
+void alloc_report(TestRunner *runner) {
+    bool first = true;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            AllocStats *stats = c_case->alloc;
+            if(!stats || (!stats->allocs && !stats->frees)) continue;
+            if(first) {
+                printf("\n-----------ALLOCATIONS:-----------\n");
+                first = false;
+            }
+            printf("\nIn suite: %s, testcase: %s\n    allocs %llu, frees "
+                   "%llu, bytes %llu, peak %llu", suite->name,
+                   c_case->test_name, (unsigned long long) stats->allocs,
+                   (unsigned long long) stats->frees,
+                   (unsigned long long) stats->bytes,
+                   (unsigned long long) stats->peak);
+            if(stats->live > 0) {
+                printf(", leaked %lld bytes in %lld blocks",
+                       (long long) stats->live, (long long) stats->blocks);
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+#ifdef CUF_ALLOC_WRAP
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if(ptr) note_alloc(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    if(ptr) note_alloc(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t old = ptr && counting && !paused? malloc_usable_size(ptr) : 0;
+    void *res = __real_realloc(ptr, size);
+    // a failed realloc leaves the old block alone
+    if(!res && size) return res;
+    if(ptr) note_free(old);
+    if(res) note_alloc(res);
+    return res;
+}
+
+void __wrap_free(void *ptr) {
+    if(ptr && counting && !paused) note_free(malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+static void note_alloc(void *ptr) {
+    if(!counting || paused) return;
+    size_t size = malloc_usable_size(ptr);
+    ++(current.allocs);
+    current.bytes += size;
+    current.live += size;
+    ++(current.blocks);
+    if(current.live > 0 && (uint64_t) current.live > current.peak) {
+        current.peak = current.live;
+    }
+}
+
+static void note_free(size_t size) {
+    if(!counting || paused) return;
+    ++(current.frees);
+    current.live -= size;
+    --(current.blocks);
+}
+#endif
@@ -0,0 +1,149 @@
+/**
+ * @file cuf_alloc.h
+ * @brief CUnitFramework (CUF): Allocation Accounting Interface
+ * @details Opt-in accounting of heap allocations per testcase. Building the
+ * framework with `CUF_ALLOC_WRAP` defined adds `__wrap_` versions of
+ * `malloc()`, `calloc()`, `realloc()` and `free()`, which the test binary
+ * must then be linked against with
+ * `-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free` (the sample
+ * Makefile does both with `make ALLOC_WRAP=1`). Every allocation made by the
+ * thread running a testcase, from its setup to its teardown, is then counted
+ * to that case: number of allocations and frees, bytes allocated, and the
+ * peak number of bytes live at once. Whatever is still live after the
+ * teardown is reported as leaked in the ALLOCATIONS section of the report.
+ *
+ * The linker only redirects calls made from the objects it links, so memory
+ * allocated inside shared libraries (e.g. by libc's `strdup()`) is only seen
+ * when it is freed. Allocations the framework makes for itself, such as
+ * failure records, are not counted.
+ *
+ * Without `CUF_ALLOC_WRAP` nothing is counted and the assertions below
+ * always pass.
+ */
+#ifndef __CUF_ALLOC_H__
+#define __CUF_ALLOC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cuf.h"
+
+
+/**
+ * Assert that a block of code makes no heap allocations. Use it like a
+ * statement taking a block:
+ *
+ *     ASSERT_NO_ALLOCS {
+ *         queue_push(queue, item);
+ *     }
+ *
+ * Leaving the block with `break`, `return` or `goto` skips the check.
+ */
+#define ASSERT_NO_ALLOCS ASSERT_ALLOCS_AT_MOST(0)
+/**
+ * Assert that a block of code makes at most `n` heap allocations, see
+ * `ASSERT_NO_ALLOCS`.
+ *
+ * @param n largest allowed number of allocations
+ */
+#define ASSERT_ALLOCS_AT_MOST(n)\
+    for(AllocScope cuf_alloc_scope = alloc_scope_begin();\
+        alloc_scope_check(suite, __FILE__, __LINE__, #n, (n),\
+                          &cuf_alloc_scope);)
+
+
+/**
+ * Heap usage of a testcase.
+ */
+struct alloc_stats_t {
+    uint64_t allocs;       /**< number of allocations, reallocs included */
+    uint64_t frees;        /**< number of frees, reallocs included */
+    uint64_t bytes;        /**< bytes allocated in total */
+    uint64_t peak;         /**< most bytes live at once */
+    int64_t live;          /**< bytes live at the end, leaked if above 0 */
+    int64_t blocks;        /**< blocks live at the end, leaked if above 0 */
+};
+
+/**
+ * State of an `ASSERT_ALLOCS_AT_MOST()` block. Internal use.
+ */
+typedef struct {
+    uint64_t allocs;       /**< allocation count when the block was entered */
+    bool entered;          /**< whether the block body has been run */
+} AllocScope;
+
+
+/**
+ * Whether allocations are being counted, i.e. the framework was built with
+ * `CUF_ALLOC_WRAP`.
+ *
+ * @return true if allocations are counted
+ */
+bool alloc_tracking(void);
+/**
+ * Stop counting the calling thread's allocations until the matching
+ * `alloc_resume()`, so the framework's own bookkeeping isn't charged to the
+ * testcase. Calls nest. Internal use function.
+ */
+void alloc_pause(void);
+/**
+ * Undo one `alloc_pause()`. Internal use function.
+ */
+void alloc_resume(void);
+/**
+ * Get the nesting depth of `alloc_pause()` on the calling thread. Internal
+ * use function.
+ *
+ * @return number of pauses not yet resumed
+ */
+int alloc_pause_depth(void);
+/**
+ * Set the nesting depth of `alloc_pause()` on the calling thread, e.g. back
+ * to what it was before a jump skipped the matching resumes. Internal use
+ * function.
+ *
+ * @param depth value returned by `alloc_pause_depth()`
+ */
+void alloc_set_pause_depth(int depth);
+/**
+ * Start counting the calling thread's allocations for a testcase about to be
+ * set up. Internal use function.
+ */
+void alloc_case_begin(void);
+/**
+ * Stop counting started by `alloc_case_begin()` and store the counts in the
+ * testcase's `alloc`. Internal use function.
+ *
+ * @param testcase testcase to store the counts to
+ */
+void alloc_case_end(TestCase *testcase);
+/**
+ * Enter an `ASSERT_ALLOCS_AT_MOST()` block. Internal use function.
+ *
+ * @return scope state to pass to `alloc_scope_check()`
+ */
+AllocScope alloc_scope_begin(void);
+/**
+ * Loop condition of an `ASSERT_ALLOCS_AT_MOST()` block: lets the body run
+ * once, then records a failure if it allocated more than `limit` times.
+ * Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr static source text of the limit
+ * @param limit largest allowed number of allocations
+ * @param scope scope state from `alloc_scope_begin()`
+ * @return true to run the body, false once it has run
+ */
+bool alloc_scope_check(TestSuite *suite, const char *file, int line,
+                       const char *expr, uint64_t limit, AllocScope *scope);
+/**
+ * Print the ALLOCATIONS section of a report, if any testcase was counted.
+ * Internal use function.
+ *
+ * @param runner testrunner to report on
+ */
+void alloc_report(TestRunner *runner);
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file cuf_arena.c
+ * @brief CUnitFramework (CUF): Bump Arena Implementation
+ * @details Chunked bump allocator plus the registry of per thread arenas that
+ * the failure records of a run are kept in.
+ */
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_arena.h"
+
+static void fork_lock(void);
+static void fork_unlock(void);
+static void fork_register(void);
+
+/**
+ * a block of memory owned by an arena
+ */
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next; /**< previously filled chunk */
+    size_t size;           /**< usable bytes in `data` */
+    size_t used;           /**< bytes of `data` handed out */
+    alignas(max_align_t) unsigned char data[]; /**< the memory itself */
+} ArenaChunk;
+
+struct arena_t {
+    ArenaChunk *head;      /**< chunk currently allocated from */
+    struct arena_t *next_local; /**< next arena in the per thread registry */
+};
+
+
+// registry of every arena handed out by arena_local()
+static pthread_mutex_t local_lock = PTHREAD_MUTEX_INITIALIZER;
+static Arena *local_arenas = NULL;
+// bumped by arena_release_all() so threads know their arena is gone
+static atomic_uint local_generation = 0;
+static _Thread_local Arena *thread_arena = NULL;
+static _Thread_local unsigned thread_generation = 0;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+
+Arena *arena_create(void) {
+    Arena *arena = malloc(sizeof(Arena));
+    arena->head = NULL;
+    arena->next_local = NULL;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    // keep every allocation aligned for any type
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    ArenaChunk *chunk = arena->head;
+    if(!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = CUF_ARENA_CHUNK_SIZE;
+        if(size > chunk_size) chunk_size = size;
+        chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+    void *mem = chunk->data + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+char *arena_strdup(Arena *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = arena_alloc(arena, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+ArenaMark arena_mark(Arena *arena) {
+    ArenaMark mark = {arena->head, arena->head? arena->head->used : 0};
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    while(arena->head != mark.chunk) {
+        ArenaChunk *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    if(arena->head) arena->head->used = mark.used;
+}
+
+void arena_destroy(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while(chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+Arena *arena_local(void) {
+    unsigned generation = atomic_load(&local_generation);
+    if(!thread_arena || thread_generation != generation) {
+        thread_arena = arena_create();
+        thread_generation = generation;
+        pthread_mutex_lock(&local_lock);
+        thread_arena->next_local = local_arenas;
+        local_arenas = thread_arena;
+        pthread_mutex_unlock(&local_lock);
+    }
+    return thread_arena;
+}
+
+void arena_release_all(void) {
+    pthread_mutex_lock(&local_lock);
+    Arena *arena = local_arenas;
+    local_arenas = NULL;
+    atomic_fetch_add(&local_generation, 1);
+    pthread_mutex_unlock(&local_lock);
+    while(arena) {
+        Arena *next = arena->next_local;
+        arena_destroy(arena);
+        arena = next;
+    }
+    thread_arena = NULL;
+}
+
+void arena_prepare_fork(void) {
+    pthread_once(&fork_once, &fork_register);
+}
+
+
+static void fork_lock(void) {
+    pthread_mutex_lock(&local_lock);
+}
+
+static void fork_unlock(void) {
+    pthread_mutex_unlock(&local_lock);
+}
+
+static void fork_register(void) {
+    pthread_atfork(&fork_lock, &fork_unlock, &fork_unlock);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file cuf_arena.h
+ * @brief CUnitFramework (CUF): Bump Arena Interface
+ * @details Bump allocator the framework keeps its failure records in. Memory
+ * handed out by an arena is never freed on its own; the whole arena goes at
+ * once, which keeps a storm of failing assertions from turning into a storm
+ * of malloc calls.
+ */
+#ifndef __CUF_ARENA_H__
+#define __CUF_ARENA_H__
+
+#include <stddef.h>
+
+// default size of each block of memory an arena grabs from malloc
+#define CUF_ARENA_CHUNK_SIZE (64 * 1024)
+
+
+/**
+ * Struct for a bump arena. Operate on it using the `arena_*` family of
+ * functions.
+ */
+typedef struct arena_t Arena;
+/**
+ * A position in an arena to go back to, see `arena_mark()`.
+ */
+typedef struct {
+    struct arena_chunk_t *chunk; /**< chunk allocated from at the time */
+    size_t used;           /**< bytes of it handed out at the time */
+} ArenaMark;
+
+/**
+ * Create an empty arena on the heap. No memory is reserved until the first
+ * allocation.
+ *
+ * @return pointer to the created Arena object.
+ */
+Arena *arena_create(void);
+/**
+ * Allocate memory from an arena. The memory is suitably aligned for any type
+ * and stays valid until the arena is destroyed.
+ *
+ * @param arena arena to allocate from
+ * @param size number of bytes to allocate
+ * @return pointer to the allocated memory
+ */
+void *arena_alloc(Arena *arena, size_t size);
+/**
+ * Copy a string into an arena.
+ *
+ * @param arena arena to allocate from
+ * @param str nul terminated string to copy
+ * @return pointer to the copy
+ */
+char *arena_strdup(Arena *arena, const char *str);
+/**
+ * Remember how far an arena has been allocated, to undo what is allocated
+ * after with `arena_rewind()`.
+ *
+ * @param arena arena to mark
+ * @return the current position in the arena
+ */
+ArenaMark arena_mark(Arena *arena);
+/**
+ * Release everything allocated from an arena since `arena_mark()` returned
+ * `mark`. Memory from then on must no longer be used.
+ *
+ * @param arena arena to rewind
+ * @param mark position returned by `arena_mark()` on the same arena
+ */
+void arena_rewind(Arena *arena, ArenaMark mark);
+/**
+ * Destroy an arena, releasing everything ever allocated from it.
+ *
+ * @param arena arena to destroy
+ */
+void arena_destroy(Arena *arena);
+/**
+ * Get the calling thread's arena for the current run, creating it on first
+ * use. Each thread allocates from its own arena, so no locking is needed on
+ * the allocation path.
+ *
+ * @return the calling thread's arena
+ */
+Arena *arena_local(void);
+/**
+ * Destroy every arena handed out by `arena_local()` on any thread. Memory
+ * from them must no longer be used. The next `arena_local()` call starts a
+ * fresh arena.
+ */
+void arena_release_all(void);
+/**
+ * Make `fork()` safe while other threads use `arena_local()`: the registry
+ * lock is taken around the fork, so the child never starts with it held by
+ * a thread it doesn't have. Internal use function, called before forking;
+ * only the first call does anything.
+ */
+void arena_prepare_fork(void);
+
+#endif
@@ -5,12 +5,58 @@
  * these will not work without the supporting CUF testing infrastructure, i.e.
  * you must use these from within a TESTCASE definition, executed by a
  * TestRunner for everything to work correctly.
+ *
+ * A failing assertion doesn't format anything: it records which check failed
+ * and the source text of its operands, and the message is only put together
+ * when the report prints it. The comparison assertions evaluate each operand
+ * exactly once and keep the values they had for the report.
+ *
+ * `ASSERT_*` checks are non-fatal: the test goes on after a failure. Their
+ * `REQUIRE_*` counterparts stop the test function at the first failure and
+ * go on with the teardown, and `REQUIRE()` does the same for any other
+ * assertion, e.g. `REQUIRE(ASSERT_ARRAY(...))` (see cuf_guard.h).
  */
 #ifndef __CUF_ASSERT_H__
 #define __CUF_ASSERT_H__
 
 #include "cuf.h"
+#include "cuf_alloc.h"
+#include "cuf_guard.h"
 #include "cuf_util.h"
+#include "cuf_value.h"
+
+
+/**
+ * Capture both operands, compare them by value and record a failure if the
+ * ordering doesn't satisfy `pass`. Internal use macro.
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ * @param pass condition on `cuf_ord`, the result of `value_compare()`
+ * @param what static printf format describing the check
+ */
+#define CUF_ASSERT_CMP(a, b, pass, what) do {\
+    CufValue cuf_val_a = CUF_VALUE(a);\
+    CufValue cuf_val_b = CUF_VALUE(b);\
+    int cuf_ord = value_compare(cuf_val_a, cuf_val_b);\
+    if(!(pass)) {\
+        testsuite_record_values(suite, __FILE__, __LINE__, what, #a, #b,\
+                                cuf_val_a, cuf_val_b);\
+    }\
+} while (0)
+/**
+ * Record a failure naming the operand if `fail` holds. Internal use macro.
+ *
+ * @param a operand of the check
+ * @param fail condition on the operand under which the check fails
+ * @param what static printf format describing the check, taking the source
+ *             text of `a` as its only `%s` argument
+ */
+#define CUF_ASSERT_ONE(a, fail, what) do {\
+    if(fail) {\
+        testsuite_record_check(suite, __FILE__, __LINE__, what, #a, NULL);\
+    }\
+} while (0)
 
 
 /**
@@ -18,79 +64,39 @@
  * 
  * @param a value to assert
  */
-#define ASSERT_TRUE(a) do {\
-    if(a != true) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be TRUE\nat %s:%d; in TestCase:"\
-                    " %s", #a, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_TRUE(a) CUF_ASSERT_ONE(a, (a) != true,\
+    "Assertion failure: Value of `%s` should be TRUE")
 /**
  * Assert that a is FALSE, and fail the test if this is not true
  * 
  * @param a value to assert
  */
-#define ASSERT_FALSE(a) do {\
-    if(a == true) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be FALSE\nat %s:%d; in TestCase:"\
-                    " %s", #a, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_FALSE(a) CUF_ASSERT_ONE(a, (a) == true,\
+    "Assertion failure: Value of `%s` should be FALSE")
 /**
  * Assert that a is equal to b, and fail the test if this is not true
  * 
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_EQ(a,b) do {\
-    if(!(a == b)) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` and `%s` should BE EQUAL\n"\
-                    "At %s:%d; in TestCase: %s", #a, #b, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name);\
-        testsuite_record_fail(suite, (char *)&msg);\
-    }\
-} while (0)
+#define ASSERT_EQ(a,b) CUF_ASSERT_CMP(a, b, cuf_ord == 0,\
+    "Assertion failure: Value of `%s` and `%s` should BE EQUAL")
 /**
  * Assert that a is NOT EQUAL to b, and fail the test if this is not true
  * 
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_NE(a,b) do {\
-    if(a == b) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` and `%s` should NOT BE EQUAL\n"\
-                    "at %s:%d; in TestCase: %s", #a, #b, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name]);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_NE(a,b) CUF_ASSERT_CMP(a, b, cuf_ord != 0,\
+    "Assertion failure: Value of `%s` and `%s` should NOT BE EQUAL")
 /**
  * Assert that a is LESS THAN to b, and fail the test if this is not true
  * 
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_LT(a,b) do {\
-    if(a >= b) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be LESS THAN `%s` \n"\
-                    "At %s:%d; in TestCase: %s", #a, #b, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name]);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_LT(a,b) CUF_ASSERT_CMP(a, b, cuf_ord == -1,\
+    "Assertion failure: Value of `%s` should be LESS THAN `%s`")
 /**
  * Assert that a is LESS THAN or EQUAL to b, and fail the test if this is not
  * true
@@ -98,31 +104,16 @@
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_LE(a,b) do {\
-    if(a > b) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be LESS THAN or EQUAL to `%s`\n"\
-                    "at %s:%d; in case: %s", #a, #b, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name]);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_LE(a,b) CUF_ASSERT_CMP(a, b, cuf_ord == -1 || cuf_ord == 0,\
+    "Assertion failure: Value of `%s` should be LESS THAN or EQUAL to `%s`")
 /**
  * Assert that a is GREATER THAN b, and fail the test if this is not true
  * 
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_GT(a,b) do {\
-    if(a <= b) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be GREATER THAN to `%s`\n"\
-                    "at %s:%d; in case: %s", #a, #b, __FILE__, __LINE__,\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_GT(a,b) CUF_ASSERT_CMP(a, b, cuf_ord == 1,\
+    "Assertion failure: Value of `%s` should be GREATER THAN to `%s`")
 /**
  * Assert that a is GREATER THAN or EQUAL to b, and fail the test if this is not
  * true
@@ -130,50 +121,34 @@
  * @param a LHS of comparison
  * @param b RHS of comparison
  */
-#define ASSERT_GE(a,b) do {\
-    if(a < b) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "Value of `%s` should be GREATER THAN or EQUAL to `%s`\n"\
-                    "At %s:%d; in TestCase: %s", #a, #b, __FILE__, __LINE__,\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_GE(a,b) CUF_ASSERT_CMP(a, b, cuf_ord == 1 || cuf_ord == 0,\
+    "Assertion failure: Value of `%s` should be GREATER THAN or EQUAL to `%s`")
 
 /**
  * Assert that a is NULL
  * 
  * @param a variable/value to check
  */
-#define ASSERT_NOT_NULL(a) do {\
-    if(!a) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "`%s` is NULL or NULL pointer\nAt %s:%d; in TestCase:"\
-                    " %s", #a, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_NOT_NULL(a) CUF_ASSERT_ONE(a, !(a),\
+    "Assertion failure: `%s` is NULL or NULL pointer")
 /**
  * Assert that a is NOT NULL
  * 
  * @param a variable/value to check
  */
-#define ASSERT_NULL(a) do {\
-    if(a) {\
-        char msg[CUF_BUF_SIZE] = {'0'};\
-        snprintf((char *) &msg, CUF_BUF_SIZE, "Assertion failure: "\
-                    "`%s` is NOT NULL or NULL pointer\nAt %s:%d; in TestCase:"\
-                    " %s", #a, __FILE__, __LINE__,\
-                    suite->testcases[suite->current_test]->test_name);\
-        testsuite_record_fail(suite, (char *) &msg);\
-    }\
-} while (0)
+#define ASSERT_NULL(a) CUF_ASSERT_ONE(a, (a),\
+    "Assertion failure: `%s` is NOT NULL or NULL pointer")
 
 /**
  * Assert values in an n-dimentional array against an array of expected values,
- * using a comparison function `comp_func`
+ * using a comparison function `comp_func`, called exactly once per element
+ * compared. The error buffer handed to it holds at least `CUF_BUF_SIZE`
+ * bytes; it belongs to the thread and is reused by every comparison on it,
+ * so nothing is allocated while elements match, except on the thread's
+ * first comparison (see `cuf_array_msgs()`). Allocating and growing the
+ * buffer isn't charged to the testcase's heap usage (see cuf_alloc.h), any
+ * other allocation `comp_func` makes is. A `comp_func` crashing mid-message
+ * leaves nothing behind (see cuf_guard.h).
  *
  * @param actual values to compare against reference
  * @param expected reference array
@@ -182,37 +157,106 @@
  */
 #define ASSERT_ARRAY(actual, expected, comp_func, n) do {\
     int cuf_arr_errors = 0;\
-    char* cuf_cfm = malloc(CUF_BUF_SIZE);\
-    size_t cuf_cfm_used = 0;\
-    size_t cuf_cfm_size = CUF_BUF_SIZE;\
-    for(size_t i = 0; i < (size_t) n; ++i) {\
-        if(cuf_arr_errors >= CUF_ERR_LIMIT) {\
-            if(cuf_cfm_size - cuf_cfm_used <= 60) {\
-            CUF_ARRAY_EXPAND(cuf_cfm, cuf_cfm_size, 2, char*);\
-            }\
-            char cuf_trunc_msg[] = "Errors exceeded max output... Truncated...";\
-            strncpy(&cuf_cfm[cuf_cfm_used], cuf_trunc_msg, strlen(cuf_trunc_msg));\
-            cuf_cfm_used += strlen(cuf_trunc_msg);\
-            break;\
+    ArrayMsgs *cuf_cfm = cuf_array_msgs();\
+    for(size_t i = 0; i < (size_t) (n); ++i) {\
+        if(comp_func(i, &(actual)[i], &(expected)[i], &cuf_cfm->msgs,\
+                     &cuf_cfm->used, &cuf_cfm->size)) {\
+            continue;\
         }\
-        bool cuf_arr_status = comp_func(i, &actual[i], &expected[i], &cuf_cfm, &cuf_cfm_used,\
-                                        &cuf_cfm_size);\
-        if(cuf_arr_status == false) {\
-            ++cuf_arr_errors;\
+        if(++cuf_arr_errors >= CUF_ERR_LIMIT && i + 1 < (size_t) (n)) {\
+            cuf_array_msg(&cuf_cfm->msgs, &cuf_cfm->used, &cuf_cfm->size,\
+                          "Errors exceeded max output... Truncated...");\
+            break;\
         }\
     }\
-    cuf_cfm[cuf_cfm_used] = '\0';\
     if(cuf_arr_errors > 0) {\
-        char *msg = malloc((CUF_BUF_SIZE + cuf_cfm_used + 1)*sizeof(char));\
-        snprintf(msg, CUF_BUF_SIZE + cuf_cfm_used + 1, "Assertion failure:"\
-                " array comparison of `%s` against `%s` with comparison function `%s` failed"\
-                "\nAt %s:%d; in TestCase: %s\nFail Elems:\n%s", #actual, #expected, #comp_func,\
-                __FILE__, __LINE__, suite->testcases[suite->current_test]->test_name,\
-                cuf_cfm);\
-        testsuite_record_fail(suite, msg);\
-        free(msg);\
+        testsuite_record_detail(suite, __FILE__, __LINE__, "Assertion failure:"\
+                                " array comparison of `%s` against `%s` "\
+                                "failed\nFail Elems:", #actual, #expected,\
+                                cuf_array_msgs_end(#comp_func));\
     }\
-    free(cuf_cfm);\
+    cuf_array_msgs_reset();\
 } while (0)
 
+/**
+ * Make any assertion fatal: if it records a failure, stop the test function
+ * right after it and go on with the teardown.
+ *
+ * @param check assertion statement, e.g. `ASSERT_EQ(a, b)`
+ */
+#define REQUIRE(check) do {\
+    int cuf_req_count = testsuite_current_case(suite)->err_msg_count;\
+    check;\
+    if(testsuite_current_case(suite)->err_msg_count != cuf_req_count) {\
+        guard_fatal();\
+    }\
+} while (0)
+/**
+ * Like `ASSERT_TRUE()`, stopping the test function if a is not TRUE
+ *
+ * @param a value to assert
+ */
+#define REQUIRE_TRUE(a) REQUIRE(ASSERT_TRUE(a))
+/**
+ * Like `ASSERT_FALSE()`, stopping the test function if a is not FALSE
+ *
+ * @param a value to assert
+ */
+#define REQUIRE_FALSE(a) REQUIRE(ASSERT_FALSE(a))
+/**
+ * Like `ASSERT_EQ()`, stopping the test function if a is not equal to b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_EQ(a,b) REQUIRE(ASSERT_EQ(a, b))
+/**
+ * Like `ASSERT_NE()`, stopping the test function if a is equal to b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_NE(a,b) REQUIRE(ASSERT_NE(a, b))
+/**
+ * Like `ASSERT_LT()`, stopping the test function if a is not less than b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_LT(a,b) REQUIRE(ASSERT_LT(a, b))
+/**
+ * Like `ASSERT_LE()`, stopping the test function if a is greater than b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_LE(a,b) REQUIRE(ASSERT_LE(a, b))
+/**
+ * Like `ASSERT_GT()`, stopping the test function if a is not greater than b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_GT(a,b) REQUIRE(ASSERT_GT(a, b))
+/**
+ * Like `ASSERT_GE()`, stopping the test function if a is less than b
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ */
+#define REQUIRE_GE(a,b) REQUIRE(ASSERT_GE(a, b))
+/**
+ * Like `ASSERT_NOT_NULL()`, stopping the test function if a is NULL, before
+ * anything can dereference it
+ *
+ * @param a variable/value to check
+ */
+#define REQUIRE_NOT_NULL(a) REQUIRE(ASSERT_NOT_NULL(a))
+/**
+ * Like `ASSERT_NULL()`, stopping the test function if a is not NULL
+ *
+ * @param a variable/value to check
+ */
+#define REQUIRE_NULL(a) REQUIRE(ASSERT_NULL(a))
+
 #endif
@@ -0,0 +1,339 @@
+/**
+ * @file cuf_bench.c
+ * @brief CUnitFramework (CUF): Microbenchmark Implementation
+ * @details Calibration, sampling and reporting for benchmarks. Samples are
+ * timed with `cuf_now_ns()`, and summarized by their median and median
+ * absolute deviation, which unlike the mean don't get dragged around by the
+ * odd sample that caught an interrupt.
+ *
+ * The baseline file is plain text with one benchmark per line: suite name,
+ * benchmark name and the per iteration sample times in nanoseconds,
+ * separated by tabs (samples by spaces). Lines starting with '#' are ignored.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_bench.h"
+#include "cuf_util.h"
+
+
+/**
+ * the saved samples of one benchmark
+ */
+typedef struct {
+    char *suite;           /**< name of the suite */
+    char *name;            /**< name of the benchmark */
+    int samples;           /**< number of samples in `sample_ns` */
+    double sample_ns[CUF_BENCH_SAMPLES]; /**< time per iteration per sample */
+} BaselineEntry;
+
+/**
+ * the baseline file of the run, see `bench_set_baseline()`
+ */
+typedef struct {
+    char *path;            /**< file to read and write, NULL if unset */
+    double threshold;      /**< relative slowdown to tolerate */
+    bool update;           /**< overwrite entries with passing results */
+    BaselineEntry *entries; /**< entries of the file */
+    int count;             /**< number of entries */
+    int size;              /**< allocated size of `entries` */
+} Baseline;
+
+static uint64_t bench_sample(TestSuite *suite, TestCase *testcase, void *uut,
+                             size_t iters);
+static double median_of(double *vals, int count);
+static int compare_doubles(const void *a, const void *b);
+static BaselineEntry *baseline_find(const char *suite, const char *name);
+static BaselineEntry *baseline_add(const char *suite, const char *name);
+static void baseline_compare(TestCase *testcase, BenchStats *stats,
+                             BaselineEntry *entry);
+static double mann_whitney_greater(const double *base, int n1,
+                                   const double *cur, int n2);
+
+// only written before and after the run, read only while cases run
+static Baseline baseline = {NULL, 0, false, NULL, 0, 0};
+
+
+int testsuite_reg_bench(TestSuite *suite, BenchFunc bench, Dependency *deps,
+                        char *name, void *args) {
+    testsuite_reg_case(suite, NULL, deps, name, args);
+    TestCase *testcase = suite->testcases[suite->test_count - 1];
+    testcase->benchfunc = bench;
+    testcase->bench = calloc(1, sizeof(BenchStats));
+    return 0;
+}
+
+void bench_run(TestSuite *suite, TestCase *testcase, void *uut) {
+    BenchStats *stats = testcase->bench;
+    stats->samples = 0;
+    // grow the iteration count until one sample is long enough to time well
+    size_t iters = 1;
+    while(true) {
+        uint64_t ns = bench_sample(suite, testcase, uut, iters);
+        if(testcase->status == CUF_TC_FAIL) return;
+        if(ns >= CUF_BENCH_SAMPLE_NS || iters >= CUF_BENCH_MAX_ITERS) break;
+        // aim a little past the target, but don't trust a single tiny sample
+        // to jump more than 100x ahead
+        size_t next = iters * 100;
+        if(ns > 0) {
+            double scaled = 1.2 * iters * CUF_BENCH_SAMPLE_NS / ns;
+            if(scaled < next) next = (size_t) scaled;
+        }
+        if(next <= iters) next = iters + 1;
+        if(next > CUF_BENCH_MAX_ITERS) next = CUF_BENCH_MAX_ITERS;
+        iters = next;
+    }
+    stats->iters = iters;
+    for(int i = 0; i < CUF_BENCH_WARMUP; ++i) {
+        bench_sample(suite, testcase, uut, iters);
+        if(testcase->status == CUF_TC_FAIL) return;
+    }
+    for(int i = 0; i < CUF_BENCH_SAMPLES; ++i) {
+        uint64_t ns = bench_sample(suite, testcase, uut, iters);
+        if(testcase->status == CUF_TC_FAIL) return;
+        stats->sample_ns[i] = (double) ns / iters;
+        ++(stats->samples);
+    }
+
+    double sorted[CUF_BENCH_SAMPLES];
+    memcpy(sorted, stats->sample_ns, sizeof(double) * stats->samples);
+    stats->median_ns = median_of(sorted, stats->samples);
+    stats->min_ns = sorted[0];
+    double dev[CUF_BENCH_SAMPLES];
+    for(int i = 0; i < stats->samples; ++i) {
+        dev[i] = stats->sample_ns[i] - stats->median_ns;
+        if(dev[i] < 0) dev[i] = -dev[i];
+    }
+    stats->mad_ns = median_of(dev, stats->samples);
+
+    stats->baseline_ns = 0;
+    BaselineEntry *entry = baseline_find(suite->name, testcase->test_name);
+    if(entry) baseline_compare(testcase, stats, entry);
+}
+
+void bench_report(TestRunner *runner) {
+    bool first = true;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            BenchStats *stats = c_case->bench;
+            if(!stats || stats->samples == 0) continue;
+            if(c_case->status != CUF_TC_PASS) continue;
+            if(first) {
+                printf("\n-----------BENCHMARKS:-----------\n");
+                first = false;
+            }
+            char median[32], mad[32], min[32];
+            cuf_format_ns(median, sizeof(median), stats->median_ns);
+            cuf_format_ns(mad, sizeof(mad), stats->mad_ns);
+            cuf_format_ns(min, sizeof(min), stats->min_ns);
+            double ops = stats->median_ns > 0? 1e9 / stats->median_ns : 0;
+            printf("\nIn suite: %s, benchmark: %s\n    median %s, MAD %s, "
+                   "min %s, %.0f ops/sec (%d samples x %zu iterations)",
+                   suite->name, c_case->test_name, median, mad, min, ops,
+                   stats->samples, stats->iters);
+            if(stats->baseline_ns > 0) {
+                printf(", %+.1f%% vs baseline", 100 *
+                       (stats->median_ns / stats->baseline_ns - 1));
+            }
+            printf("\n");
+        }
+    }
+}
+
+int bench_set_baseline(const char *path, double threshold, bool update) {
+    bench_clear_baseline();
+    baseline.path = strdup(path);
+    baseline.threshold = threshold;
+    baseline.update = update;
+    FILE *in = fopen(path, "r");
+    // no file yet just means nothing to compare against
+    if(!in) return errno == ENOENT? 0 : -1;
+    char *line = NULL;
+    size_t cap = 0;
+    while(getline(&line, &cap, in) > 0) {
+        if(line[0] == '#') continue;
+        char *save = NULL;
+        char *suite = strtok_r(line, "\t", &save);
+        char *name = strtok_r(NULL, "\t", &save);
+        char *pos = strtok_r(NULL, "\n", &save);
+        if(!suite || !name || !pos) continue;
+        BaselineEntry *entry = baseline_find(suite, name);
+        if(!entry) entry = baseline_add(suite, name);
+        entry->samples = 0;
+        while(entry->samples < CUF_BENCH_SAMPLES) {
+            char *end;
+            double val = strtod(pos, &end);
+            if(end == pos) break;
+            entry->sample_ns[entry->samples++] = val;
+            pos = end;
+        }
+    }
+    free(line);
+    fclose(in);
+    return 0;
+}
+
+int bench_save_baseline(TestRunner *runner) {
+    if(!baseline.path) return 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            BenchStats *stats = c_case->bench;
+            if(!stats || stats->samples == 0) continue;
+            // a regression must never sneak into the baseline by itself
+            if(c_case->status != CUF_TC_PASS) continue;
+            BaselineEntry *entry = baseline_find(suite->name,
+                                                 c_case->test_name);
+            if(entry && !baseline.update) continue;
+            if(!entry) entry = baseline_add(suite->name, c_case->test_name);
+            entry->samples = stats->samples;
+            memcpy(entry->sample_ns, stats->sample_ns,
+                   sizeof(double) * stats->samples);
+        }
+    }
+    // write next to the old file and swap, so a crash can't leave half of it
+    size_t len = strlen(baseline.path) + 5;
+    char *tmp_path = malloc(len);
+    snprintf(tmp_path, len, "%s.tmp", baseline.path);
+    FILE *out = fopen(tmp_path, "w");
+    if(!out) {
+        free(tmp_path);
+        return -1;
+    }
+    fprintf(out, "# cuf benchmark baseline: suite, benchmark, ns/iteration\n");
+    for(int i = 0; i < baseline.count; ++i) {
+        BaselineEntry *entry = &baseline.entries[i];
+        fprintf(out, "%s\t%s\t", entry->suite, entry->name);
+        for(int j = 0; j < entry->samples; ++j) {
+            fprintf(out, j? " %.6g" : "%.6g", entry->sample_ns[j]);
+        }
+        fprintf(out, "\n");
+    }
+    int ret = fclose(out)? -1 : rename(tmp_path, baseline.path);
+    free(tmp_path);
+    return ret? -1 : 0;
+}
+
+void bench_clear_baseline(void) {
+    for(int i = 0; i < baseline.count; ++i) {
+        free(baseline.entries[i].suite);
+        free(baseline.entries[i].name);
+    }
+    free(baseline.entries);
+    free(baseline.path);
+    baseline.path = NULL;
+    baseline.entries = NULL;
+    baseline.count = 0;
+    baseline.size = 0;
+}
+
+
+static uint64_t bench_sample(TestSuite *suite, TestCase *testcase, void *uut,
+                             size_t iters) {
+    uint64_t start = cuf_now_ns();
+    testcase->benchfunc(uut, suite, iters);
+    return cuf_now_ns() - start;
+}
+
+static double median_of(double *vals, int count) {
+    if(count == 0) return 0;
+    qsort(vals, count, sizeof(double), &compare_doubles);
+    if(count % 2) return vals[count / 2];
+    return (vals[count/2 - 1] + vals[count/2]) / 2;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static BaselineEntry *baseline_find(const char *suite, const char *name) {
+    for(int i = 0; i < baseline.count; ++i) {
+        BaselineEntry *entry = &baseline.entries[i];
+        if(!strcmp(entry->suite, suite) && !strcmp(entry->name, name)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static BaselineEntry *baseline_add(const char *suite, const char *name) {
+    if(baseline.count == baseline.size) {
+        baseline.size = baseline.size? baseline.size * 2 : CUF_ARRAY_SIZE;
+        baseline.entries = realloc(baseline.entries,
+                                   sizeof(BaselineEntry) * baseline.size);
+    }
+    BaselineEntry *entry = &baseline.entries[baseline.count++];
+    entry->suite = strdup(suite);
+    entry->name = strdup(name);
+    entry->samples = 0;
+    return entry;
+}
+
+static void baseline_compare(TestCase *testcase, BenchStats *stats,
+                             BaselineEntry *entry) {
+    if(entry->samples == 0) return;
+    double sorted[CUF_BENCH_SAMPLES];
+    memcpy(sorted, entry->sample_ns, sizeof(double) * entry->samples);
+    stats->baseline_ns = median_of(sorted, entry->samples);
+    // updating accepts whatever this run measures as the new normal
+    if(stats->baseline_ns <= 0 || baseline.update) return;
+    double change = stats->median_ns / stats->baseline_ns - 1;
+    if(change <= baseline.threshold) return;
+    // a slower median alone could be noise, the samples have to agree
+    double p = mann_whitney_greater(entry->sample_ns, entry->samples,
+                                    stats->sample_ns, stats->samples);
+    if(p >= CUF_BENCH_ALPHA) return;
+    char now[32], before[32];
+    cuf_format_ns(now, sizeof(now), stats->median_ns);
+    cuf_format_ns(before, sizeof(before), stats->baseline_ns);
+    char msg[CUF_BUF_SIZE];
+    snprintf(msg, CUF_BUF_SIZE, "Benchmark regression: regressed %.0f%% "
+             "(p<%g), median %s against %s in the baseline\nIn TestCase: %s",
+             100 * change, CUF_BENCH_ALPHA, now, before, testcase->test_name);
+    testcase_record_fail(testcase, msg);
+}
+
+static double mann_whitney_greater(const double *base, int n1,
+                                   const double *cur, int n2) {
+    // U counts the pairs where the current sample is the slower one
+    double u = 0;
+    for(int i = 0; i < n2; ++i) {
+        for(int j = 0; j < n1; ++j) {
+            if(cur[i] > base[j]) {
+                u += 1;
+            } else if(cur[i] == base[j]) {
+                u += 0.5;
+            }
+        }
+    }
+    // tied values shrink the variance of U
+    int n = n1 + n2;
+    double all[2 * CUF_BENCH_SAMPLES];
+    memcpy(all, base, sizeof(double) * n1);
+    memcpy(all + n1, cur, sizeof(double) * n2);
+    qsort(all, n, sizeof(double), &compare_doubles);
+    double ties = 0;
+    for(int i = 0; i < n;) {
+        int j = i;
+        while(j < n && all[j] == all[i]) ++j;
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    double mean = n1 * (double) n2 / 2;
+    double var = n1 * (double) n2 / 12 * ((n + 1) - ties / (n * (n - 1.0)));
+    if(var <= 0) return 1;
+    // normal approximation with continuity correction
+    double z = (u - mean - 0.5) / sqrt(var);
+    return 0.5 * erfc(z / sqrt(2));
+}
@@ -0,0 +1,130 @@
+/**
+ * @file cuf_bench.h
+ * @brief CUnitFramework (CUF): Microbenchmark Interface
+ * @details Benchmarks are registered to a TestSuite next to its testcases and
+ * go through the same dependency checks, setup and teardown. Instead of being
+ * called once, a benchmark is handed an iteration count: the runner
+ * calibrates that count until a sample takes a measurable amount of time,
+ * runs a few warmup samples, then times `CUF_BENCH_SAMPLES` samples. The
+ * results show up in a BENCHMARKS section of the report.
+ *
+ * With a baseline file set (see `bench_set_baseline()`), the samples of each
+ * benchmark are also compared against the ones saved by an earlier run, and
+ * a benchmark that got significantly slower fails like a testcase would.
+ */
+#ifndef __CUF_BENCH_H__
+#define __CUF_BENCH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cuf.h"
+
+// number of timed samples taken per benchmark
+#define CUF_BENCH_SAMPLES 31
+// number of untimed samples run after calibration
+#define CUF_BENCH_WARMUP 3
+// wall time a single sample should take, in nanoseconds
+#define CUF_BENCH_SAMPLE_NS 5000000
+// upper bound on the calibrated iteration count
+#define CUF_BENCH_MAX_ITERS ((size_t) 1 << 30)
+// significance level a regression against the baseline has to reach
+#define CUF_BENCH_ALPHA 0.01
+
+
+/**
+ * Define a benchmark function. It must run the code being measured `iters`
+ * times; assertions work as in a testcase.
+ *
+ * @param name name of benchmark, must be valid c name and unique
+ */
+#define BENCHMARK(name) void name(void *uut, TestSuite *suite, size_t iters)
+/**
+ * shortcut macro to register a benchmark to a testsuite
+ *
+ * @param suite TestSuite object to register benchmark to
+ * @param bench BenchFunc function to register
+ * @param deps Dependency object for the benchmark
+ * @param args argument object for given benchmark
+ */
+#define REGISTER_BENCHMARK(suite, bench, deps, args)\
+            testsuite_reg_bench(suite, bench, deps, #bench, args)
+
+
+/**
+ * Timing results of a benchmark. Times are per iteration.
+ */
+struct bench_stats_t {
+    size_t iters;          /**< iterations per sample, from calibration */
+    int samples;           /**< number of samples taken */
+    double sample_ns[CUF_BENCH_SAMPLES]; /**< time per iteration per sample */
+    double median_ns;      /**< median of the samples */
+    double mad_ns;         /**< median absolute deviation of the samples */
+    double min_ns;         /**< fastest sample */
+    double baseline_ns;    /**< median of the baseline samples, 0 if none */
+};
+
+/**
+ * Register a benchmark to a suite. Benchmarks count as testcases: they pass
+ * unless an assertion in them fails, and are skipped on missing
+ * dependencies.
+ *
+ * @param suite suite to register to
+ * @param bench benchmark function
+ * @param deps Dependency object for the benchmark
+ * @param name name to call this benchmark
+ * @param args variable args object to use for this benchmark
+ * @return 0
+ */
+int testsuite_reg_bench(TestSuite *suite, BenchFunc bench, Dependency *deps,
+                        char *name, void *args);
+/**
+ * Compare benchmarks against a baseline file and keep it up to date. After
+ * each benchmark, its samples are tested against the baseline ones with a
+ * one sided Mann-Whitney U test; if the median got slower by more than
+ * `threshold` and the slowdown is significant at `CUF_BENCH_ALPHA`, the
+ * benchmark fails with a "regressed N% (p<0.01)" message. When the report
+ * is printed, benchmarks that passed and are missing from the file are added
+ * to it. With `update` set, nothing is gated and every benchmark that passed
+ * overwrites its entry, to accept an intended slowdown.
+ *
+ * The file is read here, so call this before running; it stays loaded until
+ * `testrunner_destroy()`.
+ *
+ * @param path path of the baseline file, which may not exist yet
+ * @param threshold relative slowdown to tolerate, e.g. 0.05 for 5%
+ * @param update whether to replace existing entries with this run's samples
+ * @return 0 on success, -1 if an existing file could not be read
+ */
+int bench_set_baseline(const char *path, double threshold, bool update);
+/**
+ * Calibrate, warm up and time a benchmark, filling in its stats. Internal
+ * use function; called by `testcase_call()`.
+ *
+ * @param suite suite the benchmark belongs to
+ * @param testcase the benchmark's testcase
+ * @param uut uut produced by setup
+ */
+void bench_run(TestSuite *suite, TestCase *testcase, void *uut);
+/**
+ * Print the BENCHMARKS section of a report, if any benchmark has results.
+ * Internal use function.
+ *
+ * @param runner testrunner to report on
+ */
+void bench_report(TestRunner *runner);
+/**
+ * Write this run's results to the baseline file, if one is set. Internal use
+ * function.
+ *
+ * @param runner testrunner whose benchmarks to save
+ * @return 0 on success or without a baseline, -1 if writing failed
+ */
+int bench_save_baseline(TestRunner *runner);
+/**
+ * Forget the baseline set with `bench_set_baseline()`. Internal use
+ * function.
+ */
+void bench_clear_baseline(void);
+
+#endif
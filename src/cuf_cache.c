@@ -0,0 +1,476 @@
+/**
+ * @file cuf_cache.c
+ * @brief CUnitFramework (CUF): Result Cache Implementation
+ * @details The cache file is a `CUF_CACHE_MAGIC` header, a uint64 entry
+ * count and that many (name hash, input hash) pairs of uint64s sorted by
+ * name hash, all in native byte order. Only the code and data sections of
+ * the test binary (allocated PROGBITS sections of its ELF file) go into the
+ * input hash, so rebuilding unchanged code with different debug info or
+ * build ids still hits; a binary that isn't ELF is hashed whole.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <elf.h>
+#endif
+
+#include "cuf_cache.h"
+
+#define XXH_P1 UINT64_C(11400714785074694791)
+#define XXH_P2 UINT64_C(14029467366897019727)
+#define XXH_P3 UINT64_C(1609587929392839161)
+#define XXH_P4 UINT64_C(9650029242287828579)
+#define XXH_P5 UINT64_C(2870177450012600261)
+
+
+/**
+ * a testcase in the cache file, or of the run being prepared
+ */
+typedef struct {
+    uint64_t name;         /**< hash of suite, name and registration order */
+    uint64_t key;          /**< hash of the inputs, 0 if not cacheable */
+} CacheEntry;
+
+/**
+ * content hash of a dependency file
+ */
+typedef struct {
+    const DepPath *path;   /**< interned path of the file */
+    uint64_t hash;         /**< hash of the contents */
+    bool ok;               /**< whether the file could be read */
+} FileHash;
+
+/**
+ * dependency files to hash, shared by the hashing threads
+ */
+typedef struct {
+    FileHash *files;       /**< files to hash */
+    int count;             /**< number of files */
+    int next;              /**< next file nobody took yet */
+    pthread_mutex_t lock;  /**< guards `next` */
+} HashJob;
+
+/**
+ * a testcase's name hash and position, to number same named cases
+ */
+typedef struct {
+    uint64_t name;         /**< hash of suite and testcase name */
+    int index;             /**< index of the testcase in its suite */
+} NamedCase;
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input);
+static uint64_t xxh_merge(uint64_t acc, uint64_t val);
+static uint64_t read_u64(const unsigned char *pos);
+static bool map_file(const char *path, void **data, size_t *size);
+static bool exe_hash(uint64_t *hash);
+static bool file_hash(const char *path, uint64_t *hash);
+static void hash_files(FileHash *files, int count);
+static void *hash_worker(void *arg);
+static void name_suite(TestSuite *suite, CacheEntry *entries);
+static int compare_entries(const void *a, const void *b);
+static int compare_files(const void *a, const void *b);
+static int compare_named(const void *a, const void *b);
+static int compare_ptrs(const void *a, const void *b);
+
+// the result cache, see cache_set_file()
+static struct {
+    char *path;            // cache file, NULL for no cache
+    void *map;             // mapping of the file, NULL if it doesn't exist
+    size_t map_size;       // size of `map` in bytes
+    const CacheEntry *entries; // sorted entries inside `map`
+    size_t count;          // number of `entries`
+    CacheEntry *run;       // entry per testcase of the prepared run
+    int run_count;         // number of entries in `run`
+} cache = {NULL, NULL, 0, NULL, 0, NULL, 0};
+
+
+uint64_t cache_hash(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *pos = data;
+    const unsigned char *end = pos + len;
+    uint64_t hash;
+    if(len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2;
+        uint64_t v2 = seed + XXH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_P1;
+        do {
+            v1 = xxh_round(v1, read_u64(pos));
+            v2 = xxh_round(v2, read_u64(pos + 8));
+            v3 = xxh_round(v3, read_u64(pos + 16));
+            v4 = xxh_round(v4, read_u64(pos + 24));
+            pos += 32;
+        } while(end - pos >= 32);
+        hash = ((v1 << 1) | (v1 >> 63)) + ((v2 << 7) | (v2 >> 57)) +
+               ((v3 << 12) | (v3 >> 52)) + ((v4 << 18) | (v4 >> 46));
+        hash = xxh_merge(hash, v1);
+        hash = xxh_merge(hash, v2);
+        hash = xxh_merge(hash, v3);
+        hash = xxh_merge(hash, v4);
+    } else {
+        hash = seed + XXH_P5;
+    }
+    hash += len;
+    for(; end - pos >= 8; pos += 8) {
+        hash ^= xxh_round(0, read_u64(pos));
+        hash = ((hash << 27) | (hash >> 37)) * XXH_P1 + XXH_P4;
+    }
+    if(end - pos >= 4) {
+        uint32_t word;
+        memcpy(&word, pos, sizeof(word));
+        hash ^= word * XXH_P1;
+        hash = ((hash << 23) | (hash >> 41)) * XXH_P2 + XXH_P3;
+        pos += 4;
+    }
+    for(; pos < end; ++pos) {
+        hash ^= *pos * XXH_P5;
+        hash = ((hash << 11) | (hash >> 53)) * XXH_P1;
+    }
+    hash ^= hash >> 33;
+    hash *= XXH_P2;
+    hash ^= hash >> 29;
+    hash *= XXH_P3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+int cache_set_file(const char *path) {
+    cache_clear();
+    cache.path = strdup(path);
+    void *map;
+    size_t size;
+    if(!map_file(path, &map, &size)) {
+        // no file yet just means nothing is cached
+        return errno == ENOENT? 0 : -1;
+    }
+    uint64_t count;
+    size_t header = sizeof(CUF_CACHE_MAGIC) - 1 + sizeof(count);
+    if(size < header || memcmp(map, CUF_CACHE_MAGIC, header - sizeof(count))) {
+        if(size) munmap(map, size);
+        return -1;
+    }
+    memcpy(&count, (char *) map + header - sizeof(count), sizeof(count));
+    if((size - header) / sizeof(CacheEntry) != count ||
+       (size - header) % sizeof(CacheEntry)) {
+        munmap(map, size);
+        return -1;
+    }
+    cache.map = map;
+    cache.map_size = size;
+    cache.entries = (const CacheEntry *) ((char *) map + header);
+    cache.count = count;
+    return 0;
+}
+
+void cache_prepare(TestRunner *runner) {
+    if(!cache.path) return;
+    free(cache.run);
+    cache.run = NULL;
+    cache.run_count = 0;
+    int total = 0;
+    int total_deps = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        total += suite->test_count;
+        for(int j = 0; j < suite->test_count; ++j) {
+            Dependency *deps = suite->testcases[j]->deps;
+            suite->testcases[j]->cached = false;
+            if(deps && deps->has_filedeps) total_deps += deps->filedep_count;
+        }
+    }
+    uint64_t binary;
+    if(total == 0 || !exe_hash(&binary)) return;
+
+    // paths are interned, so equal pointers mean the same file
+    const DepPath **paths = malloc(sizeof(DepPath *) * (total_deps + 1));
+    int npaths = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            Dependency *deps = suite->testcases[j]->deps;
+            if(!deps || !deps->has_filedeps) continue;
+            for(int k = 0; k < deps->filedep_count; ++k) {
+                paths[npaths++] = deps->filedeps[k];
+            }
+        }
+    }
+    qsort(paths, npaths, sizeof(DepPath *), &compare_ptrs);
+    FileHash *files = malloc(sizeof(FileHash) * (npaths + 1));
+    int nfiles = 0;
+    for(int i = 0; i < npaths; ++i) {
+        if(i && paths[i] == paths[i - 1]) continue;
+        files[nfiles].path = paths[i];
+        files[nfiles].hash = 0;
+        files[nfiles].ok = false;
+        ++nfiles;
+    }
+    free(paths);
+    hash_files(files, nfiles);
+
+    cache.run = malloc(sizeof(CacheEntry) * total);
+    cache.run_count = total;
+    CacheEntry *entry = cache.run;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        name_suite(suite, entry);
+        for(int j = 0; j < suite->test_count; ++j, ++entry) {
+            TestCase *c_case = suite->testcases[j];
+            Dependency *deps = c_case->deps;
+            // benchmarks are run for their timings, never skip them
+            entry->key = 0;
+            if(c_case->benchfunc) continue;
+            if(c_case->status == CUF_TC_DESELECTED) continue;
+            uint64_t key = cache_hash(&binary, sizeof(binary), entry->name);
+            bool ok = true;
+            int count = deps && deps->has_filedeps? deps->filedep_count : 0;
+            for(int k = 0; k < count && ok; ++k) {
+                FileHash find = {deps->filedeps[k], 0, false};
+                FileHash *file = bsearch(&find, files, nfiles,
+                                         sizeof(FileHash), &compare_files);
+                ok = file->ok;
+                key = cache_hash(&file->hash, sizeof(file->hash), key);
+            }
+            if(!ok) continue;
+            entry->key = key? key : 1;
+            const CacheEntry *hit = NULL;
+            if(cache.count) {
+                hit = bsearch(entry, cache.entries, cache.count,
+                              sizeof(CacheEntry), &compare_entries);
+            }
+            if(hit && hit->key == entry->key && dependency_check(deps)) {
+                c_case->cached = true;
+            }
+        }
+    }
+    free(files);
+}
+
+int cache_save(TestRunner *runner) {
+    if(!cache.path || !cache.run) return 0;
+    CacheEntry *entries = malloc(sizeof(CacheEntry) *
+                                 (cache.run_count + cache.count + 1));
+    size_t count = 0;
+    // every case of this run replaces its old entry, failed ones by nothing;
+    // cases left to other shards weren't part of it
+    CacheEntry *names = malloc(sizeof(CacheEntry) * (cache.run_count + 1));
+    size_t nnames = 0;
+    CacheEntry *entry = cache.run;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++entry) {
+            if(suite->testcases[j]->status == CUF_TC_DESELECTED) continue;
+            names[nnames++] = *entry;
+        }
+    }
+    qsort(names, nnames, sizeof(CacheEntry), &compare_entries);
+    for(size_t i = 0; i < cache.count; ++i) {
+        if(!nnames || !bsearch(&cache.entries[i], names, nnames,
+                               sizeof(CacheEntry), &compare_entries)) {
+            entries[count++] = cache.entries[i];
+        }
+    }
+    free(names);
+    entry = cache.run;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++entry) {
+            TestCase *c_case = suite->testcases[j];
+            if(!entry->key || !c_case->done) continue;
+            if(c_case->status != CUF_TC_PASS) continue;
+            entries[count++] = *entry;
+        }
+    }
+    qsort(entries, count, sizeof(CacheEntry), &compare_entries);
+
+    // write next to the old file and swap, so a crash can't leave half of it
+    size_t len = strlen(cache.path) + 5;
+    char *tmp_path = malloc(len);
+    snprintf(tmp_path, len, "%s.tmp", cache.path);
+    FILE *out = fopen(tmp_path, "wb");
+    if(!out) {
+        free(tmp_path);
+        free(entries);
+        return -1;
+    }
+    uint64_t count64 = count;
+    fwrite(CUF_CACHE_MAGIC, 1, sizeof(CUF_CACHE_MAGIC) - 1, out);
+    fwrite(&count64, sizeof(count64), 1, out);
+    fwrite(entries, sizeof(CacheEntry), count, out);
+    free(entries);
+    int ret = fclose(out)? -1 : rename(tmp_path, cache.path);
+    free(tmp_path);
+    return ret? -1 : 0;
+}
+
+void cache_clear(void) {
+    if(cache.map) munmap(cache.map, cache.map_size);
+    free(cache.path);
+    free(cache.run);
+    cache.path = NULL;
+    cache.map = NULL;
+    cache.map_size = 0;
+    cache.entries = NULL;
+    cache.count = 0;
+    cache.run = NULL;
+    cache.run_count = 0;
+}
+
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+static uint64_t read_u64(const unsigned char *pos) {
+    uint64_t val;
+    memcpy(&val, pos, sizeof(val));
+    return val;
+}
+
+static bool map_file(const char *path, void **data, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return false;
+    }
+    *size = st.st_size;
+    *data = NULL;
+    // an empty file has nothing to map
+    if(*size) *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if(*data == MAP_FAILED) {
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+static bool exe_hash(uint64_t *hash) {
+    void *data;
+    size_t size;
+    if(!map_file("/proc/self/exe", &data, &size)) return false;
+    const unsigned char *bytes = data;
+    bool whole = true;
+    *hash = 0;
+#ifdef __linux__
+    const Elf64_Ehdr *ehdr = data;
+    if(size >= sizeof(Elf64_Ehdr) && !memcmp(bytes, ELFMAG, SELFMAG) &&
+       bytes[EI_CLASS] == ELFCLASS64 && ehdr->e_shoff &&
+       ehdr->e_shoff + (uint64_t) ehdr->e_shnum * sizeof(Elf64_Shdr) <=
+       size) {
+        const Elf64_Shdr *shdrs = (const Elf64_Shdr *) (bytes + ehdr->e_shoff);
+        whole = false;
+        for(int i = 0; i < ehdr->e_shnum; ++i) {
+            const Elf64_Shdr *shdr = &shdrs[i];
+            if(shdr->sh_type != SHT_PROGBITS) continue;
+            if(!(shdr->sh_flags & SHF_ALLOC)) continue;
+            if(shdr->sh_offset + shdr->sh_size > size) continue;
+            *hash = cache_hash(bytes + shdr->sh_offset, shdr->sh_size, *hash);
+        }
+    }
+#endif
+    if(whole) *hash = cache_hash(bytes, size, 0);
+    if(size) munmap(data, size);
+    return true;
+}
+
+static bool file_hash(const char *path, uint64_t *hash) {
+    void *data;
+    size_t size;
+    if(!map_file(path, &data, &size)) return false;
+    *hash = cache_hash(data, size, 0);
+    if(size) munmap(data, size);
+    return true;
+}
+
+static void hash_files(FileHash *files, int count) {
+    HashJob job = {files, count, 0, PTHREAD_MUTEX_INITIALIZER};
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = cpus > 1? (int) cpus - 1 : 0;
+    if(nthreads > count - 1) nthreads = count > 1? count - 1 : 0;
+    pthread_t *threads = malloc(sizeof(pthread_t) * (nthreads + 1));
+    int started = 0;
+    for(; started < nthreads; ++started) {
+        if(pthread_create(&threads[started], NULL, &hash_worker, &job)) break;
+    }
+    // this thread pitches in as well
+    hash_worker(&job);
+    for(int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+}
+
+static void *hash_worker(void *arg) {
+    HashJob *job = arg;
+    while(true) {
+        pthread_mutex_lock(&job->lock);
+        int i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if(i >= job->count) return NULL;
+        FileHash *file = &job->files[i];
+        file->ok = file_hash(dependency_path_name(file->path), &file->hash);
+    }
+}
+
+static void name_suite(TestSuite *suite, CacheEntry *entries) {
+    if(suite->test_count == 0) return;
+    uint64_t base = cache_hash(suite->name, strlen(suite->name) + 1, 0);
+    NamedCase *named = malloc(sizeof(NamedCase) * suite->test_count);
+    for(int i = 0; i < suite->test_count; ++i) {
+        const char *name = suite->testcases[i]->test_name;
+        named[i].name = cache_hash(name, strlen(name) + 1, base);
+        named[i].index = i;
+    }
+    // same named cases are numbered in registration order
+    qsort(named, suite->test_count, sizeof(NamedCase), &compare_named);
+    uint32_t nth = 0;
+    for(int i = 0; i < suite->test_count; ++i) {
+        nth = (i && named[i].name == named[i - 1].name)? nth + 1 : 0;
+        entries[named[i].index].name = cache_hash(&nth, sizeof(nth),
+                                                  named[i].name);
+    }
+    free(named);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    uint64_t x = ((const CacheEntry *) a)->name;
+    uint64_t y = ((const CacheEntry *) b)->name;
+    return (x > y) - (x < y);
+}
+
+static int compare_files(const void *a, const void *b) {
+    return compare_ptrs(&((const FileHash *) a)->path,
+                        &((const FileHash *) b)->path);
+}
+
+static int compare_named(const void *a, const void *b) {
+    const NamedCase *x = a;
+    const NamedCase *y = b;
+    if(x->name != y->name) return (x->name > y->name) - (x->name < y->name);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compare_ptrs(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) *(const void *const *) a;
+    uintptr_t y = (uintptr_t) *(const void *const *) b;
+    return (x > y) - (x < y);
+}
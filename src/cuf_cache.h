@@ -0,0 +1,73 @@
+/**
+ * @file cuf_cache.h
+ * @brief CUnitFramework (CUF): Result Cache Interface
+ * @details Incremental runs: with a cache file set, a testcase that passed
+ * before and whose inputs haven't changed since is reported as a cached pass
+ * without calling its setup, test function or teardown. The inputs of a case
+ * are its suite and name, the code and data sections of the test binary, and
+ * the contents of every file in its `Dependency` file dependencies, all
+ * hashed together with XXH64. Anything else a case reads, such as a shared
+ * library under test, must be listed as a file dependency to be noticed.
+ * Cases registered more than once under the same name are told apart by the
+ * order they were registered in. Benchmarks are always run.
+ *
+ * The cache is a sorted array of (name hash, input hash) pairs, memory
+ * mapped and binary searched, so looking up 100k cases touches a few pages
+ * and allocates nothing. Each distinct dependency file is hashed once per
+ * run, on as many threads as there are cpus.
+ */
+#ifndef __CUF_CACHE_H__
+#define __CUF_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cuf.h"
+
+// first bytes of a cache file, the last one is the format version
+#define CUF_CACHE_MAGIC "CUFCACH1"
+
+
+/**
+ * Hash a buffer with XXH64.
+ *
+ * @param data buffer to hash
+ * @param len size of `data` in bytes
+ * @param seed seed of the hash, also used to chain several buffers
+ * @return the hash
+ */
+uint64_t cache_hash(const void *data, size_t len, uint64_t seed);
+/**
+ * Keep a result cache in a file: cases whose inputs match a pass recorded
+ * there are not run, and the passes of this run are written back when the
+ * report is printed. Entries of cases that aren't part of the run are kept.
+ *
+ * The file is mapped here, so call this before running; it stays mapped
+ * until `testrunner_destroy()`.
+ *
+ * @param path path of the cache file, which may not exist yet
+ * @return 0 on success, -1 if an existing file could not be read or is not
+ *         a cache file
+ */
+int cache_set_file(const char *path);
+/**
+ * Hash the inputs of every testcase of a run and mark the ones found in the
+ * cache as `cached`, if a cache file is set. Internal use function.
+ *
+ * @param runner testrunner about to be run
+ */
+void cache_prepare(TestRunner *runner);
+/**
+ * Write the passes of a run to the cache file, if one is set. Internal use
+ * function.
+ *
+ * @param runner testrunner whose results to save
+ * @return 0 on success or without a cache, -1 if writing failed
+ */
+int cache_save(TestRunner *runner);
+/**
+ * Unmap the cache set with `cache_set_file()`. Internal use function.
+ */
+void cache_clear(void);
+
+#endif
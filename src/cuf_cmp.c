@@ -0,0 +1,587 @@
+/**
+ * @file cuf_cmp.c
+ * @brief CUnitFramework (CUF): Bulk Comparison Implementation
+ * @details Mismatch kernels behind the typed array assertions. Every kernel
+ * walks both buffers in `CUF_CMP_BLOCK` sized blocks and returns the start of
+ * the first block that doesn't pass its check, so the hot loop does nothing
+ * but load and compare. The SSE2 and AVX2 versions are compiled with target
+ * attributes and picked once at runtime, so the library still runs on cpus
+ * without them.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cuf_alloc.h"
+#include "cuf_cmp.h"
+#include "cuf_util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CUF_CMP_X86
+#include <immintrin.h>
+#endif
+
+
+/**
+ * set of mismatch kernels, all returning the start of the first failing block
+ * at or after `from`, or `n` if there is none
+ */
+typedef struct {
+    size_t (*diff) (const unsigned char *a, const unsigned char *b,
+                    size_t from, size_t n);            /**< byte equality */
+    size_t (*far_f32) (const float *a, const float *b, size_t from, size_t n,
+                       float tol);                     /**< float closeness */
+    size_t (*far_f64) (const double *a, const double *b, size_t from,
+                       size_t n, double tol);          /**< double closeness */
+} CmpKernels;
+
+/**
+ * a read only memory mapping of a whole file
+ */
+typedef struct {
+    const unsigned char *data; /**< mapped contents, NULL for empty files */
+    size_t size;           /**< size of the file in bytes */
+} FileMap;
+
+
+static size_t diff_scalar(const unsigned char *a, const unsigned char *b,
+                          size_t from, size_t n);
+static size_t far_f32_scalar(const float *a, const float *b, size_t from,
+                             size_t n, float tol);
+static size_t far_f64_scalar(const double *a, const double *b, size_t from,
+                             size_t n, double tol);
+static void kernels_pick(void);
+static size_t find_block(const void *a, const void *b, size_t from,
+                         size_t bytes);
+static int array_eq(TestSuite *suite, const char *file, int line,
+                    const char *expr_a, const char *expr_b, const void *a,
+                    const void *b, size_t n, size_t size);
+static int array_near(TestSuite *suite, const char *file, int line,
+                      const char *expr_a, const char *expr_b, const void *a,
+                      const void *b, size_t n, double abs_tol,
+                      uint64_t max_ulps, bool f32);
+static int buffer_vs_file(TestSuite *suite, const char *file, int line,
+                          const char *what, const char *expr_a,
+                          const char *expr_b, const char *name_a,
+                          const unsigned char *a, size_t len_a,
+                          const char *golden);
+static int file_map(const char *path, FileMap *map);
+static void file_unmap(FileMap *map);
+static int hex_window(char *out, size_t cap, const char *label,
+                      const unsigned char *data, size_t size, size_t start);
+static bool near_f32(float x, float y, float tol, uint64_t max_ulps);
+static bool near_f64(double x, double y, double tol, uint64_t max_ulps);
+
+static CmpKernels kernels = {&diff_scalar, &far_f32_scalar, &far_f64_scalar};
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+
+size_t cmp_find_diff(const void *a, const void *b, size_t n) {
+    const unsigned char *pa = a;
+    const unsigned char *pb = b;
+    size_t i = find_block(a, b, 0, n);
+    for(; i < n; ++i) {
+        if(pa[i] != pb[i]) return i;
+    }
+    return n;
+}
+
+int cmp_eq_u8(TestSuite *suite, const char *file, int line,
+              const char *expr_a, const char *expr_b, const uint8_t *a,
+              const uint8_t *b, size_t n) {
+    return array_eq(suite, file, line, expr_a, expr_b, a, b, n, sizeof(*a));
+}
+
+int cmp_eq_i32(TestSuite *suite, const char *file, int line,
+               const char *expr_a, const char *expr_b, const int32_t *a,
+               const int32_t *b, size_t n) {
+    return array_eq(suite, file, line, expr_a, expr_b, a, b, n, sizeof(*a));
+}
+
+int cmp_eq_i64(TestSuite *suite, const char *file, int line,
+               const char *expr_a, const char *expr_b, const int64_t *a,
+               const int64_t *b, size_t n) {
+    return array_eq(suite, file, line, expr_a, expr_b, a, b, n, sizeof(*a));
+}
+
+int cmp_near_f32(TestSuite *suite, const char *file, int line,
+                 const char *expr_a, const char *expr_b, const float *a,
+                 const float *b, size_t n, double abs_tol, uint64_t max_ulps) {
+    return array_near(suite, file, line, expr_a, expr_b, a, b, n, abs_tol,
+                      max_ulps, true);
+}
+
+int cmp_near_f64(TestSuite *suite, const char *file, int line,
+                 const char *expr_a, const char *expr_b, const double *a,
+                 const double *b, size_t n, double abs_tol, uint64_t max_ulps) {
+    return array_near(suite, file, line, expr_a, expr_b, a, b, n, abs_tol,
+                      max_ulps, false);
+}
+
+int cmp_file_eq(TestSuite *suite, const char *file, int line,
+                const char *expr_a, const char *expr_b, const char *path,
+                const char *golden) {
+    FileMap map;
+    int err = file_map(path, &map);
+    if(err) {
+        char detail[CUF_BUF_SIZE];
+        snprintf(detail, CUF_BUF_SIZE, "Could not map `%s`: %s", path,
+                 strerror(err));
+        testsuite_record_detail(suite, file, line, "Assertion failure: file "
+                                "`%s` should EQUAL `%s`", expr_a, expr_b,
+                                detail);
+        return 1;
+    }
+    int ret = buffer_vs_file(suite, file, line, "Assertion failure: file "
+                             "`%s` should EQUAL `%s`", expr_a, expr_b, path,
+                             map.data, map.size, golden);
+    file_unmap(&map);
+    return ret;
+}
+
+int cmp_buffer_eq_file(TestSuite *suite, const char *file, int line,
+                       const char *expr_a, const char *expr_b,
+                       const void *buf, size_t len, const char *golden) {
+    return buffer_vs_file(suite, file, line, "Assertion failure: buffer `%s` "
+                          "should EQUAL file `%s`", expr_a, expr_b, expr_a,
+                          buf, len, golden);
+}
+
+
+static size_t find_block(const void *a, const void *b, size_t from,
+                         size_t bytes) {
+    pthread_once(&kernels_once, &kernels_pick);
+    return kernels.diff(a, b, from, bytes);
+}
+
+static int array_eq(TestSuite *suite, const char *file, int line,
+                    const char *expr_a, const char *expr_b, const void *a,
+                    const void *b, size_t n, size_t size) {
+    const unsigned char *pa = a;
+    const unsigned char *pb = b;
+    size_t bytes = n * size;
+    size_t block = find_block(a, b, 0, bytes);
+    if(block == bytes) return 0;
+
+    // the message buffer is ours, keep it out of the testcase's heap usage
+    alloc_pause();
+    // only the first bad block is looked at element by element
+    char *msg = NULL;
+    size_t used = 0;
+    size_t msg_size = 0;
+    size_t end = block + CUF_CMP_BLOCK < bytes? block + CUF_CMP_BLOCK : bytes;
+    size_t last = block / size;
+    int errors = 0;
+    bool truncated = false;
+    for(size_t i = block / size; i < end / size; ++i) {
+        if(!memcmp(pa + i*size, pb + i*size, size)) continue;
+        if(errors == CUF_ERR_LIMIT) {
+            cuf_array_msg(&msg, &used, &msg_size,
+                          "Errors exceeded max output... Truncated...");
+            truncated = true;
+            break;
+        }
+        ++errors;
+        last = i;
+        if(size == sizeof(uint8_t)) {
+            cuf_array_msg(&msg, &used, &msg_size, "[%zu] %u != %u\n", i,
+                          (unsigned) pa[i], (unsigned) pb[i]);
+        } else if(size == sizeof(int32_t)) {
+            int32_t x, y;
+            memcpy(&x, pa + i*size, size);
+            memcpy(&y, pb + i*size, size);
+            cuf_array_msg(&msg, &used, &msg_size, "[%zu] %" PRId32 " != %"
+                          PRId32 "\n", i, x, y);
+        } else {
+            int64_t x, y;
+            memcpy(&x, pa + i*size, size);
+            memcpy(&y, pb + i*size, size);
+            cuf_array_msg(&msg, &used, &msg_size, "[%zu] %" PRId64 " != %"
+                          PRId64 "\n", i, x, y);
+        }
+    }
+    if(!truncated && find_block(a, b, end, bytes) < bytes) {
+        cuf_array_msg(&msg, &used, &msg_size, "More mismatches after element "
+                      "%zu", last);
+    }
+    testsuite_record_detail(suite, file, line, "Assertion failure: array "
+                            "`%s` should EQUAL `%s`\nFail Elems:", expr_a,
+                            expr_b, cuf_array_msg_end(&msg, &used, &msg_size));
+    free(msg);
+    alloc_resume();
+    return 1;
+}
+
+static int array_near(TestSuite *suite, const char *file, int line,
+                      const char *expr_a, const char *expr_b, const void *a,
+                      const void *b, size_t n, double abs_tol,
+                      uint64_t max_ulps, bool f32) {
+    const float *fa = a;
+    const float *fb = b;
+    const double *da = a;
+    const double *db = b;
+    size_t step = CUF_CMP_BLOCK / (f32? sizeof(float) : sizeof(double));
+    pthread_once(&kernels_once, &kernels_pick);
+
+    // the message buffer is ours, keep it out of the testcase's heap usage
+    alloc_pause();
+    char *msg = NULL;
+    size_t used = 0;
+    size_t msg_size = 0;
+    int errors = 0;
+    size_t from = 0;
+    size_t last = 0;
+    while(from < n) {
+        // the kernels only know about the absolute tolerance, a flagged block
+        // may still pass once the ulp distance is taken into account
+        size_t block = f32? kernels.far_f32(fa, fb, from, n, (float) abs_tol)
+                          : kernels.far_f64(da, db, from, n, abs_tol);
+        if(block == n) break;
+        size_t end = block + step < n? block + step : n;
+        // once a block was reported, later ones are only mentioned
+        bool reported = errors > 0;
+        size_t i = block;
+        for(; i < end; ++i) {
+            bool ok = f32? near_f32(fa[i], fb[i], (float) abs_tol, max_ulps)
+                         : near_f64(da[i], db[i], abs_tol, max_ulps);
+            if(ok) continue;
+            if(reported) break;
+            if(errors == CUF_ERR_LIMIT) {
+                cuf_array_msg(&msg, &used, &msg_size,
+                              "Errors exceeded max output... Truncated...");
+                break;
+            }
+            ++errors;
+            last = i;
+            if(f32) {
+                cuf_array_msg(&msg, &used, &msg_size, "[%zu] %.9g vs %.9g\n",
+                              i, fa[i], fb[i]);
+            } else {
+                cuf_array_msg(&msg, &used, &msg_size,
+                              "[%zu] %.17g vs %.17g\n", i, da[i], db[i]);
+            }
+        }
+        if(i < end) {
+            if(reported) {
+                cuf_array_msg(&msg, &used, &msg_size, "More mismatches after "
+                              "element %zu", last);
+            }
+            break;
+        }
+        from = end;
+    }
+    if(errors == 0) {
+        alloc_resume();
+        return 0;
+    }
+    testsuite_record_detail(suite, file, line, "Assertion failure: array "
+                            "`%s` should be NEAR `%s`\nFail Elems:", expr_a,
+                            expr_b, cuf_array_msg_end(&msg, &used, &msg_size));
+    free(msg);
+    alloc_resume();
+    return 1;
+}
+
+static int buffer_vs_file(TestSuite *suite, const char *file, int line,
+                          const char *what, const char *expr_a,
+                          const char *expr_b, const char *name_a,
+                          const unsigned char *a, size_t len_a,
+                          const char *golden) {
+    FileMap map;
+    int err = file_map(golden, &map);
+    // everything below is formatted on the stack, the arena takes a copy
+    char detail[4 * CUF_BUF_SIZE];
+    if(err) {
+        snprintf(detail, sizeof(detail), "Could not map `%s`: %s", golden,
+                 strerror(err));
+        testsuite_record_detail(suite, file, line, what, expr_a, expr_b,
+                                detail);
+        return 1;
+    }
+    size_t common = len_a < map.size? len_a : map.size;
+    size_t off = cmp_find_diff(a, map.data, common);
+    if(off == common && len_a == map.size) {
+        file_unmap(&map);
+        return 0;
+    }
+
+    // show the 16 byte row holding the difference and the one before it
+    size_t start = off - off % 16;
+    start = start >= 16? start - 16 : 0;
+    int used = snprintf(detail, sizeof(detail), "First difference at offset "
+                        "%zu (0x%zx); sizes %zu and %zu\n", off, off, len_a,
+                        map.size);
+    used += hex_window(detail + used, sizeof(detail) - used, name_a, a, len_a,
+                       start);
+    hex_window(detail + used, sizeof(detail) - used, golden, map.data,
+               map.size, start);
+    testsuite_record_detail(suite, file, line, what, expr_a, expr_b, detail);
+    file_unmap(&map);
+    return 1;
+}
+
+static int file_map(const char *path, FileMap *map) {
+    map->data = NULL;
+    map->size = 0;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return errno;
+    struct stat st;
+    if(fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    map->size = st.st_size;
+    // mapping zero bytes fails, an empty file is simply no data
+    if(map->size > 0) {
+        void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            map->size = 0;
+            return err;
+        }
+        posix_madvise(data, map->size, POSIX_MADV_SEQUENTIAL);
+        map->data = data;
+    }
+    close(fd);
+    return 0;
+}
+
+static void file_unmap(FileMap *map) {
+    if(map->data) munmap((void *) map->data, map->size);
+    map->data = NULL;
+}
+
+static int hex_window(char *out, size_t cap, const char *label,
+                      const unsigned char *data, size_t size, size_t start) {
+    size_t used = snprintf(out, cap, "%s:\n", label);
+    for(size_t row = start; row < start + 32 && row < size; row += 16) {
+        if(used < cap) used += snprintf(out + used, cap - used, "  %08zx ",
+                                        row);
+        for(size_t i = row; i < row + 16; ++i) {
+            if(used >= cap) break;
+            if(i < size) {
+                used += snprintf(out + used, cap - used, " %02x", data[i]);
+            } else {
+                used += snprintf(out + used, cap - used, "   ");
+            }
+        }
+        if(used < cap) used += snprintf(out + used, cap - used, "  |");
+        for(size_t i = row; i < row + 16 && i < size && used < cap; ++i) {
+            char c = data[i] >= 0x20 && data[i] < 0x7f? data[i] : '.';
+            used += snprintf(out + used, cap - used, "%c", c);
+        }
+        if(used < cap) used += snprintf(out + used, cap - used, "|\n");
+    }
+    return used < cap? (int) used : (int) cap - 1;
+}
+
+static bool near_f32(float x, float y, float tol, uint64_t max_ulps) {
+    if(x == y) return true;
+    if(isnan(x) || isnan(y)) return false;
+    if(fabsf(x - y) <= tol) return true;
+    // map sign and magnitude onto one monotonic integer line
+    int32_t ix, iy;
+    memcpy(&ix, &x, sizeof(ix));
+    memcpy(&iy, &y, sizeof(iy));
+    int64_t ox = ix < 0? -(int64_t) (ix & INT32_MAX) : ix;
+    int64_t oy = iy < 0? -(int64_t) (iy & INT32_MAX) : iy;
+    uint64_t ulps = ox > oy? (uint64_t) (ox - oy) : (uint64_t) (oy - ox);
+    return ulps <= max_ulps;
+}
+
+static bool near_f64(double x, double y, double tol, uint64_t max_ulps) {
+    if(x == y) return true;
+    if(isnan(x) || isnan(y)) return false;
+    if(fabs(x - y) <= tol) return true;
+    int64_t ix, iy;
+    memcpy(&ix, &x, sizeof(ix));
+    memcpy(&iy, &y, sizeof(iy));
+    int64_t ox = ix < 0? -(ix & INT64_MAX) : ix;
+    int64_t oy = iy < 0? -(iy & INT64_MAX) : iy;
+    // the distance can exceed INT64_MAX, but always fits unsigned
+    uint64_t ulps = ox > oy? (uint64_t) ox - (uint64_t) oy
+                           : (uint64_t) oy - (uint64_t) ox;
+    return ulps <= max_ulps;
+}
+
+
+static size_t diff_scalar(const unsigned char *a, const unsigned char *b,
+                          size_t from, size_t n) {
+    for(size_t i = from; i < n; i += CUF_CMP_BLOCK) {
+        size_t len = n - i < CUF_CMP_BLOCK? n - i : CUF_CMP_BLOCK;
+        if(memcmp(a + i, b + i, len)) return i;
+    }
+    return n;
+}
+
+static size_t far_f32_scalar(const float *a, const float *b, size_t from,
+                             size_t n, float tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(float);
+    for(size_t i = from; i < n; ++i) {
+        if(!(a[i] == b[i] || fabsf(a[i] - b[i]) <= tol)) {
+            return i - (i - from) % step;
+        }
+    }
+    return n;
+}
+
+static size_t far_f64_scalar(const double *a, const double *b, size_t from,
+                             size_t n, double tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(double);
+    for(size_t i = from; i < n; ++i) {
+        if(!(a[i] == b[i] || fabs(a[i] - b[i]) <= tol)) {
+            return i - (i - from) % step;
+        }
+    }
+    return n;
+}
+
+
+#ifdef CUF_CMP_X86
+
+__attribute__((target("sse2")))
+static size_t diff_sse2(const unsigned char *a, const unsigned char *b,
+                        size_t from, size_t n) {
+    size_t i = from;
+    for(; i + CUF_CMP_BLOCK <= n; i += CUF_CMP_BLOCK) {
+        __m128i eq = _mm_set1_epi8(-1);
+        for(int j = 0; j < CUF_CMP_BLOCK; j += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (a + i + j));
+            __m128i y = _mm_loadu_si128((const __m128i *) (b + i + j));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(x, y));
+        }
+        if(_mm_movemask_epi8(eq) != 0xFFFF) return i;
+    }
+    return diff_scalar(a, b, i, n);
+}
+
+__attribute__((target("sse2")))
+static size_t far_f32_sse2(const float *a, const float *b, size_t from,
+                           size_t n, float tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(float);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 vtol = _mm_set1_ps(tol);
+    size_t i = from;
+    for(; i + step <= n; i += step) {
+        __m128 ok = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(size_t j = 0; j < step; j += 4) {
+            __m128 x = _mm_loadu_ps(a + i + j);
+            __m128 y = _mm_loadu_ps(b + i + j);
+            __m128 diff = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+            ok = _mm_and_ps(ok, _mm_or_ps(_mm_cmpeq_ps(x, y),
+                                          _mm_cmple_ps(diff, vtol)));
+        }
+        if(_mm_movemask_ps(ok) != 0xF) return i;
+    }
+    return far_f32_scalar(a, b, i, n, tol);
+}
+
+__attribute__((target("sse2")))
+static size_t far_f64_sse2(const double *a, const double *b, size_t from,
+                           size_t n, double tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(double);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d vtol = _mm_set1_pd(tol);
+    size_t i = from;
+    for(; i + step <= n; i += step) {
+        __m128d ok = _mm_castsi128_pd(_mm_set1_epi32(-1));
+        for(size_t j = 0; j < step; j += 2) {
+            __m128d x = _mm_loadu_pd(a + i + j);
+            __m128d y = _mm_loadu_pd(b + i + j);
+            __m128d diff = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+            ok = _mm_and_pd(ok, _mm_or_pd(_mm_cmpeq_pd(x, y),
+                                          _mm_cmple_pd(diff, vtol)));
+        }
+        if(_mm_movemask_pd(ok) != 0x3) return i;
+    }
+    return far_f64_scalar(a, b, i, n, tol);
+}
+
+__attribute__((target("avx2")))
+static size_t diff_avx2(const unsigned char *a, const unsigned char *b,
+                        size_t from, size_t n) {
+    size_t i = from;
+    for(; i + CUF_CMP_BLOCK <= n; i += CUF_CMP_BLOCK) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y0 = _mm256_loadu_si256((const __m256i *) (b + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *) (a + i + 32));
+        __m256i y1 = _mm256_loadu_si256((const __m256i *) (b + i + 32));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(x0, y0),
+                                      _mm256_cmpeq_epi8(x1, y1));
+        if((unsigned) _mm256_movemask_epi8(eq) != 0xFFFFFFFFu) return i;
+    }
+    return diff_scalar(a, b, i, n);
+}
+
+__attribute__((target("avx2")))
+static size_t far_f32_avx2(const float *a, const float *b, size_t from,
+                           size_t n, float tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(float);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 vtol = _mm256_set1_ps(tol);
+    size_t i = from;
+    for(; i + step <= n; i += step) {
+        __m256 x0 = _mm256_loadu_ps(a + i);
+        __m256 y0 = _mm256_loadu_ps(b + i);
+        __m256 x1 = _mm256_loadu_ps(a + i + 8);
+        __m256 y1 = _mm256_loadu_ps(b + i + 8);
+        __m256 d0 = _mm256_andnot_ps(sign, _mm256_sub_ps(x0, y0));
+        __m256 d1 = _mm256_andnot_ps(sign, _mm256_sub_ps(x1, y1));
+        __m256 ok0 = _mm256_or_ps(_mm256_cmp_ps(x0, y0, _CMP_EQ_OQ),
+                                  _mm256_cmp_ps(d0, vtol, _CMP_LE_OQ));
+        __m256 ok1 = _mm256_or_ps(_mm256_cmp_ps(x1, y1, _CMP_EQ_OQ),
+                                  _mm256_cmp_ps(d1, vtol, _CMP_LE_OQ));
+        if(_mm256_movemask_ps(_mm256_and_ps(ok0, ok1)) != 0xFF) return i;
+    }
+    return far_f32_scalar(a, b, i, n, tol);
+}
+
+__attribute__((target("avx2")))
+static size_t far_f64_avx2(const double *a, const double *b, size_t from,
+                           size_t n, double tol) {
+    const size_t step = CUF_CMP_BLOCK / sizeof(double);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d vtol = _mm256_set1_pd(tol);
+    size_t i = from;
+    for(; i + step <= n; i += step) {
+        __m256d x0 = _mm256_loadu_pd(a + i);
+        __m256d y0 = _mm256_loadu_pd(b + i);
+        __m256d x1 = _mm256_loadu_pd(a + i + 4);
+        __m256d y1 = _mm256_loadu_pd(b + i + 4);
+        __m256d d0 = _mm256_andnot_pd(sign, _mm256_sub_pd(x0, y0));
+        __m256d d1 = _mm256_andnot_pd(sign, _mm256_sub_pd(x1, y1));
+        __m256d ok0 = _mm256_or_pd(_mm256_cmp_pd(x0, y0, _CMP_EQ_OQ),
+                                   _mm256_cmp_pd(d0, vtol, _CMP_LE_OQ));
+        __m256d ok1 = _mm256_or_pd(_mm256_cmp_pd(x1, y1, _CMP_EQ_OQ),
+                                   _mm256_cmp_pd(d1, vtol, _CMP_LE_OQ));
+        if(_mm256_movemask_pd(_mm256_and_pd(ok0, ok1)) != 0xF) return i;
+    }
+    return far_f64_scalar(a, b, i, n, tol);
+}
+
+#endif
+
+static void kernels_pick(void) {
+#ifdef CUF_CMP_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        kernels.diff = &diff_avx2;
+        kernels.far_f32 = &far_f32_avx2;
+        kernels.far_f64 = &far_f64_avx2;
+    } else if(__builtin_cpu_supports("sse2")) {
+        kernels.diff = &diff_sse2;
+        kernels.far_f32 = &far_f32_sse2;
+        kernels.far_f64 = &far_f64_sse2;
+    }
+#endif
+}
@@ -0,0 +1,211 @@
+/**
+ * @file cuf_cmp.h
+ * @brief CUnitFramework (CUF): Bulk Comparison Interface
+ * @details Typed array assertions for plain integer and floating point
+ * buffers. Instead of calling a comparison function per element they scan
+ * both arrays with SSE2/AVX2 kernels (picked at runtime, with a scalar
+ * fallback) for the first 64 byte block holding a mismatch, and only look at
+ * single elements inside that block to build the failure message. The same
+ * kernels back the golden file assertions, which compare memory mapped files
+ * without reading them into the heap.
+ */
+#ifndef __CUF_CMP_H__
+#define __CUF_CMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cuf.h"
+
+// granularity, in bytes, at which the kernels look for mismatches
+#define CUF_CMP_BLOCK 64
+
+
+/**
+ * Assert that two arrays of `uint8_t` hold the same values
+ *
+ * @param actual values to compare against reference
+ * @param expected reference array
+ * @param n number of elements in the arrays
+ */
+#define ASSERT_ARRAY_EQ_U8(actual, expected, n) do {\
+    cmp_eq_u8(suite, __FILE__, __LINE__, #actual, #expected, (actual),\
+              (expected), (n));\
+} while (0)
+/**
+ * Assert that two arrays of `int32_t` hold the same values
+ *
+ * @param actual values to compare against reference
+ * @param expected reference array
+ * @param n number of elements in the arrays
+ */
+#define ASSERT_ARRAY_EQ_I32(actual, expected, n) do {\
+    cmp_eq_i32(suite, __FILE__, __LINE__, #actual, #expected, (actual),\
+               (expected), (n));\
+} while (0)
+/**
+ * Assert that two arrays of `int64_t` hold the same values
+ *
+ * @param actual values to compare against reference
+ * @param expected reference array
+ * @param n number of elements in the arrays
+ */
+#define ASSERT_ARRAY_EQ_I64(actual, expected, n) do {\
+    cmp_eq_i64(suite, __FILE__, __LINE__, #actual, #expected, (actual),\
+               (expected), (n));\
+} while (0)
+/**
+ * Assert that two arrays of `float` are element-wise close. Elements are
+ * close if they are equal, differ by at most `abs_tol`, or are at most
+ * `max_ulps` representable values apart. NaN is never close to anything.
+ *
+ * @param actual values to compare against reference
+ * @param expected reference array
+ * @param n number of elements in the arrays
+ * @param abs_tol largest allowed absolute difference
+ * @param max_ulps largest allowed distance in units in the last place
+ */
+#define ASSERT_ARRAY_NEAR_F32(actual, expected, n, abs_tol, max_ulps) do {\
+    cmp_near_f32(suite, __FILE__, __LINE__, #actual, #expected, (actual),\
+                 (expected), (n), (abs_tol), (max_ulps));\
+} while (0)
+/**
+ * Assert that two arrays of `double` are element-wise close, see
+ * `ASSERT_ARRAY_NEAR_F32()`.
+ *
+ * @param actual values to compare against reference
+ * @param expected reference array
+ * @param n number of elements in the arrays
+ * @param abs_tol largest allowed absolute difference
+ * @param max_ulps largest allowed distance in units in the last place
+ */
+#define ASSERT_ARRAY_NEAR_F64(actual, expected, n, abs_tol, max_ulps) do {\
+    cmp_near_f64(suite, __FILE__, __LINE__, #actual, #expected, (actual),\
+                 (expected), (n), (abs_tol), (max_ulps));\
+} while (0)
+/**
+ * Assert that the file at `path` has the same contents as the file at
+ * `golden`. Both files are memory mapped and compared in place; a failure
+ * shows the first differing offset with a hex dump around it.
+ *
+ * @param path path of the file to check
+ * @param golden path of the reference file
+ */
+#define ASSERT_FILE_EQ(path, golden) do {\
+    cmp_file_eq(suite, __FILE__, __LINE__, #path, #golden, (path),\
+                (golden));\
+} while (0)
+/**
+ * Assert that a buffer has the same contents as the file at `golden`, which
+ * is memory mapped and compared in place.
+ *
+ * @param buf buffer to check
+ * @param len size of `buf` in bytes
+ * @param golden path of the reference file
+ */
+#define ASSERT_BUFFER_EQ_FILE(buf, len, golden) do {\
+    cmp_buffer_eq_file(suite, __FILE__, __LINE__, #buf, #golden, (buf),\
+                       (len), (golden));\
+} while (0)
+
+
+/**
+ * Find the first byte at which two buffers differ, using the fastest kernel
+ * the cpu supports.
+ *
+ * @param a first buffer
+ * @param b second buffer
+ * @param n size of both buffers in bytes
+ * @return offset of the first differing byte, or `n` if the buffers are equal
+ */
+size_t cmp_find_diff(const void *a, const void *b, size_t n);
+
+/**
+ * Compare two `uint8_t` arrays and record a failure listing the mismatches
+ * of the first differing block. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr_a static source text of the actual array
+ * @param expr_b static source text of the expected array
+ * @param a actual array
+ * @param b expected array
+ * @param n number of elements in the arrays
+ * @return 0 if the arrays are equal, 1 otherwise
+ */
+int cmp_eq_u8(TestSuite *suite, const char *file, int line,
+              const char *expr_a, const char *expr_b, const uint8_t *a,
+              const uint8_t *b, size_t n);
+/**
+ * `int32_t` version of `cmp_eq_u8()`. Internal use function.
+ */
+int cmp_eq_i32(TestSuite *suite, const char *file, int line,
+               const char *expr_a, const char *expr_b, const int32_t *a,
+               const int32_t *b, size_t n);
+/**
+ * `int64_t` version of `cmp_eq_u8()`. Internal use function.
+ */
+int cmp_eq_i64(TestSuite *suite, const char *file, int line,
+               const char *expr_a, const char *expr_b, const int64_t *a,
+               const int64_t *b, size_t n);
+/**
+ * Compare two `float` arrays for closeness and record a failure listing the
+ * far apart elements of the first failing block. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr_a static source text of the actual array
+ * @param expr_b static source text of the expected array
+ * @param a actual array
+ * @param b expected array
+ * @param n number of elements in the arrays
+ * @param abs_tol largest allowed absolute difference
+ * @param max_ulps largest allowed distance in units in the last place
+ * @return 0 if the arrays are close, 1 otherwise
+ */
+int cmp_near_f32(TestSuite *suite, const char *file, int line,
+                 const char *expr_a, const char *expr_b, const float *a,
+                 const float *b, size_t n, double abs_tol, uint64_t max_ulps);
+/**
+ * `double` version of `cmp_near_f32()`. Internal use function.
+ */
+int cmp_near_f64(TestSuite *suite, const char *file, int line,
+                 const char *expr_a, const char *expr_b, const double *a,
+                 const double *b, size_t n, double abs_tol, uint64_t max_ulps);
+/**
+ * Compare two files and record a failure describing the first difference.
+ * Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr_a static source text of the checked path
+ * @param expr_b static source text of the golden path
+ * @param path path of the file to check
+ * @param golden path of the reference file
+ * @return 0 if the files are equal, 1 otherwise
+ */
+int cmp_file_eq(TestSuite *suite, const char *file, int line,
+                const char *expr_a, const char *expr_b, const char *path,
+                const char *golden);
+/**
+ * Compare a buffer against a file and record a failure describing the first
+ * difference. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr_a static source text of the buffer
+ * @param expr_b static source text of the golden path
+ * @param buf buffer to check
+ * @param len size of `buf` in bytes
+ * @param golden path of the reference file
+ * @return 0 if the contents are equal, 1 otherwise
+ */
+int cmp_buffer_eq_file(TestSuite *suite, const char *file, int line,
+                       const char *expr_a, const char *expr_b,
+                       const void *buf, size_t len, const char *golden);
+
+#endif
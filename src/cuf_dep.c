@@ -3,62 +3,566 @@
  * @brief CUnitFramework (CUF): Dependency Tracker Implementation
  * @details Dependency tracking for the cuf framework, allowing dependency
  * checking for skipping and other operations
+ *
+ * Interned paths live in a chained hash table and are reference counted by
+ * the Dependency objects using them, so the table empties itself as they
+ * are destroyed. Results are tagged with the run they were checked in;
+ * starting a run only bumps the run number. A single lock covers the table
+ * and the results, since the thread pool runners check dependencies from
+ * several threads and a path is only ever checked once per run anyway.
+ *
+ * Testcase dependencies are looked up by binary search in a sorted index of
+ * every registered case, and cycles are found with Kahn's algorithm: a case
+ * that never runs out of unvisited dependencies is on or behind a cycle.
  */
+#define _POSIX_C_SOURCE 200809L
 #include "cuf_dep.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "cuf.h"
+#include "cuf_arena.h"
 
-static bool filedeps_met(char *files);
+
+/**
+ * An interned file dependency path, see cuf_dep.h.
+ */
+struct dep_path_t {
+    DepPath *next;         /**< next path in the same hash bucket */
+    char *path;            /**< the path, NUL terminated */
+    uint64_t hash;         /**< hash of `path` */
+    int refs;              /**< number of Dependency objects using it */
+    unsigned run;          /**< run `met` was checked in, 0 for never */
+    bool met;              /**< whether the path was accessible */
+};
+
+/**
+ * a testcase along with its position in registration order
+ */
+typedef struct {
+    TestSuite *suite;      /**< suite the testcase belongs to */
+    TestCase *testcase;    /**< the testcase */
+    int order;             /**< its position among every case of the run */
+} CaseNumber;
+
+static DepPath *path_intern(const char *path, size_t len);
+static void path_release(DepPath *dep_path);
+static bool path_met(DepPath *dep_path);
+static uint64_t path_hash(const char *path, size_t len);
+static void table_grow(void);
+static int compare_names(const void *a, const void *b);
+static int compare_numbers(const void *a, const void *b);
+static int match_name(const CaseNumber *ref, const char *suite,
+                      const char *name);
+static int find_first(const CaseNumber *index, int count, const char *suite,
+                      const char *name);
+static DepNeed *collect_cases(TestRunner *runner, int *count);
+static CaseNumber *number_cases(DepNeed *cases, int count);
+static int find_order(CaseNumber *numbers, int count, TestCase *testcase);
+static int group_root(int *group, int idx);
+static void find_cycles(DepNeed *cases, int count);
+static const char *reason_printf(const char *fmt, ...);
+
+// interned paths, by hash
+static struct {
+    pthread_mutex_t lock;  // guards everything below and the paths' results
+    DepPath **buckets;     // power of two number of chains, NULL when empty
+    size_t size;           // number of buckets
+    size_t count;          // number of interned paths
+    unsigned run;          // current run number, never 0
+} table = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 1};
 
 
 Dependency *dependency_create() {
     Dependency *deps = malloc(sizeof(Dependency));
     deps->filedeps = NULL;
+    deps->filedep_count = 0;
     deps->has_filedeps = false;
+    deps->case_suites = NULL;
+    deps->case_names = NULL;
+    deps->casedep_count = 0;
+    deps->needs = NULL;
+    deps->need_count = 0;
     return deps;
 }
 
 
 Dependency *dependency_reg_filedeps(Dependency *deps, char *filedeps) {
-    if(deps->has_filedeps) {
-        deps->filedeps = realloc(deps->filedeps, 
-                                sizeof(char) * (strlen(filedeps)+1));
-    } else {
-        deps->has_filedeps = true;
-        deps->filedeps = malloc(sizeof(char) * (strlen(filedeps)+1));
-    }
-    strcpy(deps->filedeps, filedeps);
+    for(int i = 0; i < deps->filedep_count; ++i) {
+        path_release(deps->filedeps[i]);
+    }
+    free(deps->filedeps);
+    // one path per line, blank lines don't name anything
+    int lines = 1;
+    for(const char *c = filedeps; *c; ++c) lines += *c == '\n';
+    deps->filedeps = malloc(sizeof(DepPath *) * lines);
+    deps->filedep_count = 0;
+    deps->has_filedeps = true;
+    const char *start = filedeps;
+    while(*start) {
+        const char *end = strchr(start, '\n');
+        if(!end) end = start + strlen(start);
+        if(end > start) {
+            deps->filedeps[deps->filedep_count++] =
+                path_intern(start, end - start);
+        }
+        start = *end? end + 1 : end;
+    }
     return deps;
 }
 
+Dependency *dependency_reg_case(Dependency *deps, const char *suite,
+                                const char *test_name) {
+    int count = deps->casedep_count + 1;
+    deps->case_suites = realloc(deps->case_suites, sizeof(char *) * count);
+    deps->case_names = realloc(deps->case_names, sizeof(char *) * count);
+    deps->case_suites[count - 1] = strdup(suite);
+    deps->case_names[count - 1] = test_name? strdup(test_name) : NULL;
+    deps->casedep_count = count;
+    return deps;
+}
+
+Dependency *dependency_reg_suite(Dependency *deps, const char *suite) {
+    return dependency_reg_case(deps, suite, NULL);
+}
+
 bool dependency_check(Dependency *deps) {
-    int ret = true;
-    if(deps->has_filedeps) ret &= filedeps_met(deps->filedeps);
-    return ret;
+    if(!deps || !deps->has_filedeps) return true;
+    for(int i = 0; i < deps->filedep_count; ++i) {
+        if(!path_met(deps->filedeps[i])) return false;
+    }
+    return true;
 }
 
 void dependency_destroy(Dependency *deps) {
-    if(deps->filedeps) free(deps->filedeps);
+    for(int i = 0; i < deps->filedep_count; ++i) {
+        path_release(deps->filedeps[i]);
+    }
+    free(deps->filedeps);
+    for(int i = 0; i < deps->casedep_count; ++i) {
+        free(deps->case_suites[i]);
+        free(deps->case_names[i]);
+    }
+    free(deps->case_suites);
+    free(deps->case_names);
+    free(deps->needs);
     free(deps);
 }
 
-static bool filedeps_met(char *files) {
-    char *prev_index = files;
-    char *index = NULL;
-    while(prev_index != NULL) {
-        index = strchr(prev_index, '\n');
-        if(!index) index = files+strlen(files);
-        int count = index-prev_index;
-        char *filebuf = malloc(sizeof(char) * (count + 1));
-        strncpy(filebuf, prev_index, count);
-        filebuf[count] = '\0';
-        FILE *temp = fopen(filebuf, "r+");
-        if(! temp) return false;
-        fclose(temp);
-        prev_index = (index == files+strlen(files))? NULL : (index + 1);
-        if(filebuf) free(filebuf);
+const char *dependency_path_name(const DepPath *dep_path) {
+    return dep_path->path;
+}
+
+void dependency_new_run(void) {
+    pthread_mutex_lock(&table.lock);
+    if(++table.run == 0) table.run = 1;
+    pthread_mutex_unlock(&table.lock);
+}
+
+bool dependency_between_cases(TestRunner *runner) {
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            Dependency *deps = suite->testcases[j]->deps;
+            if(deps && deps->casedep_count > 0) return true;
+        }
     }
-    return true;
-} 
+    return false;
+}
+
+void dependency_resolve(TestRunner *runner) {
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            suite->testcases[j]->skip_reason = NULL;
+        }
+        total += suite->test_count;
+    }
+    if(total == 0 || !dependency_between_cases(runner)) return;
+
+    DepNeed *cases = collect_cases(runner, &total);
+    // by name, cases registered under the same one in registration order
+    CaseNumber *index = malloc(sizeof(CaseNumber) * total);
+    for(int i = 0; i < total; ++i) {
+        index[i].suite = cases[i].suite;
+        index[i].testcase = cases[i].testcase;
+        index[i].order = i;
+    }
+    qsort(index, total, sizeof(CaseNumber), &compare_names);
+    for(int i = 0; i < total; ++i) {
+        TestCase *c_case = cases[i].testcase;
+        Dependency *deps = c_case->deps;
+        if(!deps) continue;
+        free(deps->needs);
+        deps->needs = NULL;
+        deps->need_count = 0;
+        int size = 0;
+        for(int k = 0; k < deps->casedep_count; ++k) {
+            const char *suite = deps->case_suites[k];
+            const char *name = deps->case_names[k];
+            int first = find_first(index, total, suite, name);
+            if(first == total || match_name(&index[first], suite, name)) {
+                if(!c_case->skip_reason && name) {
+                    c_case->skip_reason = reason_printf(
+                        "unknown dependency `%s/%s`", suite, name);
+                } else if(!c_case->skip_reason) {
+                    c_case->skip_reason = reason_printf(
+                        "unknown dependency `%s`", suite);
+                }
+                continue;
+            }
+            for(int m = first; m < total; ++m) {
+                if(match_name(&index[m], suite, name)) break;
+                // a case depending on its own suite means the others in it
+                if(index[m].testcase == c_case) continue;
+                if(deps->need_count == size) {
+                    size = size? size * 2 : 4;
+                    deps->needs = realloc(deps->needs,
+                                          sizeof(DepNeed) * size);
+                }
+                DepNeed *need = &deps->needs[deps->need_count++];
+                need->suite = index[m].suite;
+                need->testcase = index[m].testcase;
+            }
+        }
+    }
+    free(index);
+    find_cycles(cases, total);
+    free(cases);
+}
+
+void dependency_groups(TestRunner *runner, int *group) {
+    int total = 0;
+    DepNeed *cases = collect_cases(runner, &total);
+    for(int i = 0; i < total; ++i) group[i] = i;
+    if(total == 0 || !dependency_between_cases(runner)) {
+        free(cases);
+        return;
+    }
+    CaseNumber *numbers = number_cases(cases, total);
+    for(int i = 0; i < total; ++i) {
+        Dependency *deps = cases[i].testcase->deps;
+        int needs = deps? deps->need_count : 0;
+        for(int k = 0; k < needs; ++k) {
+            int root = group_root(group, find_order(numbers, total,
+                                                   deps->needs[k].testcase));
+            int own = group_root(group, i);
+            // the earlier case stays the root, so roots are first cases
+            if(root < own) {
+                group[own] = root;
+            } else {
+                group[root] = own;
+            }
+        }
+    }
+    for(int i = 0; i < total; ++i) group[i] = group_root(group, i);
+    free(numbers);
+    free(cases);
+}
+
+int dependency_state(TestCase *testcase, const char **reason) {
+    // decided when the run started, or by a scheduler since
+    if(testcase->skip_reason) {
+        if(reason) *reason = testcase->skip_reason;
+        return CUF_DEP_BLOCKED;
+    }
+    Dependency *deps = testcase->deps;
+    int count = deps? deps->need_count : 0;
+    const DepNeed *pending = NULL;
+    for(int i = 0; i < count; ++i) {
+        const DepNeed *need = &deps->needs[i];
+        if(need->testcase->status == CUF_TC_DESELECTED) {
+            if(reason) {
+                *reason = reason_printf("dependency `%s/%s` in another "
+                                        "shard", need->suite->name,
+                                        need->testcase->test_name);
+            }
+            return CUF_DEP_BLOCKED;
+        }
+        if(!need->testcase->done) {
+            if(!pending) pending = need;
+            continue;
+        }
+        if(need->testcase->status != CUF_TC_PASS) {
+            if(reason) *reason = dependency_blame(need);
+            return CUF_DEP_BLOCKED;
+        }
+    }
+    if(!pending) return CUF_DEP_READY;
+    if(reason) {
+        *reason = reason_printf("dependency `%s/%s` not run yet",
+                                pending->suite->name,
+                                pending->testcase->test_name);
+    }
+    return CUF_DEP_WAIT;
+}
+
+const char *dependency_blame(const DepNeed *need) {
+    TestCase *c_case = need->testcase;
+    if(c_case->status == CUF_TC_FAIL) {
+        return reason_printf("failed dependency `%s/%s`", need->suite->name,
+                             c_case->test_name);
+    }
+    // skipped for its own dependencies: pass the root cause along
+    if(c_case->skip_reason) return c_case->skip_reason;
+    return reason_printf("skipped dependency `%s/%s`", need->suite->name,
+                         c_case->test_name);
+}
+
+
+static DepPath *path_intern(const char *path, size_t len) {
+    uint64_t hash = path_hash(path, len);
+    pthread_mutex_lock(&table.lock);
+    if(table.size) {
+        DepPath *dep_path = table.buckets[hash & (table.size - 1)];
+        for(; dep_path; dep_path = dep_path->next) {
+            if(dep_path->hash == hash && !strncmp(dep_path->path, path, len)
+               && dep_path->path[len] == '\0') {
+                ++(dep_path->refs);
+                pthread_mutex_unlock(&table.lock);
+                return dep_path;
+            }
+        }
+    }
+    if(table.count >= table.size) table_grow();
+    DepPath *dep_path = malloc(sizeof(DepPath));
+    dep_path->path = malloc(len + 1);
+    memcpy(dep_path->path, path, len);
+    dep_path->path[len] = '\0';
+    dep_path->hash = hash;
+    dep_path->refs = 1;
+    dep_path->run = 0;
+    dep_path->met = false;
+    DepPath **bucket = &table.buckets[hash & (table.size - 1)];
+    dep_path->next = *bucket;
+    *bucket = dep_path;
+    ++(table.count);
+    pthread_mutex_unlock(&table.lock);
+    return dep_path;
+}
+
+static void path_release(DepPath *dep_path) {
+    pthread_mutex_lock(&table.lock);
+    if(--(dep_path->refs) > 0) {
+        pthread_mutex_unlock(&table.lock);
+        return;
+    }
+    DepPath **link = &table.buckets[dep_path->hash & (table.size - 1)];
+    while(*link != dep_path) link = &(*link)->next;
+    *link = dep_path->next;
+    free(dep_path->path);
+    free(dep_path);
+    // the last path takes the table with it
+    if(--(table.count) == 0) {
+        free(table.buckets);
+        table.buckets = NULL;
+        table.size = 0;
+    }
+    pthread_mutex_unlock(&table.lock);
+}
+
+static bool path_met(DepPath *dep_path) {
+    pthread_mutex_lock(&table.lock);
+    if(dep_path->run != table.run) {
+        // same requirements as opening it for reading and writing
+        dep_path->met = !faccessat(AT_FDCWD, dep_path->path, R_OK | W_OK,
+                                   AT_EACCESS);
+        dep_path->run = table.run;
+    }
+    bool met = dep_path->met;
+    pthread_mutex_unlock(&table.lock);
+    return met;
+}
+
+static uint64_t path_hash(const char *path, size_t len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037u;
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) path[i];
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+static void table_grow(void) {
+    size_t size = table.size? table.size * 2 : CUF_DEP_BUCKETS;
+    DepPath **buckets = calloc(size, sizeof(DepPath *));
+    for(size_t i = 0; i < table.size; ++i) {
+        DepPath *dep_path = table.buckets[i];
+        while(dep_path) {
+            DepPath *next = dep_path->next;
+            DepPath **bucket = &buckets[dep_path->hash & (size - 1)];
+            dep_path->next = *bucket;
+            *bucket = dep_path;
+            dep_path = next;
+        }
+    }
+    free(table.buckets);
+    table.buckets = buckets;
+    table.size = size;
+}
+
+static int compare_names(const void *a, const void *b) {
+    const CaseNumber *number_a = a;
+    const CaseNumber *number_b = b;
+    int diff = strcmp(number_a->suite->name, number_b->suite->name);
+    if(diff) return diff;
+    diff = strcmp(number_a->testcase->test_name,
+                  number_b->testcase->test_name);
+    if(diff) return diff;
+    return (number_a->order > number_b->order) -
+           (number_a->order < number_b->order);
+}
+
+static int compare_numbers(const void *a, const void *b) {
+    const CaseNumber *number_a = a;
+    const CaseNumber *number_b = b;
+    return (number_a->testcase > number_b->testcase) -
+           (number_a->testcase < number_b->testcase);
+}
+
+static int match_name(const CaseNumber *ref, const char *suite,
+                      const char *name) {
+    int diff = strcmp(ref->suite->name, suite);
+    if(diff || !name) return diff;
+    return strcmp(ref->testcase->test_name, name);
+}
+
+static int find_first(const CaseNumber *index, int count, const char *suite,
+                      const char *name) {
+    int low = 0;
+    int high = count;
+    while(low < high) {
+        int mid = low + (high - low) / 2;
+        if(match_name(&index[mid], suite, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static DepNeed *collect_cases(TestRunner *runner, int *count) {
+    *count = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        *count += runner->suites[i]->test_count;
+    }
+    DepNeed *cases = malloc(sizeof(DepNeed) * (*count + 1));
+    int order = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++order) {
+            cases[order].suite = suite;
+            cases[order].testcase = suite->testcases[j];
+        }
+    }
+    return cases;
+}
+
+static CaseNumber *number_cases(DepNeed *cases, int count) {
+    // sorted by address, so a dependency can be found by its testcase
+    CaseNumber *numbers = malloc(sizeof(CaseNumber) * (count + 1));
+    for(int i = 0; i < count; ++i) {
+        numbers[i].suite = cases[i].suite;
+        numbers[i].testcase = cases[i].testcase;
+        numbers[i].order = i;
+    }
+    qsort(numbers, count, sizeof(CaseNumber), &compare_numbers);
+    return numbers;
+}
+
+static int find_order(CaseNumber *numbers, int count, TestCase *testcase) {
+    CaseNumber find = {NULL, testcase, 0};
+    CaseNumber *hit = bsearch(&find, numbers, count, sizeof(CaseNumber),
+                              &compare_numbers);
+    return hit->order;
+}
+
+static int group_root(int *group, int idx) {
+    while(group[idx] != idx) {
+        // path halving keeps the chains short
+        group[idx] = group[group[idx]];
+        idx = group[idx];
+    }
+    return idx;
+}
+
+static void find_cycles(DepNeed *cases, int count) {
+    CaseNumber *numbers = number_cases(cases, count);
+    // dependents of every case, counted and then filled in
+    int *waiting = calloc(count, sizeof(int));
+    int *first = calloc(count + 1, sizeof(int));
+    int edges = 0;
+    for(int i = 0; i < count; ++i) {
+        Dependency *deps = cases[i].testcase->deps;
+        edges += deps? deps->need_count : 0;
+    }
+    int *from = malloc(sizeof(int) * (edges + 1));
+    int *dependents = malloc(sizeof(int) * (edges + 1));
+    edges = 0;
+    for(int i = 0; i < count; ++i) {
+        Dependency *deps = cases[i].testcase->deps;
+        int needs = deps? deps->need_count : 0;
+        for(int k = 0; k < needs; ++k) {
+            int order = find_order(numbers, count, deps->needs[k].testcase);
+            from[edges++] = order;
+            ++first[order + 1];
+            ++waiting[i];
+        }
+    }
+    for(int i = 0; i < count; ++i) first[i + 1] += first[i];
+    int *fill = malloc(sizeof(int) * (count + 1));
+    memcpy(fill, first, sizeof(int) * (count + 1));
+    edges = 0;
+    for(int i = 0; i < count; ++i) {
+        Dependency *deps = cases[i].testcase->deps;
+        int needs = deps? deps->need_count : 0;
+        for(int k = 0; k < needs; ++k) {
+            dependents[fill[from[edges++]]++] = i;
+        }
+    }
+    // Kahn's algorithm, `fill` doubles as the queue
+    int head = 0;
+    int tail = 0;
+    for(int i = 0; i < count; ++i) {
+        if(waiting[i] == 0) fill[tail++] = i;
+    }
+    while(head < tail) {
+        int node = fill[head++];
+        for(int k = first[node]; k < first[node + 1]; ++k) {
+            if(--waiting[dependents[k]] == 0) fill[tail++] = dependents[k];
+        }
+    }
+    for(int i = 0; i < count && tail < count; ++i) {
+        TestCase *c_case = cases[i].testcase;
+        if(waiting[i] > 0 && !c_case->skip_reason) {
+            c_case->skip_reason = "a dependency cycle";
+        }
+    }
+    free(numbers);
+    free(waiting);
+    free(first);
+    free(from);
+    free(dependents);
+    free(fill);
+}
+
+static const char *reason_printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    char *reason = arena_alloc(arena_local(), len + 1);
+    va_start(args, fmt);
+    vsnprintf(reason, len + 1, fmt, args);
+    va_end(args);
+    return reason;
+}
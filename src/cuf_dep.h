@@ -3,20 +3,73 @@
  * @brief CUnitFramework (CUF): Dependency Tracker Interface
  * @details Dependency tracking for the cuf framework, allowing dependency
  * checking for skipping and other operations
+ *
+ * File dependencies are split into paths once, when registered, and each
+ * distinct path is interned: every Dependency naming it shares one entry.
+ * The entry caches whether the path was accessible, so a fixture file shared
+ * by hundreds of testcases is checked once per run instead of once per case.
+ * A file created or removed during a run is therefore not noticed until the
+ * next one.
+ *
+ * A testcase can also depend on other testcases, or on every testcase of a
+ * suite, named as they appear in the report. It only runs once all of them
+ * have passed and is skipped, with the reason, as soon as one of them fails
+ * or is skipped; its own dependents are then skipped in turn. The names are
+ * looked up when a run starts, and a case naming nothing registered, or
+ * taking part in a dependency cycle, is skipped. `testrunner_run()` runs
+ * suites after the suites they depend on and cases after the cases of their
+ * suite they depend on, in the order of the run otherwise (see cuf_order.h);
+ * only cases of two suites that depend on each other can still find a
+ * dependency not run yet, and are skipped. `testrunner_run_graph()` (see
+ * cuf_sched.h) orders cases by their dependencies across suites and runs
+ * independent ones in parallel.
  */
 #ifndef __CUF_DEP_H__
 #define __CUF_DEP_H__
 
 #include <stdbool.h>
 
+// initial number of buckets of the interned path table, a power of two
+#define CUF_DEP_BUCKETS 16
+
+struct testcase_t;
+struct testsuite_t;
+struct testrunner_t;
+
+/**
+ * listing of the states `dependency_state()` reports
+ */
+enum cuf_dep_states {
+    CUF_DEP_READY,         /**< every testcase depended on has passed */
+    CUF_DEP_WAIT,          /**< some have not finished, none has failed */
+    CUF_DEP_BLOCKED        /**< the testcase can't run and must be skipped */
+};
 
+/**
+ * An interned file dependency path along with its cached check result.
+ * Internal use.
+ */
+typedef struct dep_path_t DepPath;
+/**
+ * A testcase depended on, as found when the run started. Internal use.
+ */
+typedef struct {
+    struct testsuite_t *suite;   /**< suite the testcase belongs to */
+    struct testcase_t *testcase; /**< the testcase */
+} DepNeed;
 /**
  * Struct that holds information about the dependencies of a testcase. Operate
  * on it using the `dependency_*` family of functions
  */
 typedef struct {
     bool has_filedeps;    /**< flag indicating if the object has file dependencies*/
-    char *filedeps;       /**< `\n` delimited string of file dependencies */
+    DepPath **filedeps;   /**< interned paths of the file dependencies */
+    int filedep_count;    /**< number of paths in `filedeps` */
+    char **case_suites;   /**< suites of the testcases depended on */
+    char **case_names;    /**< testcases depended on, NULL for a whole suite */
+    int casedep_count;    /**< number of entries of the two arrays above */
+    DepNeed *needs;       /**< testcases the names resolved to for this run */
+    int need_count;       /**< number of `needs` */
 } Dependency;
 
 /**
@@ -29,18 +82,43 @@ Dependency *dependency_create();
  * Register a set of file dependencies to the deps object. If the deps object
  * previous had file dependencies registed. they will be replaced. The set of
  * file dependencies is sepcified as a newline (`\n`) delimited string of valid
- * paths.
+ * paths, each of which has to exist and be readable and writable. Empty lines
+ * are ignored.
  * 
  * @param deps pointer to deps object to modify.
  * @param filedeps newline delimited string of paths to register.
  * @return a pointer to the current deps object to allow function chaining.
  */
 Dependency *dependency_reg_filedeps(Dependency *deps, char *filedeps) ;
+/**
+ * Add a testcase that has to pass before the case owning the deps object
+ * runs. Every testcase registered under this suite and name counts.
+ *
+ * @param deps pointer to deps object to modify.
+ * @param suite name of the suite of the testcase
+ * @param test_name name of the testcase, as it appears in the report (the
+ *                  `REGISTER_TESTCASE` macros name a case after the
+ *                  function argument, e.g. "&migrate")
+ * @return a pointer to the current deps object to allow function chaining.
+ */
+Dependency *dependency_reg_case(Dependency *deps, const char *suite,
+                                const char *test_name);
+/**
+ * Add a suite whose testcases all have to pass before the case owning the
+ * deps object runs. A case depending on its own suite depends on the other
+ * cases of it.
+ *
+ * @param deps pointer to deps object to modify.
+ * @param suite name of the suite
+ * @return a pointer to the current deps object to allow function chaining.
+ */
+Dependency *dependency_reg_suite(Dependency *deps, const char *suite);
 /**
  * check that the depedencies specified in the deps object are satisfied on the
- * current system.
+ * current system. Each path is only looked at the first time it is checked in
+ * a run, see `dependency_new_run()`.
  *
- * @param deps pointer to deps object to use for check.
+ * @param deps pointer to deps object to use for check, NULL for none.
  * @return boolean value true if all deps are satisfied, and false if one or
  *         more are not.
  */
@@ -51,5 +129,61 @@ bool dependency_check(Dependency *deps);
  * @param deps depedency object to destroy.
  */
 void dependency_destroy(Dependency *deps);
+/**
+ * Get the path of an interned file dependency.
+ *
+ * @param dep_path one of the `filedeps` of a Dependency
+ * @return the path, valid as long as the Dependency is
+ */
+const char *dependency_path_name(const DepPath *dep_path);
+/**
+ * Forget the cached results of every path, so each is checked again the next
+ * time a dependency on it is. Called by the runners when a run starts.
+ */
+void dependency_new_run(void);
+/**
+ * Whether any testcase of a runner depends on other testcases.
+ *
+ * @param runner testrunner to look at
+ * @return true if some case called `dependency_reg_case()` or
+ *         `dependency_reg_suite()` on its deps object
+ */
+bool dependency_between_cases(struct testrunner_t *runner);
+/**
+ * Look up the testcases every case of a runner depends on, and mark the
+ * cases naming unknown testcases or taking part in a cycle to be skipped.
+ * Called by the runners when a run starts. Internal use function.
+ *
+ * @param runner testrunner about to be run
+ */
+void dependency_resolve(struct testrunner_t *runner);
+/**
+ * Group the testcases of a runner that depend on each other, directly or
+ * through others, as found by the last `dependency_resolve()`. Internal use
+ * function.
+ *
+ * @param runner testrunner about to be run
+ * @param group filled with, for every case in registration order, the
+ *              registration index of the first case of its group
+ */
+void dependency_groups(struct testrunner_t *runner, int *group);
+/**
+ * Check the testcases a case depends on. Internal use function.
+ *
+ * @param testcase testcase about to be run
+ * @param reason set to why the case must be skipped, or why it has to wait,
+ *               unless it is ready; NULL to not be told, which keeps a
+ *               scheduler polling a waiting case from formatting the text
+ * @return one of the `cuf_dep_states`
+ */
+int dependency_state(struct testcase_t *testcase, const char **reason);
+/**
+ * Get the reason to skip the dependents of a testcase that finished without
+ * passing. Internal use function.
+ *
+ * @param need the testcase that didn't pass
+ * @return the reason, owned by the run
+ */
+const char *dependency_blame(const DepNeed *need);
 
 #endif
@@ -0,0 +1,39 @@
+/**
+ * @file cuf_escape.c
+ * @brief CUnitFramework (CUF): Field Escaping Implementation
+ */
+#include <stdio.h>
+
+#include "cuf_escape.h"
+
+
+void cuf_write_escaped(FILE *out, const char *text) {
+    for(; *text; ++text) {
+        switch(*text) {
+            case '\\':
+                fputs("\\\\", out);
+                break;
+            case '\t':
+                fputs("\\t", out);
+                break;
+            case '\n':
+                fputs("\\n", out);
+                break;
+            default:
+                fputc(*text, out);
+        }
+    }
+}
+
+void cuf_unescape(char *text) {
+    char *dst = text;
+    for(; *text; ++text) {
+        if(*text == '\\' && text[1]) {
+            ++text;
+            *dst++ = *text == 't'? '\t' : *text == 'n'? '\n' : *text;
+        } else {
+            *dst++ = *text;
+        }
+    }
+    *dst = '\0';
+}
@@ -0,0 +1,30 @@
+/**
+ * @file cuf_escape.h
+ * @brief CUnitFramework (CUF): Field Escaping Interface
+ * @details The text files of the framework (results, timing and history
+ * files) are tab separated, one record per line. Fields that may hold any
+ * text are written with backslashes, tabs and newlines as `\\`, `\t` and
+ * `\n`. These functions only need the C library, so the `cufmerge` tool
+ * links them without the rest of the framework.
+ */
+#ifndef __CUF_ESCAPE_H__
+#define __CUF_ESCAPE_H__
+
+#include <stdio.h>
+
+
+/**
+ * Write text with backslashes, tabs and newlines escaped.
+ *
+ * @param out stream to write to
+ * @param text text to write
+ */
+void cuf_write_escaped(FILE *out, const char *text);
+/**
+ * Undo `cuf_write_escaped()` in place.
+ *
+ * @param text escaped text, NUL terminated
+ */
+void cuf_unescape(char *text);
+
+#endif
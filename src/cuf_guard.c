@@ -0,0 +1,178 @@
+/**
+ * @file cuf_guard.c
+ * @brief CUnitFramework (CUF): Crash Guard Implementation
+ * @details Each thread keeps a pointer to the guard frame of the test
+ * function it is running. Frames are set up without saving the signal mask,
+ * which would cost a system call per testcase; the handlers are installed
+ * with SA_NODEFER instead, so jumping out of one leaves no signal blocked.
+ * A thread's alternate signal stack is allocated the first time it runs a
+ * testcase with recovery on, and freed when the thread exits.
+ */
+// sigaltstack() and SA_ONSTACK need _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cuf_alloc.h"
+#include "cuf_guard.h"
+#include "cuf_util.h"
+
+
+/**
+ * where a test function running on this thread jumps back to
+ */
+typedef struct {
+    sigjmp_buf env;        /**< context saved by `sigsetjmp()` */
+    bool fatal;            /**< whether REQUIRE checks jump back here */
+} GuardFrame;
+
+static int guard_run(GuardFunc func, const char *part, bool fatal,
+                     TestSuite *suite, TestCase *testcase, void *uut);
+static void fixture_setup(TestSuite *suite, TestCase *testcase, void *uut);
+static void fixture_teardown(TestSuite *suite, TestCase *testcase,
+                             void *uut);
+static void guard_signal(int sig);
+static void stack_ensure(void);
+static void stack_free(void *stack);
+static void stack_key_create(void);
+
+// signals turned into failures, and their handling before `guard_prepare()`
+static const int guard_signals[] = {SIGSEGV, SIGFPE, SIGBUS};
+#define GUARD_SIGNAL_COUNT (sizeof(guard_signals) / sizeof(guard_signals[0]))
+static struct sigaction saved_actions[GUARD_SIGNAL_COUNT];
+// set before any worker thread starts, and only read while they run
+static bool installed = false;
+static _Thread_local GuardFrame *active_frame = NULL;
+static _Thread_local bool stack_ready = false;
+static pthread_key_t stack_key;
+static pthread_once_t stack_once = PTHREAD_ONCE_INIT;
+
+
+void testrunner_set_crash_recovery(TestRunner *runner, bool recover) {
+    runner->crash_recovery = recover;
+}
+
+void guard_prepare(TestRunner *runner) {
+    if(!runner->crash_recovery || installed) return;
+    struct sigaction action;
+    action.sa_handler = &guard_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_ONSTACK | SA_NODEFER;
+    for(size_t i = 0; i < GUARD_SIGNAL_COUNT; ++i) {
+        sigaction(guard_signals[i], &action, &saved_actions[i]);
+    }
+    installed = true;
+}
+
+void guard_release(void) {
+    if(!installed) return;
+    for(size_t i = 0; i < GUARD_SIGNAL_COUNT; ++i) {
+        sigaction(guard_signals[i], &saved_actions[i], NULL);
+    }
+    installed = false;
+}
+
+int guard_call(GuardFunc func, TestSuite *suite, TestCase *testcase,
+               void *uut) {
+    return guard_run(func, "testcase", true, suite, testcase, uut);
+}
+
+int guard_setup(TestSuite *suite, TestCase *testcase, void **uut) {
+    if(!suite->setup) return 0;
+    return guard_run(&fixture_setup, "setup", false, suite, testcase, uut);
+}
+
+int guard_teardown(TestSuite *suite, TestCase *testcase, void *uut) {
+    if(!suite->teardown) return 0;
+    return guard_run(&fixture_teardown, "teardown", false, suite, testcase,
+                     uut);
+}
+
+void guard_fatal(void) {
+    if(active_frame && active_frame->fatal) {
+        siglongjmp(active_frame->env, CUF_GUARD_REQUIRE);
+    }
+}
+
+
+static int guard_run(GuardFunc func, const char *part, bool fatal,
+                     TestSuite *suite, TestCase *testcase, void *uut) {
+    if(installed) stack_ensure();
+    GuardFrame frame;
+    frame.fatal = fatal;
+    GuardFrame *outer = active_frame;
+    // a jump back skips the resumes of the pauses made since
+    int depth = alloc_pause_depth();
+    int stop = sigsetjmp(frame.env, 0);
+    if(stop == 0) {
+        active_frame = &frame;
+        func(suite, testcase, uut);
+    }
+    active_frame = outer;
+    if(stop != 0) {
+        alloc_set_pause_depth(depth);
+        // left behind by an array comparison that crashed
+        cuf_array_msgs_reset();
+    }
+    if(stop > 0) {
+        char msg[CUF_BUF_SIZE];
+        snprintf(msg, CUF_BUF_SIZE, "Crash: %s caught signal %s (%d)\nIn "
+                 "TestCase: %s", part, cuf_signal_name(stop), stop,
+                 testcase->test_name);
+        testcase_record_fail(testcase, msg);
+    }
+    return stop;
+}
+
+static void fixture_setup(TestSuite *suite, TestCase *testcase, void *uut) {
+    suite->setup((void **) uut, testcase->args, testcase);
+}
+
+static void fixture_teardown(TestSuite *suite, TestCase *testcase,
+                             void *uut) {
+    suite->teardown(uut, testcase->args, testcase);
+}
+
+static void guard_signal(int sig) {
+    if(active_frame) siglongjmp(active_frame->env, sig);
+    // not in a test function, raise it again with its old handling
+    for(size_t i = 0; i < GUARD_SIGNAL_COUNT; ++i) {
+        if(guard_signals[i] == sig) sigaction(sig, &saved_actions[i], NULL);
+    }
+    raise(sig);
+}
+
+static void stack_ensure(void) {
+    if(stack_ready) return;
+    stack_ready = true;
+    pthread_once(&stack_once, &stack_key_create);
+    stack_t stack;
+    // the stack is ours, keep it out of the testcase's heap usage
+    alloc_pause();
+    stack.ss_sp = malloc(CUF_GUARD_STACK_SIZE);
+    alloc_resume();
+    stack.ss_size = CUF_GUARD_STACK_SIZE;
+    stack.ss_flags = 0;
+    // without its own stack a handler still catches all but stack overflows
+    if(!stack.ss_sp || sigaltstack(&stack, NULL)) {
+        free(stack.ss_sp);
+        return;
+    }
+    pthread_setspecific(stack_key, stack.ss_sp);
+}
+
+static void stack_free(void *stack) {
+    stack_t off;
+    off.ss_sp = NULL;
+    off.ss_size = 0;
+    off.ss_flags = SS_DISABLE;
+    sigaltstack(&off, NULL);
+    free(stack);
+}
+
+static void stack_key_create(void) {
+    pthread_key_create(&stack_key, &stack_free);
+}
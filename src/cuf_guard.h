@@ -0,0 +1,112 @@
+/**
+ * @file cuf_guard.h
+ * @brief CUnitFramework (CUF): Crash Guard Interface
+ * @details The test function of every case runs inside a guard frame, set up
+ * with `sigsetjmp()` on the thread that runs it. A failing `REQUIRE_*`
+ * assertion (see cuf_assert.h) jumps back to that frame, so the rest of the
+ * test function is skipped and the case goes straight on to its teardown.
+ * The suite's setup and teardown get frames of their own, in which REQUIRE
+ * checks stay non-fatal.
+ *
+ * With crash recovery on, SIGSEGV, SIGFPE and SIGBUS raised by a test
+ * function, or by the setup or teardown around it, jump back to its frame
+ * and are recorded as a failure of the case, and the run goes on. A crashed
+ * setup leaves no uut, so the test function and teardown are skipped. The
+ * handlers run on an alternate signal stack, so a stack overflow is caught
+ * too. This is best effort: the framework puts its own per-thread state back
+ * (allocation counting pauses, the error buffer of an array comparison), but
+ * whatever locks or memory the case held when it crashed stay held, and what
+ * it scribbled over stays scribbled over. For real isolation use
+ * `testrunner_run_isolated()`, where recovery instead saves a worker respawn
+ * per crash. Signals raised elsewhere, e.g. in a suite's init or term
+ * function, get their previous handling.
+ */
+#ifndef __CUF_GUARD_H__
+#define __CUF_GUARD_H__
+
+#include <stdbool.h>
+
+#include "cuf.h"
+
+// size of the alternate signal stack of each thread running testcases
+#define CUF_GUARD_STACK_SIZE (64 * 1024)
+// value `guard_call()` returns when a REQUIRE check stopped the test function
+#define CUF_GUARD_REQUIRE -1
+
+
+/**
+ * a function run inside a guard frame, see `guard_call()`
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase being run
+ * @param uut custom uut object supplied to the case
+ */
+typedef void (*GuardFunc) (TestSuite *suite, TestCase *testcase, void *uut);
+
+
+/**
+ * Turn crashes of test functions into failures instead of letting them take
+ * down the runner, see the file description.
+ *
+ * @param runner testrunner to configure
+ * @param recover true to catch SIGSEGV, SIGFPE and SIGBUS
+ */
+void testrunner_set_crash_recovery(TestRunner *runner, bool recover);
+/**
+ * Install the crash handlers if the runner asks for them. Internal use
+ * function, called before any testcase runs.
+ *
+ * @param runner testrunner about to be run
+ */
+void guard_prepare(TestRunner *runner);
+/**
+ * Put back the signal handlers `guard_prepare()` replaced. Internal use
+ * function.
+ */
+void guard_release(void);
+/**
+ * Run a function inside a guard frame on the calling thread, recording a
+ * failure to the testcase if it crashed. Internal use function.
+ *
+ * @param func function to run
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase being run
+ * @param uut custom uut object supplied to the case
+ * @return 0 if `func` returned, `CUF_GUARD_REQUIRE` if a REQUIRE check
+ *         stopped it, or the number of the signal it crashed with
+ */
+int guard_call(GuardFunc func, TestSuite *suite, TestCase *testcase,
+               void *uut);
+/**
+ * Call the suite's setup function, if it has one, inside a guard frame on
+ * the calling thread, recording a failure to the testcase if it crashed.
+ * Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase being set up
+ * @param uut where the setup function stores the uut
+ * @return 0 if the setup returned, or the number of the signal it crashed
+ *         with
+ */
+int guard_setup(TestSuite *suite, TestCase *testcase, void **uut);
+/**
+ * Call the suite's teardown function, if it has one, inside a guard frame on
+ * the calling thread, recording a failure to the testcase if it crashed.
+ * Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase being torn down
+ * @param uut uut produced by the setup function
+ * @return 0 if the teardown returned, or the number of the signal it crashed
+ *         with
+ */
+int guard_teardown(TestSuite *suite, TestCase *testcase, void *uut);
+/**
+ * Leave the test function running on the calling thread for its guard frame,
+ * after a REQUIRE check failed. Returns when called outside of a test
+ * function, e.g. from a setup function, where the check stays non-fatal.
+ * Internal use function, see the REQUIRE macros in cuf_assert.h.
+ */
+void guard_fatal(void);
+
+#endif
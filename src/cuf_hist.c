@@ -0,0 +1,133 @@
+/**
+ * @file cuf_hist.c
+ * @brief CUnitFramework (CUF): Latency Histogram Implementation
+ * @details Percentile lookup, merging and reporting for histograms. Bucket
+ * `i` covers the values from `bucket_low(i)` up to and including
+ * `bucket_high(i)`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_hist.h"
+#include "cuf_util.h"
+
+
+static uint64_t bucket_low(size_t index);
+static uint64_t bucket_high(size_t index);
+static void table_row(char *buf, size_t size, size_t *used, const char *label,
+                      uint64_t ns);
+
+// percentiles shown in the table, besides min and max
+static const double table_pcts[] = {50, 90, 99, 99.9, 99.99};
+
+
+CufHist *hist_create(void) {
+    CufHist *hist = malloc(sizeof(CufHist));
+    hist_reset(hist);
+    return hist;
+}
+
+void hist_destroy(CufHist *hist) {
+    free(hist);
+}
+
+void hist_reset(CufHist *hist) {
+    memset(hist, 0, sizeof(CufHist));
+    hist->min = UINT64_MAX;
+}
+
+void hist_merge(CufHist *dst, const CufHist *src) {
+    for(size_t i = 0; i < CUF_HIST_BUCKETS; ++i) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->min < dst->min) dst->min = src->min;
+    if(src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_percentile(const CufHist *hist, double pct) {
+    if(hist->count == 0) return 0;
+    if(pct <= 0) return hist->min;
+    if(pct >= 100) return hist->max;
+    // the smallest value with at least pct percent of values at or below it
+    uint64_t rank = (uint64_t) (pct / 100 * hist->count);
+    if((double) rank < pct / 100 * hist->count) ++rank;
+    if(rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for(size_t i = 0; i < CUF_HIST_BUCKETS; ++i) {
+        seen += hist->counts[i];
+        if(seen < rank) continue;
+        uint64_t high = bucket_high(i);
+        if(high > hist->max) return hist->max;
+        if(high < hist->min) return hist->min;
+        return high;
+    }
+    return hist->max;
+}
+
+int hist_table(char *buf, size_t size, const CufHist *hist) {
+    char mean[32];
+    cuf_format_ns(mean, sizeof(mean),
+                  hist->count? (double) hist->sum / hist->count : 0);
+    size_t used = snprintf(buf, size, "count %llu, mean %s\n",
+                           (unsigned long long) hist->count, mean);
+    table_row(buf, size, &used, "min", hist_percentile(hist, 0));
+    for(size_t i = 0; i < sizeof(table_pcts) / sizeof(double); ++i) {
+        char label[16];
+        snprintf(label, sizeof(label), "p%g", table_pcts[i]);
+        table_row(buf, size, &used, label,
+                  hist_percentile(hist, table_pcts[i]));
+    }
+    table_row(buf, size, &used, "max", hist_percentile(hist, 100));
+    return used;
+}
+
+int hist_assert_below(TestSuite *suite, const char *file, int line,
+                      const char *what, const char *expr_a,
+                      const char *expr_b, const CufHist *hist, double pct,
+                      uint64_t limit) {
+    uint64_t value = hist_percentile(hist, pct);
+    if(hist->count && value < limit) return 0;
+    char detail[4 * CUF_BUF_SIZE];
+    if(hist->count == 0) {
+        snprintf(detail, sizeof(detail), "No values were recorded");
+    } else {
+        char label[16];
+        if(pct >= 100) {
+            snprintf(label, sizeof(label), "max");
+        } else {
+            snprintf(label, sizeof(label), "p%g", pct);
+        }
+        int used = snprintf(detail, sizeof(detail), "%s is %llu ns, limit "
+                            "%llu ns\n", label, (unsigned long long) value,
+                            (unsigned long long) limit);
+        hist_table(detail + used, sizeof(detail) - used, hist);
+    }
+    testsuite_record_detail(suite, file, line, what, expr_a, expr_b, detail);
+    return 1;
+}
+
+
+static uint64_t bucket_low(size_t index) {
+    size_t group = index / CUF_HIST_SUB;
+    uint64_t sub = index % CUF_HIST_SUB;
+    if(group == 0) return sub;
+    return (CUF_HIST_SUB + sub) << (group - 1);
+}
+
+static uint64_t bucket_high(size_t index) {
+    size_t group = index / CUF_HIST_SUB;
+    if(group == 0) return bucket_low(index);
+    return bucket_low(index) + (((uint64_t) 1 << (group - 1)) - 1);
+}
+
+static void table_row(char *buf, size_t size, size_t *used, const char *label,
+                      uint64_t ns) {
+    char val[32];
+    cuf_format_ns(val, sizeof(val), ns);
+    // keep counting past the end of buf, like snprintf does
+    size_t pos = *used < size? *used : size;
+    *used += snprintf(buf + pos, size - pos, "    %-7s %s\n", label, val);
+}
@@ -0,0 +1,200 @@
+/**
+ * @file cuf_hist.h
+ * @brief CUnitFramework (CUF): Latency Histogram Interface
+ * @details A fixed size, log-linear histogram of nanosecond latencies in the
+ * style of HdrHistogram. Values below `CUF_HIST_SUB` get a bucket each; above
+ * that every power of two is split into `CUF_HIST_SUB` equal buckets, so any
+ * recorded value is known to within 1/64 of itself over the whole `uint64_t`
+ * range. Recording is a bit scan, a shift and a few increments on memory
+ * allocated up front, cheap enough to sit inside the loop being measured.
+ *
+ * A histogram is not thread safe; give each thread its own and combine them
+ * with `hist_merge()` once the threads are done.
+ */
+#ifndef __CUF_HIST_H__
+#define __CUF_HIST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cuf.h"
+
+// log2 of the number of buckets each power of two is split into
+#define CUF_HIST_SUB_BITS 6
+// number of buckets each power of two is split into
+#define CUF_HIST_SUB (1 << CUF_HIST_SUB_BITS)
+// total number of buckets, enough for any uint64_t value
+#define CUF_HIST_BUCKETS ((64 - CUF_HIST_SUB_BITS + 1) * CUF_HIST_SUB)
+
+
+/**
+ * Assert that the 50th percentile of a histogram is below a limit. The
+ * failure message shows the histogram's percentile table.
+ *
+ * @param hist CufHist pointer to check
+ * @param ns exclusive upper limit in nanoseconds
+ */
+#define ASSERT_P50_BELOW(hist, ns) do {\
+    hist_assert_below(suite, __FILE__, __LINE__, "Assertion failure: p50 of "\
+                      "`%s` should be BELOW `%s`", #hist, #ns, (hist), 50.0,\
+                      (ns));\
+} while (0)
+/**
+ * Assert that the 99th percentile of a histogram is below a limit. The
+ * failure message shows the histogram's percentile table.
+ *
+ * @param hist CufHist pointer to check
+ * @param ns exclusive upper limit in nanoseconds
+ */
+#define ASSERT_P99_BELOW(hist, ns) do {\
+    hist_assert_below(suite, __FILE__, __LINE__, "Assertion failure: p99 of "\
+                      "`%s` should be BELOW `%s`", #hist, #ns, (hist), 99.0,\
+                      (ns));\
+} while (0)
+/**
+ * Assert that the 99.9th percentile of a histogram is below a limit. The
+ * failure message shows the histogram's percentile table.
+ *
+ * @param hist CufHist pointer to check
+ * @param ns exclusive upper limit in nanoseconds
+ */
+#define ASSERT_P999_BELOW(hist, ns) do {\
+    hist_assert_below(suite, __FILE__, __LINE__, "Assertion failure: p99.9 "\
+                      "of `%s` should be BELOW `%s`", #hist, #ns, (hist),\
+                      99.9, (ns));\
+} while (0)
+/**
+ * Assert that the largest value recorded to a histogram is below a limit. The
+ * failure message shows the histogram's percentile table.
+ *
+ * @param hist CufHist pointer to check
+ * @param ns exclusive upper limit in nanoseconds
+ */
+#define ASSERT_MAX_BELOW(hist, ns) do {\
+    hist_assert_below(suite, __FILE__, __LINE__, "Assertion failure: max of "\
+                      "`%s` should be BELOW `%s`", #hist, #ns, (hist), 100.0,\
+                      (ns));\
+} while (0)
+/**
+ * Assert that any percentile of a histogram is below a limit. The failure
+ * message shows the histogram's percentile table.
+ *
+ * @param hist CufHist pointer to check
+ * @param pct percentile to check, from 0 to 100
+ * @param ns exclusive upper limit in nanoseconds
+ */
+#define ASSERT_PERCENTILE_BELOW(hist, pct, ns) do {\
+    hist_assert_below(suite, __FILE__, __LINE__, "Assertion failure: "\
+                      "percentile of `%s` should be BELOW `%s`", #hist, #ns,\
+                      (hist), (pct), (ns));\
+} while (0)
+
+
+/**
+ * Latency histogram, see the file description.
+ */
+typedef struct {
+    uint64_t count;        /**< number of recorded values */
+    uint64_t sum;          /**< sum of the recorded values */
+    uint64_t min;          /**< smallest recorded value */
+    uint64_t max;          /**< largest recorded value */
+    uint64_t counts[CUF_HIST_BUCKETS]; /**< number of values per bucket */
+} CufHist;
+
+
+/**
+ * Get the bucket a value is counted in. Internal use function.
+ *
+ * @param value value to look up
+ * @return index into `counts`
+ */
+static inline size_t hist_index(uint64_t value) {
+    if(value < CUF_HIST_SUB) return (size_t) value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - CUF_HIST_SUB_BITS;
+    // value >> shift is in [SUB, 2 * SUB), its low bits pick the sub-bucket
+    return (size_t) (shift + 1) * CUF_HIST_SUB +
+           (size_t) (value >> shift) - CUF_HIST_SUB;
+}
+
+/**
+ * Record a value to a histogram.
+ *
+ * @param hist histogram to record to
+ * @param value value to record, usually a latency in nanoseconds
+ */
+static inline void hist_record(CufHist *hist, uint64_t value) {
+    ++(hist->counts[hist_index(value)]);
+    ++(hist->count);
+    hist->sum += value;
+    if(value < hist->min) hist->min = value;
+    if(value > hist->max) hist->max = value;
+}
+
+/**
+ * Create an empty histogram.
+ *
+ * @return the new histogram
+ */
+CufHist *hist_create(void);
+/**
+ * Destroy a histogram made with `hist_create()`.
+ *
+ * @param hist histogram to destroy
+ */
+void hist_destroy(CufHist *hist);
+/**
+ * Empty a histogram. Also initializes a histogram that was not made with
+ * `hist_create()`, e.g. a static one.
+ *
+ * @param hist histogram to empty
+ */
+void hist_reset(CufHist *hist);
+/**
+ * Add every value recorded to one histogram to another.
+ *
+ * @param dst histogram to add to
+ * @param src histogram to add, left as is
+ */
+void hist_merge(CufHist *dst, const CufHist *src);
+/**
+ * Get a percentile of the recorded values. The result is the highest value
+ * that falls in the same bucket as the percentile (never more than the
+ * largest recorded value), so it can overestimate by up to 1/64 but never
+ * underestimates.
+ *
+ * @param hist histogram to query
+ * @param pct percentile, from 0 (the smallest value) to 100 (the largest)
+ * @return the percentile, 0 for an empty histogram
+ */
+uint64_t hist_percentile(const CufHist *hist, double pct);
+/**
+ * Write the count, mean and a table of percentiles of a histogram.
+ *
+ * @param buf buffer to write to
+ * @param size size of `buf`
+ * @param hist histogram to describe
+ * @return number of bytes written, as with `snprintf()`
+ */
+int hist_table(char *buf, size_t size, const CufHist *hist);
+/**
+ * Check a percentile of a histogram against a limit and record a failure
+ * showing the percentile table if it isn't below it. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param what static printf format describing the check
+ * @param expr_a static source text of the histogram
+ * @param expr_b static source text of the limit
+ * @param hist histogram to check
+ * @param pct percentile to check
+ * @param limit exclusive upper limit for the percentile
+ * @return 0 if the percentile is below the limit, 1 otherwise
+ */
+int hist_assert_below(TestSuite *suite, const char *file, int line,
+                      const char *what, const char *expr_a,
+                      const char *expr_b, const CufHist *hist, double pct,
+                      uint64_t limit);
+
+#endif
@@ -0,0 +1,796 @@
+/**
+ * @file cuf_iso.c
+ * @brief CUnitFramework (CUF): Process Isolation Implementation
+ * @details Pre-forked worker pool for the cuf framework. The parent only ever
+ * dispatches testcases and merges results; workers run one testcase at a time
+ * and report back over a pipe using a tiny framed protocol:
+ *
+ * parent -> worker: int32 index of the task to run
+ * worker -> parent: 'F' site, what, expr_a, expr_b pointers, two CufValues,
+ *                       uint32 detail length, detail bytes (stored failure)
+ *                   'N' site, int64 count (failures past the site's limit)
+ *                   'B' BenchStats (benchmark results, before 'D')
+ *                   'T' CaseTimes (timings of the testcase, before 'D')
+ *                   'P' PerfCounts (event counts, before 'D' if counted)
+ *                   'A' AllocStats (heap usage, before 'D' if counted)
+ *                   'M' uint64 peak RSS growth (before 'D')
+ *                   'D' int32 final status (once per task)
+ *
+ * where a site is the `__FILE__` pointer and int32 line of the assertion.
+ * Workers are forked from the parent, so static strings such as `__FILE__`
+ * or the texts of a failure record live at the same address on both sides
+ * and the pointers can be sent as is. A detail length of 0 means no detail.
+ *
+ * Testcases that depend on others (see cuf_dep.h) are only dispatched once
+ * those have passed; until then they are passed over, and a worker that
+ * finds nothing ready stays idle until another case finishes. Tasks are
+ * dispatched in the order of the run (see cuf_order.h).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cuf_alloc.h"
+#include "cuf_arena.h"
+#include "cuf_bench.h"
+#include "cuf_guard.h"
+#include "cuf_iso.h"
+#include "cuf_order.h"
+#include "cuf_perf.h"
+#include "cuf_prof.h"
+#include "cuf_shard.h"
+#include "cuf_util.h"
+#include "cuf_watch.h"
+
+
+/**
+ * frame types sent from a worker back to the parent
+ */
+enum iso_frames {
+    ISO_FRAME_FAIL = 'F',  /**< failure message for the running testcase */
+    ISO_FRAME_MORE = 'N',  /**< failures that were only counted */
+    ISO_FRAME_BENCH = 'B', /**< results of the running benchmark */
+    ISO_FRAME_TIMES = 'T', /**< timings of the running testcase */
+    ISO_FRAME_PERF = 'P',  /**< event counts of the running testcase */
+    ISO_FRAME_ALLOC = 'A', /**< heap usage of the running testcase */
+    ISO_FRAME_RSS = 'M',   /**< peak RSS growth of the running testcase */
+    ISO_FRAME_DONE = 'D'   /**< final status of the running testcase */
+};
+
+/**
+ * a single testcase waiting to be run by a worker
+ */
+typedef struct {
+    int suite_idx;         /**< index of the owning suite in the runner */
+    TestCase *testcase;    /**< testcase to run */
+    bool dispatched;       /**< sent to a worker, or skipped in the parent */
+} IsoTask;
+
+/**
+ * parent side view of a worker process
+ */
+typedef struct {
+    pid_t pid;             /**< pid of the worker, -1 if the slot is empty */
+    int cmd_fd;            /**< write end of the task pipe, -1 once retired */
+    int res_fd;            /**< read end of the result pipe */
+    int task;              /**< index of the task being run, -1 if idle */
+    uint64_t deadline;     /**< `cuf_now_ns()` the task times out at, or 0 */
+    bool timed_out;        /**< the worker was killed for running too long */
+} IsoWorker;
+
+/**
+ * a set up uut that cases of a zygote suite are forked from
+ */
+struct zygote_t {
+    void *uut;             /**< uut produced by the suite's setup function */
+    void *args;            /**< args the uut was set up with */
+    TestCase *first;       /**< case setup was called with */
+};
+
+/**
+ * state of an isolated run
+ */
+typedef struct {
+    TestRunner *runner;    /**< runner being run */
+    IsoTask *tasks;        /**< every testcase of every suite */
+    int ntasks;            /**< number of tasks */
+    int next_task;         /**< index of the first task not dispatched */
+    int *remaining;        /**< per suite count of cases not reported back */
+    int next_print;        /**< index of the next suite to print */
+    IsoWorker *workers;    /**< worker slots */
+    int nworkers;          /**< number of worker slots */
+} IsoRun;
+
+
+// where a worker process streams its results, -1 in the parent
+static int iso_res_fd = -1;
+
+static bool write_full(int fd, const void *buf, size_t len);
+static bool read_full(int fd, void *buf, size_t len);
+static void iso_fail_hook(TestCase *tc, Failure *site, FailureMsg *msg);
+static void send_done(int fd, TestCase *tc);
+static int read_frame(int fd, TestCase *tc, int32_t *status);
+static void record_crash(TestCase *tc, int wstatus);
+static bool worker_spawn(IsoRun *run, int slot);
+static void worker_main(IsoRun *run, int cmd_fd, int res_fd);
+static void worker_dispatch(IsoRun *run, int slot);
+static int task_next(IsoRun *run);
+static void worker_collect(IsoRun *run, int slot);
+static void worker_reap(IsoRun *run, int slot);
+static void task_finish(IsoRun *run, int task, bool ran);
+static int compare_tasks(const void *a, const void *b);
+static int poll_timeout(IsoRun *run);
+static int wait_readable(int fd, uint64_t deadline);
+
+
+int testrunner_run_isolated(TestRunner *runner, int nworkers) {
+    testrunner_print_header(runner);
+    fflush(stdout);
+
+    IsoRun run;
+    run.runner = runner;
+    run.next_task = 0;
+    run.next_print = 0;
+    run.remaining = malloc(sizeof(int) * (runner->suite_count + 1));
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        total += runner->suites[i]->test_count;
+    }
+    run.tasks = malloc(sizeof(IsoTask) * (total + 1));
+    run.ntasks = 0;
+    // init functions run here so every worker inherits their results
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        run.remaining[i] = suite->test_count - suite->deselected;
+        if(shard_skips_suite(suite)) continue;
+        if(suite->init) suite->init(suite);
+        for(int j = 0; j < suite->test_count; ++j) {
+            if(suite->testcases[j]->status == CUF_TC_DESELECTED) continue;
+            // results are cached, so every worker inherits them as well
+            dependency_check(suite->testcases[j]->deps);
+            run.tasks[run.ntasks].suite_idx = i;
+            run.tasks[run.ntasks].testcase = suite->testcases[j];
+            run.tasks[run.ntasks].dispatched = false;
+            ++run.ntasks;
+        }
+    }
+    qsort(run.tasks, run.ntasks, sizeof(IsoTask), &compare_tasks);
+    // a dead worker must show up as EOF, not kill us on the next write
+    struct sigaction ignore, old_pipe;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, &old_pipe);
+
+    if(nworkers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = (cpus > 0)? (int) cpus : 1;
+    }
+    if(nworkers > run.ntasks) nworkers = run.ntasks;
+    run.nworkers = nworkers;
+    run.workers = malloc(sizeof(IsoWorker) * (nworkers + 1));
+    for(int i = 0; i < nworkers; ++i) {
+        run.workers[i].pid = -1;
+        run.workers[i].cmd_fd = -1;
+        run.workers[i].res_fd = -1;
+        run.workers[i].task = -1;
+    }
+    for(int i = 0; i < nworkers; ++i) {
+        if(worker_spawn(&run, i)) worker_dispatch(&run, i);
+    }
+    // suites without any cases are complete before anything ran
+    task_finish(&run, -1, false);
+
+    struct pollfd *fds = malloc(sizeof(struct pollfd) * (nworkers + 1));
+    int *slots = malloc(sizeof(int) * (nworkers + 1));
+    while(true) {
+        int nfds = 0;
+        for(int i = 0; i < nworkers; ++i) {
+            if(run.workers[i].pid < 0) continue;
+            fds[nfds].fd = run.workers[i].res_fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            slots[nfds] = i;
+            ++nfds;
+        }
+        if(nfds == 0) break;
+        int ready = poll(fds, nfds, poll_timeout(&run));
+        if(ready < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        for(int i = 0; i < nfds; ++i) {
+            if(fds[i].revents) worker_collect(&run, slots[i]);
+        }
+        // a finished case may have readied some for the idle workers
+        for(int i = 0; i < nworkers; ++i) {
+            IsoWorker *worker = &run.workers[i];
+            if(worker->pid < 0 || worker->task >= 0) continue;
+            if(worker->cmd_fd >= 0) worker_dispatch(&run, i);
+        }
+        // whatever is still running past its deadline gets killed
+        uint64_t now = cuf_now_ns();
+        for(int i = 0; i < nworkers; ++i) {
+            IsoWorker *worker = &run.workers[i];
+            if(worker->pid < 0 || worker->task < 0) continue;
+            if(worker->deadline == 0 || now < worker->deadline) continue;
+            worker->timed_out = true;
+            worker_reap(&run, i);
+        }
+    }
+    // anything left over never got a worker to run on
+    for(int task = run.next_task; task < run.ntasks; ++task) {
+        if(run.tasks[task].dispatched) continue;
+        run.tasks[task].dispatched = true;
+        // left out after a failure rather than for want of a worker
+        if(order_stopped()) {
+            task_finish(&run, task, false);
+            continue;
+        }
+        testcase_record_fail(run.tasks[task].testcase,
+                             "Crash: could not start a worker process");
+        task_finish(&run, task, true);
+    }
+
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    free(fds);
+    free(slots);
+    free(run.workers);
+    free(run.tasks);
+    free(run.remaining);
+    return testrunner_report(runner);
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+    const char *pos = buf;
+    while(len > 0) {
+        ssize_t ret = write(fd, pos, len);
+        if(ret < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        pos += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static bool read_full(int fd, void *buf, size_t len) {
+    char *pos = buf;
+    while(len > 0) {
+        ssize_t ret = read(fd, pos, len);
+        if(ret < 0 && errno == EINTR) continue;
+        if(ret <= 0) return false;
+        pos += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static void iso_fail_hook(TestCase *tc, Failure *site, FailureMsg *msg) {
+    CUF_UNUSED(tc);
+    uintptr_t ptrs[4] = {(uintptr_t) site->file, (uintptr_t) msg->what,
+                         (uintptr_t) msg->expr_a, (uintptr_t) msg->expr_b};
+    int32_t line = site->line;
+    uint32_t len = msg->detail? strlen(msg->detail) : 0;
+    size_t size = 1 + sizeof(ptrs) + sizeof(line) + 2 * sizeof(CufValue) +
+                  sizeof(len) + len;
+    char *frame = malloc(size);
+    char *pos = frame;
+    *pos++ = ISO_FRAME_FAIL;
+    memcpy(pos, ptrs, sizeof(ptrs[0]));
+    pos += sizeof(ptrs[0]);
+    memcpy(pos, &line, sizeof(line));
+    pos += sizeof(line);
+    memcpy(pos, ptrs + 1, sizeof(ptrs) - sizeof(ptrs[0]));
+    pos += sizeof(ptrs) - sizeof(ptrs[0]);
+    memcpy(pos, &msg->val_a, sizeof(CufValue));
+    pos += sizeof(CufValue);
+    memcpy(pos, &msg->val_b, sizeof(CufValue));
+    pos += sizeof(CufValue);
+    memcpy(pos, &len, sizeof(len));
+    pos += sizeof(len);
+    if(len) memcpy(pos, msg->detail, len);
+    write_full(iso_res_fd, frame, size);
+    free(frame);
+}
+
+static void send_done(int fd, TestCase *tc) {
+    fflush(stdout);
+    fflush(stderr);
+    // messages were streamed as they came, only the overflow counts are left
+    for(Failure *site = tc->failures; site; site = site->next) {
+        if(site->count <= site->stored) continue;
+        uintptr_t file = (uintptr_t) site->file;
+        int32_t line = site->line;
+        int64_t more = site->count - site->stored;
+        char frame[1 + sizeof(file) + sizeof(line) + sizeof(more)];
+        char *pos = frame;
+        *pos++ = ISO_FRAME_MORE;
+        memcpy(pos, &file, sizeof(file));
+        pos += sizeof(file);
+        memcpy(pos, &line, sizeof(line));
+        pos += sizeof(line);
+        memcpy(pos, &more, sizeof(more));
+        write_full(fd, frame, sizeof(frame));
+    }
+    if(tc->bench) {
+        char frame[1 + sizeof(BenchStats)];
+        frame[0] = ISO_FRAME_BENCH;
+        memcpy(frame + 1, tc->bench, sizeof(BenchStats));
+        write_full(fd, frame, sizeof(frame));
+    }
+    if(tc->perf) {
+        char frame[1 + sizeof(PerfCounts)];
+        frame[0] = ISO_FRAME_PERF;
+        memcpy(frame + 1, tc->perf, sizeof(PerfCounts));
+        write_full(fd, frame, sizeof(frame));
+    }
+    if(tc->alloc) {
+        char frame[1 + sizeof(AllocStats)];
+        frame[0] = ISO_FRAME_ALLOC;
+        memcpy(frame + 1, tc->alloc, sizeof(AllocStats));
+        write_full(fd, frame, sizeof(frame));
+    }
+    char memory[1 + sizeof(tc->peak_rss)];
+    memory[0] = ISO_FRAME_RSS;
+    memcpy(memory + 1, &tc->peak_rss, sizeof(tc->peak_rss));
+    write_full(fd, memory, sizeof(memory));
+    char times[1 + sizeof(CaseTimes)];
+    times[0] = ISO_FRAME_TIMES;
+    memcpy(times + 1, &tc->times, sizeof(CaseTimes));
+    write_full(fd, times, sizeof(times));
+    int32_t status = tc->status;
+    char frame[1 + sizeof(status)];
+    frame[0] = ISO_FRAME_DONE;
+    memcpy(frame + 1, &status, sizeof(status));
+    write_full(fd, frame, sizeof(frame));
+}
+
+static int read_frame(int fd, TestCase *tc, int32_t *status) {
+    char type;
+    if(!read_full(fd, &type, 1)) return -1;
+    if(type == ISO_FRAME_DONE) {
+        if(!read_full(fd, status, sizeof(*status))) return -1;
+        return ISO_FRAME_DONE;
+    }
+    if(type == ISO_FRAME_BENCH) {
+        BenchStats stats;
+        if(!read_full(fd, &stats, sizeof(stats))) return -1;
+        if(tc && tc->bench) *tc->bench = stats;
+        return ISO_FRAME_BENCH;
+    }
+    if(type == ISO_FRAME_TIMES) {
+        CaseTimes times;
+        if(!read_full(fd, &times, sizeof(times))) return -1;
+        if(tc) tc->times = times;
+        return ISO_FRAME_TIMES;
+    }
+    if(type == ISO_FRAME_PERF) {
+        PerfCounts counts;
+        if(!read_full(fd, &counts, sizeof(counts))) return -1;
+        if(tc) {
+            if(!tc->perf) tc->perf = malloc(sizeof(PerfCounts));
+            *tc->perf = counts;
+        }
+        return ISO_FRAME_PERF;
+    }
+    if(type == ISO_FRAME_ALLOC) {
+        AllocStats stats;
+        if(!read_full(fd, &stats, sizeof(stats))) return -1;
+        if(tc) {
+            if(!tc->alloc) tc->alloc = malloc(sizeof(AllocStats));
+            *tc->alloc = stats;
+        }
+        return ISO_FRAME_ALLOC;
+    }
+    if(type == ISO_FRAME_RSS) {
+        uint64_t peak_rss;
+        if(!read_full(fd, &peak_rss, sizeof(peak_rss))) return -1;
+        if(tc) tc->peak_rss = peak_rss;
+        return ISO_FRAME_RSS;
+    }
+    if(type != ISO_FRAME_FAIL && type != ISO_FRAME_MORE) return -1;
+    uintptr_t file;
+    int32_t line;
+    if(!read_full(fd, &file, sizeof(file))) return -1;
+    if(!read_full(fd, &line, sizeof(line))) return -1;
+    if(type == ISO_FRAME_MORE) {
+        int64_t more;
+        if(!read_full(fd, &more, sizeof(more))) return -1;
+        if(tc) {
+            Failure *site = testcase_fail_site(tc, (const char *) file, line);
+            site->count += more;
+            tc->err_msg_count += more;
+            tc->status = CUF_TC_FAIL;
+        }
+        return ISO_FRAME_MORE;
+    }
+    uintptr_t texts[3];
+    CufValue vals[2];
+    uint32_t len;
+    if(!read_full(fd, texts, sizeof(texts))) return -1;
+    if(!read_full(fd, vals, sizeof(vals))) return -1;
+    if(!read_full(fd, &len, sizeof(len))) return -1;
+    char *detail = malloc(len + 1);
+    bool ok = read_full(fd, detail, len);
+    detail[len] = '\0';
+    FailureMsg msg = {NULL, (const char *) texts[0], (const char *) texts[1],
+                      (const char *) texts[2], len? detail : NULL,
+                      vals[0], vals[1]};
+    if(ok && tc) testcase_record(tc, (const char *) file, line, &msg);
+    free(detail);
+    return ok? ISO_FRAME_FAIL : -1;
+}
+
+static void record_crash(TestCase *tc, int wstatus) {
+    char msg[CUF_BUF_SIZE] = {'0'};
+    if(WIFSIGNALED(wstatus)) {
+        // a SIGKILL the runner didn't send is most likely the OOM killer
+        snprintf(msg, CUF_BUF_SIZE, "Crash: testcase process killed by signal "
+                 "%s (%d)%s\nIn TestCase: %s",
+                 cuf_signal_name(WTERMSIG(wstatus)), WTERMSIG(wstatus),
+                 WTERMSIG(wstatus) == SIGKILL? ", likely out of memory" : "",
+                 tc->test_name);
+    } else {
+        snprintf(msg, CUF_BUF_SIZE, "Crash: testcase process exited with "
+                 "status %d\nIn TestCase: %s", WEXITSTATUS(wstatus),
+                 tc->test_name);
+    }
+    testcase_record_fail(tc, msg);
+}
+
+static bool worker_spawn(IsoRun *run, int slot) {
+    int cmd[2];
+    int res[2];
+    if(pipe(cmd)) return false;
+    if(pipe(res)) {
+        close(cmd[0]);
+        close(cmd[1]);
+        return false;
+    }
+    // don't let the worker inherit (and later reprint) buffered output
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(cmd[0]);
+        close(cmd[1]);
+        close(res[0]);
+        close(res[1]);
+        return false;
+    }
+    if(pid == 0) {
+        close(cmd[1]);
+        close(res[0]);
+        // other workers must see EOF when the parent closes their pipes
+        for(int i = 0; i < run->nworkers; ++i) {
+            if(run->workers[i].pid < 0) continue;
+            if(run->workers[i].cmd_fd >= 0) close(run->workers[i].cmd_fd);
+            close(run->workers[i].res_fd);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        worker_main(run, cmd[0], res[1]);
+    }
+    close(cmd[0]);
+    close(res[1]);
+    run->workers[slot].pid = pid;
+    run->workers[slot].cmd_fd = cmd[1];
+    run->workers[slot].res_fd = res[0];
+    run->workers[slot].task = -1;
+    run->workers[slot].deadline = 0;
+    run->workers[slot].timed_out = false;
+    return true;
+}
+
+static void worker_main(IsoRun *run, int cmd_fd, int res_fd) {
+    iso_res_fd = res_fd;
+    testcase_set_fail_hook(&iso_fail_hook);
+    int32_t task;
+    while(read_full(cmd_fd, &task, sizeof(task))) {
+        IsoTask *c_task = &run->tasks[task];
+        TestSuite *suite = run->runner->suites[c_task->suite_idx];
+        // the parent saw them pass, this copy of them didn't
+        Dependency *deps = c_task->testcase->deps;
+        for(int i = 0; deps && i < deps->need_count; ++i) {
+            deps->needs[i].testcase->status = CUF_TC_PASS;
+            deps->needs[i].testcase->done = true;
+        }
+        c_task->testcase->status = CUF_TC_PASS;
+        testcase_run(suite, c_task->testcase);
+        send_done(res_fd, c_task->testcase);
+    }
+    _exit(0);
+}
+
+static void worker_dispatch(IsoRun *run, int slot) {
+    IsoWorker *worker = &run->workers[slot];
+    int32_t task = order_stopped()? -1 : task_next(run);
+    if(task < 0 && (run->next_task >= run->ntasks || order_stopped())) {
+        // nothing left to do, closing the pipe tells the worker to exit
+        if(worker->cmd_fd >= 0) close(worker->cmd_fd);
+        worker->cmd_fd = -1;
+        worker->task = -1;
+        return;
+    }
+    worker->task = task;
+    // the rest waits for their dependencies, stay idle until one finishes
+    if(task < 0) return;
+    IsoTask *c_task = &run->tasks[task];
+    double timeout = testcase_get_timeout(
+        run->runner->suites[c_task->suite_idx], c_task->testcase);
+    worker->deadline = 0;
+    if(timeout > 0) {
+        worker->deadline = cuf_now_ns() + (uint64_t) (timeout * 1e9);
+    }
+    // a failed write means the worker died, which collect will notice
+    write_full(worker->cmd_fd, &task, sizeof(task));
+}
+
+static int task_next(IsoRun *run) {
+    int found = -1;
+    for(int task = run->next_task; task < run->ntasks && found < 0; ++task) {
+        IsoTask *c_task = &run->tasks[task];
+        if(c_task->dispatched) continue;
+        int state = dependency_state(c_task->testcase, NULL);
+        if(state == CUF_DEP_WAIT) continue;
+        c_task->dispatched = true;
+        if(state == CUF_DEP_READY) {
+            found = task;
+            continue;
+        }
+        // a dependency didn't pass, no need to bother a worker
+        const char *reason = NULL;
+        dependency_state(c_task->testcase, &reason);
+        c_task->testcase->skip_reason = reason;
+        c_task->testcase->status = CUF_TC_SKIP;
+        task_finish(run, task, true);
+    }
+    while(run->next_task < run->ntasks &&
+          run->tasks[run->next_task].dispatched) {
+        ++run->next_task;
+    }
+    return found;
+}
+
+static void worker_collect(IsoRun *run, int slot) {
+    IsoWorker *worker = &run->workers[slot];
+    TestCase *c_case = NULL;
+    if(worker->task >= 0) c_case = run->tasks[worker->task].testcase;
+    int32_t status;
+    int type = read_frame(worker->res_fd, c_case, &status);
+    if(type < 0) {
+        worker_reap(run, slot);
+    } else if(type == ISO_FRAME_DONE) {
+        int task = worker->task;
+        if(task >= 0) {
+            c_case->status = status;
+            worker->task = -1;
+            task_finish(run, task, true);
+        }
+        worker_dispatch(run, slot);
+    }
+}
+
+static void worker_reap(IsoRun *run, int slot) {
+    IsoWorker *worker = &run->workers[slot];
+    int wstatus = 0;
+    if(worker->cmd_fd >= 0) close(worker->cmd_fd);
+    close(worker->res_fd);
+    // a worker that sent garbage may still be alive, make sure it is not
+    kill(worker->pid, SIGKILL);
+    while(waitpid(worker->pid, &wstatus, 0) < 0 && errno == EINTR);
+    worker->pid = -1;
+    worker->cmd_fd = -1;
+    worker->res_fd = -1;
+
+    int task = worker->task;
+    worker->task = -1;
+    if(task < 0) return;
+    // the worker died while running a case, blame the case
+    IsoTask *c_task = &run->tasks[task];
+    if(worker->timed_out) {
+        testcase_record_timeout(run->runner->suites[c_task->suite_idx],
+                                c_task->testcase);
+    } else {
+        record_crash(c_task->testcase, wstatus);
+    }
+    task_finish(run, task, true);
+    // replace the dead worker if there is still work to do
+    if(run->next_task < run->ntasks && !order_stopped() &&
+       worker_spawn(run, slot)) {
+        worker_dispatch(run, slot);
+    }
+}
+
+static void task_finish(IsoRun *run, int task, bool ran) {
+    TestRunner *runner = run->runner;
+    if(task >= 0 && ran) {
+        run->tasks[task].testcase->done = true;
+        order_case_done(run->tasks[task].testcase);
+    }
+    if(task >= 0) {
+        int suite_idx = run->tasks[task].suite_idx;
+        TestSuite *suite = runner->suites[suite_idx];
+        if(--run->remaining[suite_idx] == 0 && suite->term) suite->term(suite);
+    }
+    // print progress lines in registration order as the suites complete
+    while(run->next_print < runner->suite_count &&
+          run->remaining[run->next_print] == 0) {
+        TestSuite *suite = runner->suites[run->next_print];
+        if(shard_skips_suite(suite)) {
+            ++run->next_print;
+            continue;
+        }
+        if(suite->test_count == 0 && suite->term) suite->term(suite);
+        if(order_skips_suite(suite)) {
+            ++run->next_print;
+            continue;
+        }
+        testsuite_tally(suite);
+        printf("Test Suite: %s ", suite->name);
+        for(int j = 0; j < suite->test_count; ++j) {
+            testcase_print_progress(suite->testcases[j]);
+        }
+        testrunner_print_status(runner, suite);
+        ++run->next_print;
+    }
+}
+
+static int compare_tasks(const void *a, const void *b) {
+    const IsoTask *task_a = a;
+    const IsoTask *task_b = b;
+    return (task_a->testcase->run_order > task_b->testcase->run_order) -
+           (task_a->testcase->run_order < task_b->testcase->run_order);
+}
+
+static int poll_timeout(IsoRun *run) {
+    uint64_t first = 0;
+    for(int i = 0; i < run->nworkers; ++i) {
+        IsoWorker *worker = &run->workers[i];
+        if(worker->pid < 0 || worker->task < 0 || !worker->deadline) continue;
+        if(!first || worker->deadline < first) first = worker->deadline;
+    }
+    if(!first) return -1;
+    uint64_t now = cuf_now_ns();
+    if(now >= first) return 0;
+    // round up, waking early would just mean another round of polling
+    return (int) ((first - now + 999999) / 1000000);
+}
+
+static int wait_readable(int fd, uint64_t deadline) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while(true) {
+        int wait_ms = -1;
+        if(deadline) {
+            uint64_t now = cuf_now_ns();
+            if(now >= deadline) return 0;
+            wait_ms = (int) ((deadline - now + 999999) / 1000000);
+        }
+        int ready = poll(&pfd, 1, wait_ms);
+        if(ready > 0) return 1;
+        // a failed poll is treated as readable, the read will then fail
+        if(ready < 0 && errno != EINTR) return 1;
+    }
+}
+
+int testcase_run_zygote(TestSuite *suite, TestCase *testcase,
+                        Zygote **zygote) {
+    watchdog_hold();
+    if(testcase->status == CUF_TC_DESELECTED) return testcase->status;
+    if(!testcase_check_deps(testcase)) return testcase->status;
+    if(testcase->cached) {
+        testcase->status = CUF_TC_PASS;
+        testcase->done = true;
+        return testcase->status;
+    }
+    // a different args object needs a fresh setup
+    if(*zygote && (*zygote)->args != testcase->args) {
+        zygote_release(suite, *zygote);
+        *zygote = NULL;
+    }
+    if(!*zygote) {
+        *zygote = malloc(sizeof(Zygote));
+        (*zygote)->uut = NULL;
+        (*zygote)->args = testcase->args;
+        (*zygote)->first = testcase;
+        // the shared setup is charged to the case it was called with
+        uint64_t start = cuf_now_ns();
+        int crashed = guard_setup(suite, testcase, &(*zygote)->uut);
+        testcase->times.setup_ns = cuf_now_ns() - start;
+        // nothing to fork from, the next case sets up again
+        if(crashed) {
+            free(*zygote);
+            *zygote = NULL;
+            testcase->done = true;
+            order_case_done(testcase);
+            return testcase->status;
+        }
+    }
+
+    int res[2];
+    if(pipe(res)) {
+        testcase_record_fail(testcase, "Crash: could not fork testcase");
+        testcase->done = true;
+        return testcase->status;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    // under `testrunner_run_parallel()` other workers keep running
+    arena_prepare_fork();
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(res[0]);
+        close(res[1]);
+        testcase_record_fail(testcase, "Crash: could not fork testcase");
+        testcase->done = true;
+        return testcase->status;
+    }
+    if(pid == 0) {
+        close(res[0]);
+        iso_res_fd = res[1];
+        testcase_set_fail_hook(&iso_fail_hook);
+        testcase->status = CUF_TC_PASS;
+        // the child has the process to itself, even under a thread pool
+        prof_set_shared(false);
+        // only the case's own call is counted, the setup is shared
+        alloc_case_begin();
+        uint64_t rss = prof_rss_begin();
+        testcase_call(suite, testcase, (*zygote)->uut);
+        prof_rss_end(suite, testcase, rss);
+        alloc_case_end(testcase);
+        send_done(res[1], testcase);
+        _exit(0);
+    }
+    close(res[1]);
+    uint64_t deadline = 0;
+    double timeout = testcase_get_timeout(suite, testcase);
+    if(timeout > 0) deadline = cuf_now_ns() + (uint64_t) (timeout * 1e9);
+
+    // collect everything the case reports until it exits
+    bool done = false;
+    bool timed_out = false;
+    int32_t status;
+    while(true) {
+        if(!wait_readable(res[0], deadline)) {
+            kill(pid, SIGKILL);
+            timed_out = true;
+            break;
+        }
+        int type = read_frame(res[0], testcase, &status);
+        if(type < 0) break;
+        if(type == ISO_FRAME_DONE) {
+            testcase->status = status;
+            done = true;
+        }
+    }
+    close(res[0]);
+    int wstatus = 0;
+    while(waitpid(pid, &wstatus, 0) < 0 && errno == EINTR);
+    if(timed_out) {
+        testcase_record_timeout(suite, testcase);
+    } else if(!done) {
+        record_crash(testcase, wstatus);
+    }
+    watchdog_hold();
+    testcase->done = true;
+    order_case_done(testcase);
+    return testcase->status;
+}
+
+void zygote_release(TestSuite *suite, Zygote *zygote) {
+    if(!zygote) return;
+    uint64_t start = cuf_now_ns();
+    guard_teardown(suite, zygote->first, zygote->uut);
+    zygote->first->times.teardown_ns = cuf_now_ns() - start;
+    free(zygote);
+}
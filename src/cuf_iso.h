@@ -0,0 +1,59 @@
+/**
+ * @file cuf_iso.h
+ * @brief CUnitFramework (CUF): Process Isolation Interface
+ * @details Runners that execute testcases in separate processes, so that a
+ * crashing testcase is recorded as a failure instead of taking the whole test
+ * binary down with it. Also home to the forking behind `CUF_SUITE_ZYGOTE`.
+ */
+#ifndef __CUF_ISO_H__
+#define __CUF_ISO_H__
+
+#include "cuf.h"
+
+
+/**
+ * Run the given test runner with every testcase executed in a pool of
+ * pre-forked worker processes, and print results to stdout. Workers are
+ * forked once and then fed testcases over a pipe, streaming their failure
+ * messages and final status back to this process. A testcase that crashes its
+ * worker is recorded as failed with the name of the signal, and a fresh worker
+ * is forked to take its place.
+ *
+ * Suite init functions are run in this process before the workers are forked,
+ * so their effects are visible to every worker; term functions are run here
+ * once all of a suite's cases have reported back. Setup, the testcase, and
+ * teardown run inside the worker, so nothing they change is seen by this
+ * process or by later cases running in other workers.
+ *
+ * @param runner testrunner to run
+ * @param nworkers number of worker processes; 0 or less uses one per cpu
+ * @return 0 if no tests failed, 1 otherwise
+ */
+int testrunner_run_isolated(TestRunner *runner, int nworkers);
+
+/**
+ * Opaque handle to a set up uut that the cases of a `CUF_SUITE_ZYGOTE` suite
+ * are forked from.
+ */
+typedef struct zygote_t Zygote;
+/**
+ * Run a single testcase of a zygote suite in a forked child of the calling
+ * process. If `*zygote` is NULL, or was set up with different args, setup is
+ * run first and `*zygote` replaced. Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase to run
+ * @param zygote in/out handle to the current set up uut
+ * @return the resulting status code of the testcase
+ */
+int testcase_run_zygote(TestSuite *suite, TestCase *testcase,
+                        Zygote **zygote);
+/**
+ * Run teardown on a zygote's uut and free the handle. Internal use function.
+ *
+ * @param suite suite the zygote belongs to
+ * @param zygote handle to release, may be NULL
+ */
+void zygote_release(TestSuite *suite, Zygote *zygote);
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * @file cuf_merge.c
+ * @brief CUnitFramework (CUF): Shard Results Merge Tool
+ * @details `cufmerge [-o merged] results...` reads the results files written
+ * by the shards of a run (see cuf_shard.h) and prints the FAILURES, SKIPPED
+ * TESTS and RESULTS sections the run would have printed in one piece. With
+ * `-o` it also writes the combined results, in the same format, ready to be
+ * the timing file of the next run.
+ *
+ * Exits with 0 if every testcase passed or was skipped, 1 if one failed or
+ * the files don't add up to one whole run (a shard missing or given twice,
+ * testcases without results), and 2 if a file could not be read or written.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_escape.h"
+#include "cuf_shard.h"
+
+
+/**
+ * the result of one testcase, from one line of a results file
+ */
+typedef struct {
+    int suite_idx;         /**< index of the suite in the runner */
+    int case_idx;          /**< index of the testcase in the suite */
+    char *line;            /**< the line as read, for `-o` */
+    char *suite;           /**< unescaped name of the suite */
+    char *name;            /**< unescaped name of the testcase */
+    char *status;          /**< pass, cached, fail or skip */
+    char *failures;        /**< unescaped FAILURES text, or skip reason */
+    char *fields;          /**< buffer the pointers above point into */
+} MergeCase;
+
+/**
+ * everything read so far
+ */
+typedef struct {
+    MergeCase *cases;      /**< results of every file */
+    int count;             /**< number of `cases` */
+    int size;              /**< allocated size of `cases` */
+    int shard_count;       /**< shard count of the run, 0 until known */
+    int test_count;        /**< testcases registered in the run */
+    bool *seen;            /**< per shard flag set once its file is read */
+} Merge;
+
+static int read_results(Merge *merge, const char *path);
+static bool parse_case(MergeCase *c_case, const char *line);
+static int compare_cases(const void *a, const void *b);
+static bool check_run(Merge *merge);
+static int print_report(Merge *merge);
+static int write_merged(Merge *merge, const char *path);
+
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    int first = 1;
+    if(argc > 2 && strcmp(argv[1], "-o") == 0) {
+        out_path = argv[2];
+        first = 3;
+    }
+    if(first >= argc) {
+        fprintf(stderr, "usage: %s [-o merged] results...\n", argv[0]);
+        return 2;
+    }
+    Merge merge = {NULL, 0, 0, 0, 0, NULL};
+    int ret = 0;
+    for(int i = first; i < argc && ret == 0; ++i) {
+        if(read_results(&merge, argv[i])) ret = 2;
+    }
+    if(ret == 0) {
+        qsort(merge.cases, merge.count, sizeof(MergeCase), &compare_cases);
+        bool whole = check_run(&merge);
+        ret = print_report(&merge);
+        if(out_path && write_merged(&merge, out_path)) {
+            fprintf(stderr, "cufmerge: could not write %s\n", out_path);
+            ret = 2;
+        } else if(!whole && ret == 0) {
+            ret = 1;
+        }
+    }
+    for(int i = 0; i < merge.count; ++i) {
+        free(merge.cases[i].line);
+        free(merge.cases[i].fields);
+    }
+    free(merge.cases);
+    free(merge.seen);
+    return ret;
+}
+
+
+static int read_results(Merge *merge, const char *path) {
+    FILE *in = fopen(path, "r");
+    if(!in) {
+        fprintf(stderr, "cufmerge: could not read %s\n", path);
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    int index, count, tests;
+    if(getline(&line, &cap, in) <= 0 ||
+       sscanf(line, CUF_RESULTS_HEADER, &index, &count, &tests) != 3 ||
+       count < 1 || index < 1 || index > count) {
+        fprintf(stderr, "cufmerge: %s is not a results file\n", path);
+        free(line);
+        fclose(in);
+        return -1;
+    }
+    if(!merge->shard_count) {
+        merge->shard_count = count;
+        merge->test_count = tests;
+        merge->seen = calloc(count, sizeof(bool));
+    }
+    if(count != merge->shard_count || tests != merge->test_count) {
+        fprintf(stderr, "cufmerge: %s is from shard %d/%d of %d tests, not "
+                "from a run of %d shards of %d tests\n", path, index, count,
+                tests, merge->shard_count, merge->test_count);
+        free(line);
+        fclose(in);
+        return -1;
+    }
+    if(merge->seen[index - 1]) {
+        fprintf(stderr, "cufmerge: shard %d/%d given twice\n", index, count);
+        free(line);
+        fclose(in);
+        return -1;
+    }
+    merge->seen[index - 1] = true;
+    while(getline(&line, &cap, in) > 0) {
+        if(line[0] == '#') continue;
+        if(merge->count == merge->size) {
+            merge->size = merge->size? merge->size * 2 : 64;
+            merge->cases = realloc(merge->cases,
+                                   sizeof(MergeCase) * merge->size);
+        }
+        if(parse_case(&merge->cases[merge->count], line)) ++(merge->count);
+    }
+    free(line);
+    fclose(in);
+    return 0;
+}
+
+static bool parse_case(MergeCase *c_case, const char *line) {
+    c_case->fields = strdup(line);
+    char *save = NULL;
+    char *suite_idx = strtok_r(c_case->fields, "\t\n", &save);
+    char *case_idx = strtok_r(NULL, "\t\n", &save);
+    c_case->suite = strtok_r(NULL, "\t\n", &save);
+    c_case->name = strtok_r(NULL, "\t\n", &save);
+    c_case->status = strtok_r(NULL, "\t\n", &save);
+    char *ns = strtok_r(NULL, "\t\n", &save);
+    c_case->failures = strtok_r(NULL, "\n", &save);
+    if(!suite_idx || !case_idx || !c_case->suite || !c_case->name ||
+       !c_case->status || !ns) {
+        free(c_case->fields);
+        return false;
+    }
+    // no failures, point at the empty string ending the last field
+    if(!c_case->failures) c_case->failures = ns + strlen(ns);
+    c_case->suite_idx = atoi(suite_idx);
+    c_case->case_idx = atoi(case_idx);
+    cuf_unescape(c_case->suite);
+    cuf_unescape(c_case->name);
+    cuf_unescape(c_case->failures);
+    c_case->line = strdup(line);
+    return true;
+}
+
+static int compare_cases(const void *a, const void *b) {
+    const MergeCase *case_a = a;
+    const MergeCase *case_b = b;
+    if(case_a->suite_idx != case_b->suite_idx) {
+        return (case_a->suite_idx > case_b->suite_idx) -
+               (case_a->suite_idx < case_b->suite_idx);
+    }
+    return (case_a->case_idx > case_b->case_idx) -
+           (case_a->case_idx < case_b->case_idx);
+}
+
+static bool check_run(Merge *merge) {
+    bool whole = true;
+    for(int i = 0; i < merge->shard_count; ++i) {
+        if(merge->seen[i]) continue;
+        fprintf(stderr, "cufmerge: no results for shard %d/%d\n", i + 1,
+                merge->shard_count);
+        whole = false;
+    }
+    int unique = 0;
+    for(int i = 0; i < merge->count; ++i) {
+        MergeCase *c_case = &merge->cases[i];
+        if(i && compare_cases(c_case - 1, c_case) == 0) {
+            // shards that disagree on the split, e.g. different timing files
+            fprintf(stderr, "cufmerge: suite %s, testcase %s ran in more than "
+                    "one shard\n", c_case->suite, c_case->name);
+            whole = false;
+            continue;
+        }
+        ++unique;
+    }
+    if(whole && unique != merge->test_count) {
+        fprintf(stderr, "cufmerge: %d of %d tests have no results\n",
+                merge->test_count - unique, merge->test_count);
+        whole = false;
+    }
+    return whole;
+}
+
+static int print_report(Merge *merge) {
+    int total_failed = 0;
+    int total_passed = 0;
+    int total_skipped = 0;
+    int total_cached = 0;
+    // print failures
+    bool first_fail = true;
+    for(int i = 0; i < merge->count; ++i) {
+        MergeCase *c_case = &merge->cases[i];
+        if(strcmp(c_case->status, "fail") == 0) {
+            ++total_failed;
+        } else if(strcmp(c_case->status, "skip") == 0) {
+            ++total_skipped;
+            continue;
+        } else {
+            ++total_passed;
+            total_cached += strcmp(c_case->status, "cached") == 0;
+        }
+        if(!c_case->failures[0]) continue;
+        if(first_fail) {
+            printf("\n-----------FAILURES:-----------\n");
+            first_fail = false;
+        }
+        fputs(c_case->failures, stdout);
+    }
+    // print skipped tests, one paragraph per suite
+    int open_suite = -1;
+    for(int i = 0; i < merge->count; ++i) {
+        MergeCase *c_case = &merge->cases[i];
+        if(strcmp(c_case->status, "skip")) continue;
+        if(open_suite < 0) {
+            printf("\n-----------SKIPPED TESTS:-----------\n");
+        } else if(open_suite != c_case->suite_idx) {
+            printf("\n");
+        }
+        open_suite = c_case->suite_idx;
+        printf("\nIn suite: %s, skipped testcase: %s due to %s",
+               c_case->suite, c_case->name,
+               c_case->failures[0]? c_case->failures : "missing test files");
+    }
+    if(open_suite >= 0) printf("\n");
+    int total_tests = total_passed + total_skipped + total_failed;
+    printf("\n------------RESULTS:------------\n");
+    if(total_cached > 0) {
+        printf("\n%d Tests completed, %d passed (%d cached), %d skipped, "
+               "%d failed\n\n", total_tests, total_passed, total_cached,
+               total_skipped, total_failed);
+    } else {
+        printf("\n%d Tests completed, %d passed, %d skipped, %d failed\n\n",
+               total_tests, total_passed, total_skipped, total_failed);
+    }
+    return total_failed? 1 : 0;
+}
+
+static int write_merged(Merge *merge, const char *path) {
+    // write next to the old file and swap, so a crash can't leave half of it
+    size_t len = strlen(path) + 5;
+    char *tmp_path = malloc(len);
+    snprintf(tmp_path, len, "%s.tmp", path);
+    FILE *out = fopen(tmp_path, "w");
+    if(!out) {
+        free(tmp_path);
+        return -1;
+    }
+    fprintf(out, CUF_RESULTS_HEADER, 1, 1, merge->test_count);
+    for(int i = 0; i < merge->count; ++i) {
+        if(i && compare_cases(&merge->cases[i - 1], &merge->cases[i]) == 0) {
+            continue;
+        }
+        const char *line = merge->cases[i].line;
+        fputs(line, out);
+        if(line[strlen(line) - 1] != '\n') fputc('\n', out);
+    }
+    int ret = fclose(out)? -1 : rename(tmp_path, path);
+    free(tmp_path);
+    return ret? -1 : 0;
+}
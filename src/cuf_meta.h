@@ -9,7 +9,21 @@
 #define __CUF_META_H__
 
 #include "cuf.h"
+#include "cuf_alloc.h"
 #include "cuf_assert.h"
+#include "cuf_bench.h"
+#include "cuf_cache.h"
+#include "cuf_cmp.h"
+#include "cuf_guard.h"
+#include "cuf_hist.h"
+#include "cuf_iso.h"
+#include "cuf_order.h"
+#include "cuf_perf.h"
+#include "cuf_prof.h"
+#include "cuf_sched.h"
+#include "cuf_shard.h"
 #include "cuf_util.h"
+#include "cuf_value.h"
+#include "cuf_watch.h"
 
 #endif
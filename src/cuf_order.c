@@ -0,0 +1,621 @@
+/**
+ * @file cuf_order.c
+ * @brief CUnitFramework (CUF): Fail-fast Ordering Implementation
+ * @details The history is read into an array sorted by suite name, case name
+ * and occurrence, and the testcases of the run are sorted the same way, so
+ * matching the two up, when the run starts and again when the history is
+ * written back, is a single merge walk over both.
+ *
+ * When testcases depend on each other, the order the history gives is only
+ * used to pick among the suites, and the cases of a suite, whose
+ * dependencies come earlier. Suites and cases are each put in dependency
+ * order with a heap of the ready ones, keyed by that order; a cycle is broken
+ * by taking the earliest registered of what is left.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_escape.h"
+#include "cuf_order.h"
+
+
+/**
+ * the recorded runs of one testcase, from a line of the history file
+ */
+typedef struct {
+    char *suite;           /**< name of the suite */
+    char *name;            /**< name of the testcase */
+    int occurrence;        /**< cases of the same name registered before */
+    char outcomes[CUF_HISTORY_RUNS + 1]; /**< `p` or `f` per run, oldest
+                                              first, NUL terminated */
+    uint64_t ns[CUF_HISTORY_RUNS]; /**< nanoseconds each run took */
+} HistEntry;
+
+/**
+ * a testcase of the run, with what the history says about it
+ */
+typedef struct {
+    TestSuite *suite;      /**< suite the case belongs to */
+    TestCase *testcase;    /**< the case */
+    int order;             /**< position in registration order */
+    int occurrence;        /**< cases of the same name registered before */
+    HistEntry *entry;      /**< its history, NULL if it has none */
+    int rank;              /**< one of the `order_ranks` */
+    int fail_age;          /**< runs since its last failure */
+    uint64_t cost;         /**< mean nanoseconds of its recorded runs */
+} OrderCase;
+
+/**
+ * groups of testcases, in the order they run in
+ */
+enum order_ranks {
+    ORDER_FAILED,          /**< failed in one of the recorded runs */
+    ORDER_NEW,             /**< no recorded runs */
+    ORDER_PASSED           /**< passed every recorded run */
+};
+
+/**
+ * a dependency between two of the suites or testcases being ordered
+ */
+typedef struct {
+    int from;              /**< index of the one that has to run first */
+    int to;                /**< index of the one depending on it */
+} OrderEdge;
+
+/**
+ * an index along with the key to sort it by
+ */
+typedef struct {
+    int index;             /**< index of a suite or testcase */
+    int key;               /**< smallest `run_order` of it */
+} OrderKey;
+
+static OrderCase *collect_cases(TestRunner *runner, int *count);
+static void match_history(OrderCase *cases, int count, HistEntry *entries,
+                          int nentries);
+static HistEntry *load_history(const char *path, int *count);
+static void free_history(HistEntry *entries, int count);
+static void record_run(HistEntry *entry, TestCase *testcase);
+static void order_by_deps(TestRunner *runner, const int *priority);
+static void order_topo(int count, const int *key, OrderEdge *edges,
+                       int nedges, int *out);
+static void heap_push(int *heap, int *size, const int *key, int item);
+static int heap_pop(int *heap, int *size, const int *key);
+static int compare_edges(const void *a, const void *b);
+static void write_entry(FILE *out, const HistEntry *entry);
+static int compare_entries(const void *a, const void *b);
+static int compare_named(const void *a, const void *b);
+static int compare_case_entry(const OrderCase *c_case,
+                              const HistEntry *entry);
+static int compare_run(const void *a, const void *b);
+static int compare_keys(const void *a, const void *b);
+
+// fail-fast state of the current run
+static bool fail_fast = false;
+static atomic_bool stopped = false;
+
+
+void testrunner_set_history_file(TestRunner *runner, const char *path) {
+    free(runner->history_path);
+    runner->history_path = path? strdup(path) : NULL;
+}
+
+void testrunner_set_fail_fast(TestRunner *runner, bool fail_fast) {
+    runner->fail_fast = fail_fast;
+}
+
+void order_prepare(TestRunner *runner) {
+    fail_fast = runner->fail_fast;
+    atomic_store(&stopped, false);
+    order_number(runner);
+}
+
+void order_number(TestRunner *runner) {
+    int total = 0;
+    OrderCase *cases = collect_cases(runner, &total);
+    int nentries = 0;
+    HistEntry *entries = NULL;
+    if(runner->history_path) {
+        entries = load_history(runner->history_path, &nentries);
+    }
+    if(nentries > 0) {
+        match_history(cases, total, entries, nentries);
+        for(int i = 0; i < total; ++i) {
+            OrderCase *c_case = &cases[i];
+            HistEntry *entry = c_case->entry;
+            int runs = entry? (int) strlen(entry->outcomes) : 0;
+            if(runs == 0) {
+                c_case->rank = ORDER_NEW;
+                continue;
+            }
+            uint64_t sum = 0;
+            c_case->rank = ORDER_PASSED;
+            for(int k = 0; k < runs; ++k) {
+                sum += entry->ns[k];
+                if(entry->outcomes[k] != 'f') continue;
+                c_case->rank = ORDER_FAILED;
+                c_case->fail_age = runs - 1 - k;
+            }
+            c_case->cost = sum / runs;
+        }
+        qsort(cases, total, sizeof(OrderCase), &compare_run);
+    }
+    // history order by registration order, see `order_by_deps()`
+    int *priority = malloc(sizeof(int) * (total + 1));
+    for(int i = 0; i < total; ++i) priority[cases[i].order] = i;
+    if(dependency_between_cases(runner)) {
+        order_by_deps(runner, priority);
+    } else {
+        for(int i = 0; i < total; ++i) cases[i].testcase->run_order = i;
+    }
+    free(priority);
+    free_history(entries, nentries);
+    free(cases);
+}
+
+int *order_suites(TestRunner *runner) {
+    OrderKey *keys = malloc(sizeof(OrderKey) * (runner->suite_count + 1));
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        keys[i].index = i;
+        keys[i].key = INT_MAX;
+        for(int j = 0; j < suite->test_count; ++j) {
+            int run_order = suite->testcases[j]->run_order;
+            if(run_order < keys[i].key) keys[i].key = run_order;
+        }
+    }
+    qsort(keys, runner->suite_count, sizeof(OrderKey), &compare_keys);
+    int *order = malloc(sizeof(int) * (runner->suite_count + 1));
+    for(int i = 0; i < runner->suite_count; ++i) order[i] = keys[i].index;
+    free(keys);
+    return order;
+}
+
+int *order_cases(TestSuite *suite) {
+    OrderKey *keys = malloc(sizeof(OrderKey) * (suite->test_count + 1));
+    for(int i = 0; i < suite->test_count; ++i) {
+        keys[i].index = i;
+        keys[i].key = suite->testcases[i]->run_order;
+    }
+    qsort(keys, suite->test_count, sizeof(OrderKey), &compare_keys);
+    int *order = malloc(sizeof(int) * (suite->test_count + 1));
+    for(int i = 0; i < suite->test_count; ++i) order[i] = keys[i].index;
+    free(keys);
+    return order;
+}
+
+void order_case_done(TestCase *testcase) {
+    if(fail_fast && testcase->status == CUF_TC_FAIL) {
+        atomic_store(&stopped, true);
+    }
+}
+
+bool order_stopped(void) {
+    return atomic_load(&stopped);
+}
+
+bool order_skips_suite(const TestSuite *suite) {
+    if(!order_stopped()) return false;
+    for(int i = 0; i < suite->test_count; ++i) {
+        if(suite->testcases[i]->done) return false;
+    }
+    return suite->test_count > 0;
+}
+
+void order_report(TestRunner *runner) {
+    if(!order_stopped()) return;
+    int left = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            left += !c_case->done && c_case->status != CUF_TC_DESELECTED;
+        }
+    }
+    printf("\nStopped at the first failure, %d tests not run\n", left);
+}
+
+int order_save(TestRunner *runner) {
+    if(!runner->history_path) return 0;
+    int nentries = 0;
+    HistEntry *entries = load_history(runner->history_path, &nentries);
+    int total = 0;
+    OrderCase *cases = collect_cases(runner, &total);
+    match_history(cases, total, entries, nentries);
+
+    // write next to the old file and swap, so a crash can't leave half of it
+    size_t len = strlen(runner->history_path) + 5;
+    char *tmp_path = malloc(len);
+    snprintf(tmp_path, len, "%s.tmp", runner->history_path);
+    FILE *out = fopen(tmp_path, "w");
+    if(!out) {
+        free(tmp_path);
+        free(cases);
+        free_history(entries, nentries);
+        return -1;
+    }
+    fputs(CUF_HISTORY_HEADER, out);
+    // both sorted by name, so the lines come out sorted as well
+    int i = 0;
+    int k = 0;
+    while(i < total || k < nentries) {
+        if(k < nentries && (i == total ||
+                            compare_case_entry(&cases[i], &entries[k]) > 0)) {
+            // not part of this run, or not registered anymore
+            write_entry(out, &entries[k++]);
+            continue;
+        }
+        OrderCase *c_case = &cases[i++];
+        HistEntry fresh = {c_case->suite->name, c_case->testcase->test_name,
+                           c_case->occurrence, "", {0}};
+        HistEntry *entry = c_case->entry? c_case->entry : &fresh;
+        if(c_case->entry) ++k;
+        record_run(entry, c_case->testcase);
+        if(entry->outcomes[0]) write_entry(out, entry);
+    }
+    int ret = fclose(out)? -1 : rename(tmp_path, runner->history_path);
+    free(tmp_path);
+    free(cases);
+    free_history(entries, nentries);
+    return ret? -1 : 0;
+}
+
+
+static OrderCase *collect_cases(TestRunner *runner, int *count) {
+    *count = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        *count += runner->suites[i]->test_count;
+    }
+    OrderCase *cases = malloc(sizeof(OrderCase) * (*count + 1));
+    int order = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++order) {
+            OrderCase *c_case = &cases[order];
+            c_case->suite = suite;
+            c_case->testcase = suite->testcases[j];
+            c_case->order = order;
+            c_case->occurrence = 0;
+            c_case->entry = NULL;
+            c_case->rank = ORDER_NEW;
+            c_case->fail_age = 0;
+            c_case->cost = 0;
+        }
+    }
+    return cases;
+}
+
+static void match_history(OrderCase *cases, int count, HistEntry *entries,
+                          int nentries) {
+    // number the cases registered under the same name, then merge
+    qsort(cases, count, sizeof(OrderCase), &compare_named);
+    for(int i = 1; i < count; ++i) {
+        if(strcmp(cases[i - 1].suite->name, cases[i].suite->name) ||
+           strcmp(cases[i - 1].testcase->test_name,
+                  cases[i].testcase->test_name)) {
+            continue;
+        }
+        cases[i].occurrence = cases[i - 1].occurrence + 1;
+    }
+    int k = 0;
+    for(int i = 0; i < count; ++i) {
+        while(k < nentries && compare_case_entry(&cases[i], &entries[k]) > 0) {
+            ++k;
+        }
+        if(k < nentries && compare_case_entry(&cases[i], &entries[k]) == 0) {
+            cases[i].entry = &entries[k];
+        }
+    }
+}
+
+static HistEntry *load_history(const char *path, int *count) {
+    *count = 0;
+    FILE *in = fopen(path, "r");
+    // no file yet just means no history
+    if(!in) return NULL;
+    HistEntry *entries = NULL;
+    int size = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while(getline(&line, &cap, in) > 0) {
+        if(line[0] == '#') continue;
+        char *save = NULL;
+        char *suite = strtok_r(line, "\t", &save);
+        char *name = strtok_r(NULL, "\t", &save);
+        char *occurrence = strtok_r(NULL, "\t", &save);
+        char *outcomes = strtok_r(NULL, "\t", &save);
+        char *times = strtok_r(NULL, "\t\n", &save);
+        if(!suite || !name || !occurrence || !outcomes || !times) continue;
+        if(*count == size) {
+            size = size? size * 2 : 64;
+            entries = realloc(entries, sizeof(HistEntry) * size);
+        }
+        HistEntry *entry = &entries[*count];
+        // an older file may have kept more runs, the newest ones count
+        size_t runs = strlen(outcomes);
+        size_t drop = runs > CUF_HISTORY_RUNS? runs - CUF_HISTORY_RUNS : 0;
+        strcpy(entry->outcomes, outcomes + drop);
+        memset(entry->ns, 0, sizeof(entry->ns));
+        char *pos = times;
+        for(size_t k = 0; k < runs && *pos; ++k) {
+            uint64_t ns = strtoull(pos, &pos, 10);
+            if(k >= drop) entry->ns[k - drop] = ns;
+            if(*pos == ',') ++pos;
+        }
+        cuf_unescape(suite);
+        cuf_unescape(name);
+        entry->suite = strdup(suite);
+        entry->name = strdup(name);
+        entry->occurrence = atoi(occurrence);
+        ++(*count);
+    }
+    free(line);
+    fclose(in);
+    qsort(entries, *count, sizeof(HistEntry), &compare_entries);
+    return entries;
+}
+
+static void free_history(HistEntry *entries, int count) {
+    for(int i = 0; i < count; ++i) {
+        free(entries[i].suite);
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+static void record_run(HistEntry *entry, TestCase *testcase) {
+    // only what actually ran says anything about the next run
+    if(!testcase->done || testcase->cached) return;
+    if(testcase->status != CUF_TC_PASS && testcase->status != CUF_TC_FAIL) {
+        return;
+    }
+    size_t runs = strlen(entry->outcomes);
+    if(runs == CUF_HISTORY_RUNS) {
+        memmove(entry->outcomes, entry->outcomes + 1, runs);
+        memmove(entry->ns, entry->ns + 1, sizeof(uint64_t) * (runs - 1));
+        --runs;
+    }
+    CaseTimes *times = &testcase->times;
+    entry->outcomes[runs] = testcase->status == CUF_TC_FAIL? 'f' : 'p';
+    entry->outcomes[runs + 1] = '\0';
+    entry->ns[runs] = times->setup_ns + times->wall_ns + times->teardown_ns;
+}
+
+static void order_by_deps(TestRunner *runner, const int *priority) {
+    int nsuites = runner->suite_count;
+    int *base = malloc(sizeof(int) * (nsuites + 1));
+    int total = 0;
+    int nedges = 0;
+    // number the cases in registration order, to find the ones needed
+    for(int i = 0; i < nsuites; ++i) {
+        TestSuite *suite = runner->suites[i];
+        base[i] = total;
+        for(int j = 0; j < suite->test_count; ++j) {
+            Dependency *deps = suite->testcases[j]->deps;
+            suite->testcases[j]->run_order = total++;
+            nedges += deps? deps->need_count : 0;
+        }
+    }
+    int *suite_of = malloc(sizeof(int) * (total + 1));
+    int *suite_key = malloc(sizeof(int) * (nsuites + 1));
+    for(int i = 0; i < nsuites; ++i) {
+        // suites without cases go last
+        suite_key[i] = total + i;
+        for(int j = 0; j < runner->suites[i]->test_count; ++j) {
+            suite_of[base[i] + j] = i;
+            if(priority[base[i] + j] < suite_key[i]) {
+                suite_key[i] = priority[base[i] + j];
+            }
+        }
+    }
+    // suites by the suites their cases depend on, cases inside a suite by
+    // the cases of the same suite they depend on
+    OrderEdge *suite_edges = malloc(sizeof(OrderEdge) * (nedges + 1));
+    OrderEdge *case_edges = malloc(sizeof(OrderEdge) * (nedges + 1));
+    int nsuite_edges = 0;
+    int ncase_edges = 0;
+    for(int i = 0; i < total; ++i) {
+        TestSuite *suite = runner->suites[suite_of[i]];
+        Dependency *deps = suite->testcases[i - base[suite_of[i]]]->deps;
+        int needs = deps? deps->need_count : 0;
+        for(int k = 0; k < needs; ++k) {
+            int need = deps->needs[k].testcase->run_order;
+            OrderEdge edge = {need, i};
+            if(suite_of[need] == suite_of[i]) {
+                case_edges[ncase_edges++] = edge;
+            } else {
+                edge.from = suite_of[need];
+                edge.to = suite_of[i];
+                suite_edges[nsuite_edges++] = edge;
+            }
+        }
+    }
+    int *suite_order = malloc(sizeof(int) * (nsuites + 1));
+    order_topo(nsuites, suite_key, suite_edges, nsuite_edges, suite_order);
+
+    // the edges of each suite's cases, relative to its first case
+    qsort(case_edges, ncase_edges, sizeof(OrderEdge), &compare_edges);
+    int *edge_start = malloc(sizeof(int) * (nsuites + 1));
+    for(int i = 0, e = 0; i <= nsuites; ++i) {
+        while(e < ncase_edges && suite_of[case_edges[e].from] < i) ++e;
+        edge_start[i] = e;
+    }
+    for(int e = 0; e < ncase_edges; ++e) {
+        int first = base[suite_of[case_edges[e].to]];
+        case_edges[e].from -= first;
+        case_edges[e].to -= first;
+    }
+    int *run_order = malloc(sizeof(int) * (total + 1));
+    int *case_order = malloc(sizeof(int) * (total + 1));
+    int next = 0;
+    for(int k = 0; k < nsuites; ++k) {
+        int i = suite_order[k];
+        int count = runner->suites[i]->test_count;
+        order_topo(count, priority + base[i], case_edges + edge_start[i],
+                   edge_start[i + 1] - edge_start[i], case_order);
+        for(int j = 0; j < count; ++j) {
+            run_order[base[i] + case_order[j]] = next++;
+        }
+    }
+    for(int i = 0; i < total; ++i) {
+        TestSuite *suite = runner->suites[suite_of[i]];
+        suite->testcases[i - base[suite_of[i]]]->run_order = run_order[i];
+    }
+    free(case_order);
+    free(run_order);
+    free(edge_start);
+    free(suite_order);
+    free(case_edges);
+    free(suite_edges);
+    free(suite_key);
+    free(suite_of);
+    free(base);
+}
+
+static void order_topo(int count, const int *key, OrderEdge *edges,
+                       int nedges, int *out) {
+    // the edges leaving each item are contiguous once sorted
+    qsort(edges, nedges, sizeof(OrderEdge), &compare_edges);
+    int *start = calloc(count + 1, sizeof(int));
+    int *waiting = calloc(count + 1, sizeof(int));
+    bool *placed = calloc(count + 1, sizeof(bool));
+    int *heap = malloc(sizeof(int) * (count + 1));
+    for(int e = 0; e < nedges; ++e) {
+        ++start[edges[e].from + 1];
+        ++waiting[edges[e].to];
+    }
+    for(int i = 0; i < count; ++i) start[i + 1] += start[i];
+    int size = 0;
+    for(int i = 0; i < count; ++i) {
+        if(!waiting[i]) heap_push(heap, &size, key, i);
+    }
+    int done = 0;
+    int scan = 0;
+    while(done < count) {
+        int item;
+        if(size > 0) {
+            item = heap_pop(heap, &size, key);
+        } else {
+            // only a cycle is left waiting
+            while(placed[scan]) ++scan;
+            item = scan;
+        }
+        // taken out of a cycle before its dependencies were all placed
+        if(placed[item]) continue;
+        placed[item] = true;
+        out[done++] = item;
+        for(int e = start[item]; e < start[item + 1]; ++e) {
+            int to = edges[e].to;
+            if(--waiting[to] == 0 && !placed[to]) {
+                heap_push(heap, &size, key, to);
+            }
+        }
+    }
+    free(heap);
+    free(placed);
+    free(waiting);
+    free(start);
+}
+
+static void heap_push(int *heap, int *size, const int *key, int item) {
+    int pos = (*size)++;
+    while(pos > 0 && key[heap[(pos - 1) / 2]] > key[item]) {
+        heap[pos] = heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    heap[pos] = item;
+}
+
+static int heap_pop(int *heap, int *size, const int *key) {
+    int top = heap[0];
+    int item = heap[--(*size)];
+    int pos = 0;
+    while(2 * pos + 1 < *size) {
+        int child = 2 * pos + 1;
+        if(child + 1 < *size && key[heap[child + 1]] < key[heap[child]]) {
+            ++child;
+        }
+        if(key[heap[child]] >= key[item]) break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = item;
+    return top;
+}
+
+static void write_entry(FILE *out, const HistEntry *entry) {
+    cuf_write_escaped(out, entry->suite);
+    fputc('\t', out);
+    cuf_write_escaped(out, entry->name);
+    fprintf(out, "\t%d\t%s\t", entry->occurrence, entry->outcomes);
+    int runs = (int) strlen(entry->outcomes);
+    for(int k = 0; k < runs; ++k) {
+        fprintf(out, "%s%llu", k? "," : "",
+                (unsigned long long) entry->ns[k]);
+    }
+    fputc('\n', out);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const HistEntry *entry_a = a;
+    const HistEntry *entry_b = b;
+    int diff = strcmp(entry_a->suite, entry_b->suite);
+    if(diff) return diff;
+    diff = strcmp(entry_a->name, entry_b->name);
+    if(diff) return diff;
+    return (entry_a->occurrence > entry_b->occurrence) -
+           (entry_a->occurrence < entry_b->occurrence);
+}
+
+static int compare_named(const void *a, const void *b) {
+    const OrderCase *case_a = a;
+    const OrderCase *case_b = b;
+    int diff = strcmp(case_a->suite->name, case_b->suite->name);
+    if(diff) return diff;
+    diff = strcmp(case_a->testcase->test_name, case_b->testcase->test_name);
+    if(diff) return diff;
+    return (case_a->order > case_b->order) - (case_a->order < case_b->order);
+}
+
+static int compare_case_entry(const OrderCase *c_case,
+                              const HistEntry *entry) {
+    int diff = strcmp(c_case->suite->name, entry->suite);
+    if(diff) return diff;
+    diff = strcmp(c_case->testcase->test_name, entry->name);
+    if(diff) return diff;
+    return (c_case->occurrence > entry->occurrence) -
+           (c_case->occurrence < entry->occurrence);
+}
+
+static int compare_run(const void *a, const void *b) {
+    const OrderCase *case_a = a;
+    const OrderCase *case_b = b;
+    if(case_a->rank != case_b->rank) return case_a->rank - case_b->rank;
+    // the most recent failure first, then the cheapest case
+    if(case_a->fail_age != case_b->fail_age) {
+        return case_a->fail_age - case_b->fail_age;
+    }
+    if(case_a->cost != case_b->cost) {
+        return case_a->cost > case_b->cost? 1 : -1;
+    }
+    return (case_a->order > case_b->order) - (case_a->order < case_b->order);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    const OrderKey *key_a = a;
+    const OrderKey *key_b = b;
+    if(key_a->key != key_b->key) return key_a->key > key_b->key? 1 : -1;
+    return (key_a->index > key_b->index) - (key_a->index < key_b->index);
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const OrderEdge *edge_a = a;
+    const OrderEdge *edge_b = b;
+    if(edge_a->from != edge_b->from) return edge_a->from - edge_b->from;
+    return edge_a->to - edge_b->to;
+}
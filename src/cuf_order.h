@@ -0,0 +1,134 @@
+/**
+ * @file cuf_order.h
+ * @brief CUnitFramework (CUF): Fail-fast Ordering Interface
+ * @details Getting to the first failure sooner. With a history file set, the
+ * runner keeps the outcome and duration of the last `CUF_HISTORY_RUNS` runs
+ * of every testcase, and runs the cases that failed in one of them first,
+ * the most recent failure first, then cases it has no history of, then the
+ * rest, cheapest first. Ties keep registration order, so the same history
+ * file always gives the same order.
+ *
+ * The runners that schedule single testcases (`testrunner_run_stealing()`,
+ * `testrunner_run_graph()` and `testrunner_run_isolated()`) follow that
+ * order across suites, as far as dependencies between cases allow. The
+ * serial and the suite level parallel runner keep each suite together: they
+ * order the cases inside a suite, and the suites by their first case.
+ *
+ * The history never puts a testcase before one it depends on. When cases
+ * depend on each other, suites run after the suites their cases depend on
+ * and cases after the cases of their suite they depend on; the history only
+ * decides among those that are free to go, so a failed case still runs as
+ * early as its dependencies let it.
+ *
+ * With fail-fast on, no testcase is started after the first one fails.
+ * Cases already running are let finish, and the report covers what ran,
+ * followed by the number of cases left out.
+ *
+ * The history file is a text file with one line per testcase and tab
+ * separated fields: suite name, case name, how many cases of that name were
+ * registered before it, outcomes (`p` or `f`, oldest first) and the
+ * nanoseconds each of those runs took, comma separated. Names are escaped
+ * like in a results file (see cuf_shard.h). Only passes and failures that
+ * actually ran are recorded; cases that weren't run keep their lines.
+ */
+#ifndef __CUF_ORDER_H__
+#define __CUF_ORDER_H__
+
+#include <stdbool.h>
+
+#include "cuf.h"
+
+// first line of a history file, the number is the format version
+#define CUF_HISTORY_HEADER "# cuf history 1\n"
+// number of runs of each testcase a history file remembers
+#define CUF_HISTORY_RUNS 8
+
+
+/**
+ * Keep the history of every testcase in a file and order the runs by it. The
+ * file is read when the run starts and written when the report is printed;
+ * if it doesn't exist yet, the cases run in registration order.
+ *
+ * @param runner testrunner to configure
+ * @param path history file, NULL to keep no history
+ */
+void testrunner_set_history_file(TestRunner *runner, const char *path);
+/**
+ * Stop starting testcases once one has failed, see the file description.
+ *
+ * @param runner testrunner to configure
+ * @param fail_fast true to stop at the first failure
+ */
+void testrunner_set_fail_fast(TestRunner *runner, bool fail_fast);
+/**
+ * Start the fail-fast state of a run over and number its testcases, see
+ * `order_number()`. Internal use function.
+ *
+ * @param runner testrunner about to be run
+ */
+void order_prepare(TestRunner *runner);
+/**
+ * Read the history file and number the testcases of a run in the order they
+ * should run in, see `TestCase.run_order`: dependencies first, then by the
+ * history. Needs the dependencies resolved (see `dependency_resolve()`).
+ * Internal use function.
+ *
+ * @param runner testrunner about to be run
+ */
+void order_number(TestRunner *runner);
+/**
+ * Get the suites of a runner in the order they should run in. Internal use
+ * function.
+ *
+ * @param runner testrunner being run
+ * @return suite indices, to be freed by the caller
+ */
+int *order_suites(TestRunner *runner);
+/**
+ * Get the testcases of a suite in the order they should run in. Internal use
+ * function.
+ *
+ * @param suite suite being run
+ * @return testcase indices, to be freed by the caller
+ */
+int *order_cases(TestSuite *suite);
+/**
+ * Note that a testcase finished, which stops the run if it failed and
+ * fail-fast is on. Internal use function, safe to call from multiple
+ * threads.
+ *
+ * @param testcase testcase that finished
+ */
+void order_case_done(TestCase *testcase);
+/**
+ * Whether fail-fast has stopped the run. Internal use function, safe to call
+ * from multiple threads.
+ *
+ * @return true if no more testcases should be started
+ */
+bool order_stopped(void);
+/**
+ * Whether a suite should be left out of the progress lines because the run
+ * stopped before any of its testcases ran. Internal use function.
+ *
+ * @param suite suite to check
+ * @return true if the suite never got to run
+ */
+bool order_skips_suite(const TestSuite *suite);
+/**
+ * Print how many testcases fail-fast left out, if it stopped the run.
+ * Internal use function.
+ *
+ * @param runner testrunner that has finished running
+ */
+void order_report(TestRunner *runner);
+/**
+ * Add the outcomes of a run to the history file, if one is set. Internal use
+ * function.
+ *
+ * @param runner testrunner that has finished running
+ * @return 0 on success or without a history file, -1 if writing failed
+ */
+int order_save(TestRunner *runner);
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * @file cuf_perf.c
+ * @brief CUnitFramework (CUF): Performance Counters Implementation
+ * @details Counter groups are opened per testcase rather than kept open per
+ * thread, so nothing leaks from the thread pool runners' workers and a forked
+ * isolated worker never inherits counters it didn't open. Each group is read
+ * in one go with `PERF_FORMAT_GROUP`, and counts are scaled up if the kernel
+ * had to multiplex the group with other users of the PMU.
+ */
+// syscall() needs _GNU_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cuf_alloc.h"
+#include "cuf_perf.h"
+#include "cuf_value.h"
+
+
+/**
+ * how to open one of the `cuf_perf_events`
+ */
+typedef struct {
+    const char *name;      /**< name shown in reports */
+    bool hardware;         /**< counted on the PMU, in the hardware group */
+    uint32_t type;         /**< perf_event_attr type */
+    uint64_t config;       /**< perf_event_attr config */
+} PerfEvent;
+
+#ifdef __linux__
+static const PerfEvent events[CUF_PERF_EVENTS] = {
+    {"instructions", true, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cycles", true, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"branch-misses", true, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"cache-misses", true, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"page-faults", false, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", false, PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CONTEXT_SWITCHES}
+};
+#else
+static const PerfEvent events[CUF_PERF_EVENTS] = {
+    {"instructions", true, 0, 0}, {"cycles", true, 0, 0},
+    {"branch-misses", true, 0, 0}, {"cache-misses", true, 0, 0},
+    {"page-faults", false, 0, 0}, {"context-switches", false, 0, 0}
+};
+#endif
+
+static int open_group(PerfGroup *group, bool hardware);
+static void read_group(PerfGroup *group, int leader, bool hardware,
+                       PerfCounts *counts);
+static void close_group(PerfGroup *group);
+
+static bool enabled = false;
+// counters of the testcase the calling thread is running, if any
+static _Thread_local PerfGroup *active_group = NULL;
+
+
+void perf_enable(bool enable) {
+    enabled = enable;
+}
+
+const char *perf_event_name(int event) {
+    if(event < 0 || event >= CUF_PERF_EVENTS) return "unknown";
+    return events[event].name;
+}
+
+bool perf_start(PerfGroup *group) {
+    group->hw_fd = -1;
+    group->sw_fd = -1;
+    for(int i = 0; i < CUF_PERF_EVENTS; ++i) group->fds[i] = -1;
+    if(!enabled) return false;
+    group->hw_fd = open_group(group, true);
+    group->sw_fd = open_group(group, false);
+    if(group->hw_fd < 0 && group->sw_fd < 0) return false;
+#ifdef __linux__
+    // start both groups as close to the call as possible
+    if(group->hw_fd >= 0) {
+        ioctl(group->hw_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group->hw_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if(group->sw_fd >= 0) {
+        ioctl(group->sw_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group->sw_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    active_group = group;
+    return true;
+}
+
+void perf_stop(PerfGroup *group, TestCase *testcase) {
+#ifdef __linux__
+    if(group->hw_fd >= 0) {
+        ioctl(group->hw_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if(group->sw_fd >= 0) {
+        ioctl(group->sw_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    active_group = NULL;
+    alloc_pause();
+    if(!testcase->perf) testcase->perf = malloc(sizeof(PerfCounts));
+    alloc_resume();
+    memset(testcase->perf, 0, sizeof(PerfCounts));
+    read_group(group, group->hw_fd, true, testcase->perf);
+    read_group(group, group->sw_fd, false, testcase->perf);
+    close_group(group);
+}
+
+int perf_assert_below(TestSuite *suite, const char *file, int line,
+                      const char *expr, int event, uint64_t limit) {
+    if(!active_group || event < 0 || event >= CUF_PERF_EVENTS) return 0;
+    PerfCounts counts;
+    memset(&counts, 0, sizeof(counts));
+    // groups keep counting while being read
+    read_group(active_group, active_group->hw_fd, true, &counts);
+    read_group(active_group, active_group->sw_fd, false, &counts);
+    if(!(counts.valid & (1u << event))) return 0;
+    if(counts.values[event] < limit) return 0;
+    testsuite_record_values(suite, file, line, "Assertion failure: `%s` "
+                            "count should be BELOW `%s`", events[event].name,
+                            expr, value_from_u64(counts.values[event]),
+                            value_from_u64(limit));
+    return 1;
+}
+
+void perf_report(TestRunner *runner) {
+    bool first = true;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            PerfCounts *counts = c_case->perf;
+            if(!counts || c_case->status == CUF_TC_SKIP) continue;
+            if(first) {
+                printf("\n-----------PERF COUNTERS:-----------\n");
+                first = false;
+            }
+            printf("\nIn suite: %s, testcase: %s\n   ", suite->name,
+                   c_case->test_name);
+            if(!counts->valid) printf(" no counters available");
+            for(int k = 0; k < CUF_PERF_EVENTS; ++k) {
+                if(!(counts->valid & (1u << k))) continue;
+                printf(" %s %llu", events[k].name,
+                       (unsigned long long) counts->values[k]);
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+#ifdef __linux__
+static int open_group(PerfGroup *group, bool hardware) {
+    int leader = -1;
+    for(int i = 0; i < CUF_PERF_EVENTS; ++i) {
+        if(events[i].hardware != hardware) continue;
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = (leader < 0);
+        attr.exclude_hv = 1;
+        // user space only: it is all a paranoid kernel allows, and it is
+        // what the code under test controls
+        attr.exclude_kernel = hardware;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader,
+                         PERF_FLAG_FD_CLOEXEC);
+        if(fd < 0 && !hardware) {
+            attr.exclude_kernel = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader,
+                         PERF_FLAG_FD_CLOEXEC);
+        }
+        // a missing member is just left out, a missing leader loses the group
+        if(fd < 0) {
+            if(leader < 0) return -1;
+            continue;
+        }
+        if(leader < 0) leader = fd;
+        group->fds[i] = fd;
+    }
+    return leader;
+}
+
+static void read_group(PerfGroup *group, int leader, bool hardware,
+                       PerfCounts *counts) {
+    if(leader < 0) return;
+    // nr, time enabled, time running, then a value per member
+    uint64_t buf[3 + CUF_PERF_EVENTS];
+    ssize_t len = read(leader, buf, sizeof(buf));
+    if(len < (ssize_t) (3 * sizeof(uint64_t))) return;
+    uint64_t nr = buf[0];
+    double scale = 1;
+    if(buf[2] == 0) return;
+    if(buf[2] < buf[1]) scale = (double) buf[1] / buf[2];
+    // members are read back in the order they joined the group
+    uint64_t k = 0;
+    for(int i = 0; i < CUF_PERF_EVENTS && k < nr; ++i) {
+        if(events[i].hardware != hardware || group->fds[i] < 0) continue;
+        counts->values[i] = (uint64_t) (buf[3 + k] * scale);
+        counts->valid |= 1u << i;
+        ++k;
+    }
+}
+
+static void close_group(PerfGroup *group) {
+    for(int i = 0; i < CUF_PERF_EVENTS; ++i) {
+        if(group->fds[i] >= 0) close(group->fds[i]);
+        group->fds[i] = -1;
+    }
+    group->hw_fd = -1;
+    group->sw_fd = -1;
+}
+#else
+static int open_group(PerfGroup *group, bool hardware) {
+    (void) group;
+    (void) hardware;
+    return -1;
+}
+
+static void read_group(PerfGroup *group, int leader, bool hardware,
+                       PerfCounts *counts) {
+    (void) group;
+    (void) leader;
+    (void) hardware;
+    (void) counts;
+}
+
+static void close_group(PerfGroup *group) {
+    (void) group;
+}
+#endif
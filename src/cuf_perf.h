@@ -0,0 +1,131 @@
+/**
+ * @file cuf_perf.h
+ * @brief CUnitFramework (CUF): Performance Counters Interface
+ * @details Opt-in hardware and software event counters around each testcase,
+ * read through Linux's `perf_event_open()`. Once enabled with
+ * `perf_enable()`, every test function call is counted with two counter
+ * groups: instructions, cycles, branch misses and cache misses on the cpu's
+ * PMU, and page faults and context switches from the kernel. Counters only
+ * cover the thread running the case, and only user space for the hardware
+ * events, so the counts are far more repeatable than wall time. Where the
+ * hardware counters can't be opened (no PMU in a VM, or a restrictive
+ * `perf_event_paranoid`) only the software events are counted.
+ *
+ * The counts show up in a PERF COUNTERS section of the report and in the
+ * timings export, and can be asserted on from inside the testcase.
+ */
+#ifndef __CUF_PERF_H__
+#define __CUF_PERF_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cuf.h"
+
+
+/**
+ * Assert that the test function has retired fewer than `n` user space
+ * instructions so far. Does nothing where the instruction counter isn't
+ * available, so a case can gate on it without breaking runs on machines
+ * without a PMU.
+ *
+ * @param n exclusive upper limit on the instruction count
+ */
+#define ASSERT_INSTRUCTIONS_BELOW(n)\
+            ASSERT_PERF_BELOW(CUF_PERF_INSTRUCTIONS, n)
+/**
+ * Assert that an event counter of the running testcase is below a limit. See
+ * `ASSERT_INSTRUCTIONS_BELOW()` for unavailable counters.
+ *
+ * @param event one of the `cuf_perf_events`
+ * @param n exclusive upper limit on the count
+ */
+#define ASSERT_PERF_BELOW(event, n) do {\
+    perf_assert_below(suite, __FILE__, __LINE__, #n, (event), (n));\
+} while (0)
+
+
+/**
+ * events counted for each testcase
+ */
+enum cuf_perf_events {
+    CUF_PERF_INSTRUCTIONS,     /**< retired instructions, user space */
+    CUF_PERF_CYCLES,           /**< cpu cycles, user space */
+    CUF_PERF_BRANCH_MISSES,    /**< mispredicted branches, user space */
+    CUF_PERF_CACHE_MISSES,     /**< last level cache misses, user space */
+    CUF_PERF_PAGE_FAULTS,      /**< page faults */
+    CUF_PERF_CONTEXT_SWITCHES, /**< context switches */
+    CUF_PERF_EVENTS            /**< number of events, not an event */
+};
+
+/**
+ * Counter values of a testcase.
+ */
+struct perf_counts_t {
+    uint64_t values[CUF_PERF_EVENTS]; /**< count per `cuf_perf_events` */
+    unsigned valid;        /**< bit per event that could be counted */
+};
+
+/**
+ * Open counter groups of a running testcase. Internal use.
+ */
+typedef struct {
+    int hw_fd;             /**< leader of the hardware group, -1 if none */
+    int sw_fd;             /**< leader of the software group, -1 if none */
+    int fds[CUF_PERF_EVENTS]; /**< fd per event, -1 if not opened */
+} PerfGroup;
+
+
+/**
+ * Turn counting on or off for the testcases run from now on. Counting costs
+ * a handful of system calls per testcase.
+ *
+ * @param enable whether to count
+ */
+void perf_enable(bool enable);
+/**
+ * Get the name of an event, e.g. "instructions".
+ *
+ * @param event one of the `cuf_perf_events`
+ * @return static name of the event
+ */
+const char *perf_event_name(int event);
+/**
+ * Open and start the counters for a testcase about to be called on this
+ * thread, if counting is enabled. Internal use function.
+ *
+ * @param group out counter groups to start
+ * @return true if anything is being counted
+ */
+bool perf_start(PerfGroup *group);
+/**
+ * Stop and close the counters started by `perf_start()` and store their
+ * counts in the testcase's `perf`. Internal use function.
+ *
+ * @param group counter groups to stop
+ * @param testcase testcase to store the counts to
+ */
+void perf_stop(PerfGroup *group, TestCase *testcase);
+/**
+ * Check a counter of the testcase running on this thread against a limit and
+ * record a failure if it isn't below. Internal use function.
+ *
+ * @param suite test suite object to record the failure to
+ * @param file source file of the assertion
+ * @param line source line of the assertion
+ * @param expr static source text of the limit
+ * @param event one of the `cuf_perf_events`
+ * @param limit exclusive upper limit for the count
+ * @return 0 if the count is below the limit or unavailable, 1 otherwise
+ */
+int perf_assert_below(TestSuite *suite, const char *file, int line,
+                      const char *expr, int event, uint64_t limit);
+/**
+ * Print the PERF COUNTERS section of a report, if any testcase was counted.
+ * Internal use function.
+ *
+ * @param runner testrunner to report on
+ */
+void perf_report(TestRunner *runner);
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ * @file cuf_prof.c
+ * @brief CUnitFramework (CUF): Testcase Timing Implementation
+ * @details Suite totals, the slowest testcases list, memory tracking and the
+ * JSON export.
+ *
+ * A testcase's memory is the growth of the process's peak RSS (VmHWM) from
+ * before its setup to after its teardown. The peak is reset to the current
+ * RSS before each case through /proc/self/clear_refs, so a case that
+ * allocates and frees a large buffer still shows up; where that isn't
+ * supported only growth past the earlier peak of the process is seen. Runs
+ * sharing the process between cases skip both, since resetting the peak
+ * would also wipe the measurements of the cases running alongside.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cuf_alloc.h"
+#include "cuf_perf.h"
+#include "cuf_prof.h"
+#include "cuf_util.h"
+
+
+/**
+ * a testcase along with the suite it belongs to
+ */
+typedef struct {
+    TestSuite *suite;      /**< suite of the testcase */
+    TestCase *testcase;    /**< the testcase */
+} SuiteCase;
+
+static void memory_report(TestRunner *runner);
+static uint64_t case_total_ns(const TestCase *testcase);
+static int compare_slowest(const void *a, const void *b);
+static void json_string(FILE *out, const char *str);
+static void json_times(FILE *out, const CaseTimes *times);
+static void json_perf(FILE *out, const PerfCounts *counts);
+static void json_alloc(FILE *out, const AllocStats *stats);
+static const char *status_name(int status);
+
+// whether testcases run side by side in this process
+static bool process_shared = false;
+
+
+void prof_set_shared(bool shared) {
+    process_shared = shared;
+}
+
+uint64_t prof_rss_begin(void) {
+    if(process_shared) return 0;
+    if(cuf_rss_reset_peak()) return cuf_rss_bytes(false);
+    return cuf_rss_bytes(true);
+}
+
+void prof_rss_end(TestSuite *suite, TestCase *testcase, uint64_t base) {
+    if(process_shared) return;
+    uint64_t peak = cuf_rss_bytes(true);
+    testcase->peak_rss = peak > base? peak - base : 0;
+    if(!suite->mem_budget || testcase->peak_rss <= suite->mem_budget) return;
+    char used[32], budget[32], msg[CUF_BUF_SIZE];
+    cuf_format_bytes(used, sizeof(used), testcase->peak_rss);
+    cuf_format_bytes(budget, sizeof(budget), suite->mem_budget);
+    snprintf(msg, CUF_BUF_SIZE, "Memory: testcase grew peak RSS by %s, over "
+             "the suite budget of %s\nIn TestCase: %s", used, budget,
+             testcase->test_name);
+    testcase_record_fail(testcase, msg);
+}
+
+void testsuite_sum_times(TestSuite *suite) {
+    CaseTimes *sum = &suite->times;
+    sum->wall_ns = sum->user_ns = sum->sys_ns = 0;
+    sum->setup_ns = sum->teardown_ns = 0;
+    suite->peak_rss = 0;
+    for(int i = 0; i < suite->test_count; ++i) {
+        if(suite->testcases[i]->peak_rss > suite->peak_rss) {
+            suite->peak_rss = suite->testcases[i]->peak_rss;
+        }
+        CaseTimes *times = &suite->testcases[i]->times;
+        sum->wall_ns += times->wall_ns;
+        sum->user_ns += times->user_ns;
+        sum->sys_ns += times->sys_ns;
+        sum->setup_ns += times->setup_ns;
+        sum->teardown_ns += times->teardown_ns;
+    }
+}
+
+void prof_report(TestRunner *runner) {
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        testsuite_sum_times(runner->suites[i]);
+        total += runner->suites[i]->test_count;
+    }
+    memory_report(runner);
+    if(runner->slowest <= 0 || total == 0) return;
+    SuiteCase *cases = malloc(sizeof(SuiteCase) * total);
+    int count = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            int status = suite->testcases[j]->status;
+            if(status == CUF_TC_SKIP || status == CUF_TC_DESELECTED) continue;
+            // left out by fail-fast, there is no time to speak of
+            if(!suite->testcases[j]->done) continue;
+            cases[count].suite = suite;
+            cases[count].testcase = suite->testcases[j];
+            ++count;
+        }
+    }
+    qsort(cases, count, sizeof(SuiteCase), &compare_slowest);
+    if(count > runner->slowest) count = runner->slowest;
+    if(count > 0) printf("\n-----------SLOWEST TESTS:-----------\n");
+    for(int i = 0; i < count; ++i) {
+        TestCase *c_case = cases[i].testcase;
+        char total_s[32], wall[32], user[32], sys[32], setup[32], down[32];
+        cuf_format_ns(total_s, sizeof(total_s), case_total_ns(c_case));
+        cuf_format_ns(wall, sizeof(wall), c_case->times.wall_ns);
+        cuf_format_ns(user, sizeof(user), c_case->times.user_ns);
+        cuf_format_ns(sys, sizeof(sys), c_case->times.sys_ns);
+        cuf_format_ns(setup, sizeof(setup), c_case->times.setup_ns);
+        cuf_format_ns(down, sizeof(down), c_case->times.teardown_ns);
+        printf("\nIn suite: %s, testcase: %s\n    %s total: test %s (user %s, "
+               "sys %s), setup %s, teardown %s\n", cases[i].suite->name,
+               c_case->test_name, total_s, wall, user, sys, setup, down);
+    }
+    free(cases);
+}
+
+int prof_write_json(TestRunner *runner, const char *path) {
+    FILE *out = fopen(path, "w");
+    if(!out) return -1;
+    fprintf(out, "{\"suites\": [");
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        testsuite_sum_times(suite);
+        fprintf(out, "%s\n  {\"name\": ", i? "," : "");
+        json_string(out, suite->name);
+        fprintf(out, ", \"passed\": %d, \"failed\": %d, \"skipped\": %d, ",
+                suite->passed, suite->failed, suite->skipped);
+        json_times(out, &suite->times);
+        fprintf(out, ", \"peak_rss\": %llu,\n   \"cases\": [",
+                (unsigned long long) suite->peak_rss);
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            fprintf(out, "%s\n    {\"name\": ", j? "," : "");
+            json_string(out, c_case->test_name);
+            fprintf(out, ", \"status\": \"%s\", ", status_name(c_case->status));
+            json_times(out, &c_case->times);
+            fprintf(out, ", \"peak_rss\": %llu",
+                    (unsigned long long) c_case->peak_rss);
+            if(c_case->perf) json_perf(out, c_case->perf);
+            if(c_case->alloc) json_alloc(out, c_case->alloc);
+            fprintf(out, "}");
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out)? -1 : 0;
+}
+
+
+static void memory_report(TestRunner *runner) {
+    bool first = true;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        if(!suite->peak_rss) continue;
+        TestCase *top = NULL;
+        for(int j = 0; j < suite->test_count; ++j) {
+            if(suite->testcases[j]->peak_rss == suite->peak_rss) {
+                top = suite->testcases[j];
+                break;
+            }
+        }
+        if(first) {
+            printf("\n-----------MEMORY:-----------\n");
+            first = false;
+        }
+        char peak[32], budget[32];
+        cuf_format_bytes(peak, sizeof(peak), suite->peak_rss);
+        printf("\nIn suite: %s, testcase: %s\n    peak RSS grew by %s",
+               suite->name, top->test_name, peak);
+        if(suite->mem_budget) {
+            cuf_format_bytes(budget, sizeof(budget), suite->mem_budget);
+            printf(", budget %s", budget);
+        }
+        printf("\n");
+    }
+    // only zygote suites measure their cases when the process is shared
+    for(int i = 0; i < runner->suite_count && process_shared; ++i) {
+        TestSuite *suite = runner->suites[i];
+        if(!suite->mem_budget || suite->flags & CUF_SUITE_ZYGOTE) continue;
+        printf("\nMemory budgets are not checked when testcases run side by "
+               "side on threads\n");
+        break;
+    }
+}
+
+static uint64_t case_total_ns(const TestCase *testcase) {
+    return testcase->times.setup_ns + testcase->times.wall_ns +
+           testcase->times.teardown_ns;
+}
+
+static int compare_slowest(const void *a, const void *b) {
+    uint64_t x = case_total_ns(((const SuiteCase *) a)->testcase);
+    uint64_t y = case_total_ns(((const SuiteCase *) b)->testcase);
+    // slowest first
+    return (x < y) - (x > y);
+}
+
+static void json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for(; *str; ++str) {
+        unsigned char c = *str;
+        if(c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void json_times(FILE *out, const CaseTimes *times) {
+    fprintf(out, "\"wall_ns\": %llu, \"user_ns\": %llu, \"sys_ns\": %llu, "
+            "\"setup_ns\": %llu, \"teardown_ns\": %llu",
+            (unsigned long long) times->wall_ns,
+            (unsigned long long) times->user_ns,
+            (unsigned long long) times->sys_ns,
+            (unsigned long long) times->setup_ns,
+            (unsigned long long) times->teardown_ns);
+}
+
+static void json_perf(FILE *out, const PerfCounts *counts) {
+    fprintf(out, ", \"perf\": {");
+    bool first = true;
+    for(int i = 0; i < CUF_PERF_EVENTS; ++i) {
+        if(!(counts->valid & (1u << i))) continue;
+        fprintf(out, "%s\"%s\": %llu", first? "" : ", ", perf_event_name(i),
+                (unsigned long long) counts->values[i]);
+        first = false;
+    }
+    fprintf(out, "}");
+}
+
+static void json_alloc(FILE *out, const AllocStats *stats) {
+    fprintf(out, ", \"alloc\": {\"allocs\": %llu, \"frees\": %llu, "
+            "\"bytes\": %llu, \"peak\": %llu, \"leaked\": %lld, "
+            "\"leaked_blocks\": %lld}", (unsigned long long) stats->allocs,
+            (unsigned long long) stats->frees,
+            (unsigned long long) stats->bytes,
+            (unsigned long long) stats->peak,
+            (long long) (stats->live > 0? stats->live : 0),
+            (long long) (stats->blocks > 0? stats->blocks : 0));
+}
+
+static const char *status_name(int status) {
+    switch(status) {
+        case CUF_TC_PASS:
+            return "pass";
+        case CUF_TC_FAIL:
+            return "fail";
+        case CUF_TC_DESELECTED:
+            return "deselected";
+        default:
+            return "skip";
+    }
+}
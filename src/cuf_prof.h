@@ -0,0 +1,91 @@
+/**
+ * @file cuf_prof.h
+ * @brief CUnitFramework (CUF): Testcase Timing Interface
+ * @details Reporting on where the time of a run went. Every testcase records
+ * the wall time of its setup, test function and teardown, and the user and
+ * system cpu time of its test function (see `CaseTimes`); this turns those
+ * into per-suite totals, the SLOWEST TESTS section of the report, and a JSON
+ * export for tracking timings across runs or rebalancing suites.
+ *
+ * Memory is tracked alongside: each testcase records how much it grew the
+ * peak RSS of its process, which feeds the MEMORY section of the report and
+ * the suite memory budgets (see `testsuite_set_mem_budget()`). The peak RSS
+ * belongs to the whole process, so this is only done where a case has its
+ * process to itself: in `testrunner_run()`, in the workers of the isolated
+ * runners and in zygote children. The thread pool runners leave `peak_rss`
+ * at 0 and don't check budgets, as the figure would be that of every case
+ * running at the time.
+ */
+#ifndef __CUF_PROF_H__
+#define __CUF_PROF_H__
+
+#include <stdbool.h>
+
+#include "cuf.h"
+
+
+/**
+ * Tell the memory tracking whether testcases share the process with others
+ * running at the same time, see the file description. Internal use
+ * function; every run starts out unshared.
+ *
+ * @param shared true while testcases run side by side on threads
+ */
+void prof_set_shared(bool shared);
+/**
+ * Start measuring the memory of a testcase about to be set up. Internal use
+ * function.
+ *
+ * @return baseline to pass to `prof_rss_end()`
+ */
+uint64_t prof_rss_begin(void);
+/**
+ * Store how much the peak RSS grew since `prof_rss_begin()` in the
+ * testcase's `peak_rss`, and fail the case if that is over the suite's
+ * memory budget. Does nothing while the process is shared. Internal use
+ * function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase that was measured
+ * @param base baseline returned by `prof_rss_begin()`
+ */
+void prof_rss_end(TestSuite *suite, TestCase *testcase, uint64_t base);
+/**
+ * Sum the timings of a suite's testcases into the suite's `times`, and find
+ * the largest `peak_rss` among them. Internal use function.
+ *
+ * @param suite suite to sum up
+ */
+void testsuite_sum_times(TestSuite *suite);
+/**
+ * Print the SLOWEST TESTS section of a report, listing the testcases that
+ * took the longest from setup to teardown, and the MEMORY section, listing
+ * the testcase of each suite that grew the peak RSS the most. Sums up the
+ * suite timings first. Internal use function.
+ *
+ * @param runner testrunner to report on
+ */
+void prof_report(TestRunner *runner);
+/**
+ * Write the timings of every suite and testcase of a run to a JSON file:
+ *
+ *     {"suites": [{"name": ..., "passed": ..., "failed": ..., "skipped": ...,
+ *                  "wall_ns": ..., "user_ns": ..., "sys_ns": ...,
+ *                  "setup_ns": ..., "teardown_ns": ..., "peak_rss": ...,
+ *                  "cases": [{"name": ..., "status": "pass", "wall_ns": ...,
+ *                             ..., "peak_rss": ...,
+ *                             "perf": {"instructions": ...},
+ *                             "alloc": {"allocs": ..., "leaked": ...}},
+ *                            ...]}, ...]}
+ *
+ * with `status` one of "pass", "fail" or "skip", and `perf` and `alloc` only
+ * present for cases whose events or allocations were counted (see cuf_perf.h
+ * and cuf_alloc.h).
+ *
+ * @param runner testrunner to export
+ * @param path file to write
+ * @return 0 on success, -1 if the file could not be written
+ */
+int prof_write_json(TestRunner *runner, const char *path);
+
+#endif
@@ -0,0 +1,705 @@
+/**
+ * @file cuf_sched.c
+ * @brief CUnitFramework (CUF): Parallel Scheduler Implementation
+ * @details Thread pool runners for the cuf framework. Workers only ever run
+ * tests; all printing is left to the calling thread so output stays ordered.
+ *
+ * The dependency graph runner keeps, per testcase, the number of its
+ * dependencies that have yet to finish and the list of cases depending on
+ * it. A case joins a shared FIFO of ready cases when the first number drops
+ * to zero, or as soon as one of its dependencies did not pass.
+ *
+ * Every runner starts cases in the order of the run (see cuf_order.h). The
+ * stealing runner deals that order out round-robin when a history file set
+ * it, so each worker starts with one of the first cases, and contiguously
+ * otherwise, to keep suites together. Once fail-fast stops the run, workers
+ * drain what is left without running it.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cuf_order.h"
+#include "cuf_prof.h"
+#include "cuf_sched.h"
+#include "cuf_shard.h"
+#include "cuf_watch.h"
+
+
+/**
+ * completion tracker shared between workers and the printing thread
+ */
+typedef struct {
+    pthread_mutex_t lock;  /**< protects `done` */
+    pthread_cond_t cond;   /**< signalled whenever a suite finishes */
+    bool *done;            /**< per suite flag set once the suite has run */
+} Progress;
+
+/**
+ * shared state of a suite level worker pool
+ */
+typedef struct {
+    TestRunner *runner;    /**< runner whose suites are being run */
+    Progress *progress;    /**< completion tracker for the runner's suites */
+    int *order;            /**< suite indices in the order to run them */
+    pthread_mutex_t lock;  /**< protects `next_suite` */
+    int next_suite;        /**< position in `order` of next suite */
+} SuitePool;
+
+/**
+ * a single testcase waiting to be run by the work stealing scheduler
+ */
+typedef struct {
+    int suite_idx;         /**< index of the owning suite in the runner */
+    TestCase *testcase;    /**< testcase to run */
+} Task;
+
+/**
+ * per worker deque of tasks. The owner takes from the top, thieves take the
+ * bottom half. Tasks are never added after the run starts, so a deque is just
+ * a window into the shared task array.
+ */
+typedef struct {
+    pthread_mutex_t lock;  /**< protects `top` and `bottom` */
+    int top;               /**< index of next task the owner will run */
+    int bottom;            /**< one past the last task in this deque */
+} WorkDeque;
+
+/**
+ * per suite bookkeeping making sure init/term run exactly once around all of
+ * the suite's cases, whichever workers end up running them
+ */
+typedef struct {
+    pthread_mutex_t lock;  /**< protects everything below */
+    pthread_cond_t cond;   /**< signalled when init has finished */
+    int state;             /**< one of the `gate_states` */
+    int remaining;         /**< number of cases still to run */
+} SuiteGate;
+
+/**
+ * init states of a SuiteGate
+ */
+enum gate_states {
+    GATE_IDLE,             /**< no case of the suite has started */
+    GATE_INIT,             /**< a worker is running the init function */
+    GATE_READY             /**< init has run, cases may run */
+};
+
+/**
+ * shared state of a testcase level work stealing pool
+ */
+typedef struct {
+    TestRunner *runner;    /**< runner whose cases are being run */
+    Progress *progress;    /**< completion tracker for the runner's suites */
+    Task *tasks;           /**< every testcase of every suite */
+    WorkDeque *deques;     /**< one deque per worker */
+    SuiteGate *gates;      /**< one gate per suite */
+    int njobs;             /**< number of workers (and deques) */
+} StealPool;
+
+/**
+ * a testcase of the dependency graph runner
+ */
+typedef struct {
+    int suite_idx;         /**< index of the owning suite in the runner */
+    TestCase *testcase;    /**< testcase to run */
+    int waiting;           /**< dependencies that have not finished yet */
+    int first_dependent;   /**< index of its first dependent in `dependents` */
+    int dependent_count;   /**< number of cases depending on it */
+    bool decided;          /**< queued to run, or to be skipped */
+} GraphNode;
+
+/**
+ * a testcase along with the index of its GraphNode, to look nodes up by case
+ */
+typedef struct {
+    TestCase *testcase;    /**< the testcase */
+    int node;              /**< index of its node */
+} NodeRef;
+
+/**
+ * shared state of a dependency graph pool
+ */
+typedef struct {
+    TestRunner *runner;    /**< runner whose cases are being run */
+    Progress *progress;    /**< completion tracker for the runner's suites */
+    SuiteGate *gates;      /**< one gate per suite */
+    GraphNode *nodes;      /**< every testcase of the run */
+    int *dependents;       /**< node indices, each node's dependents in turn */
+    pthread_mutex_t lock;  /**< protects everything below and the nodes */
+    pthread_cond_t cond;   /**< signalled when a case is queued or finished */
+    int *ready;            /**< FIFO of nodes to run */
+    int head;              /**< index of the next node to take from `ready` */
+    int tail;              /**< one past the last node queued */
+    int unfinished;        /**< number of nodes that have not finished */
+} GraphPool;
+
+/**
+ * argument handed to each work stealing worker thread
+ */
+typedef struct {
+    StealPool *pool;       /**< shared pool */
+    int id;                /**< index of this worker's own deque */
+} StealWorker;
+
+
+static int resolve_jobs(int njobs, int max_jobs);
+static Progress *progress_create(int suite_count);
+static void progress_mark_done(Progress *progress, int suite_idx);
+static void progress_print(TestRunner *runner, Progress *progress);
+static void progress_destroy(Progress *progress);
+static void *suite_worker(void *arg);
+static void *steal_worker(void *arg);
+static bool steal_next(StealPool *pool, int id, Task **task);
+static void gate_enter(SuiteGate *gate, TestSuite *suite);
+static bool gate_leave(SuiteGate *gate);
+static int graph_build(GraphPool *pool);
+static int compare_refs(const void *a, const void *b);
+static int compare_tasks(const void *a, const void *b);
+static int compare_run_order(const void *a, const void *b);
+static void *graph_worker(void *arg);
+static void graph_push(GraphPool *pool, int node);
+static void graph_finish(GraphPool *pool, GraphNode *node);
+
+
+int testrunner_run_parallel(TestRunner *runner, int njobs) {
+    // suites can't run on their own if their cases don't
+    if(dependency_between_cases(runner)) {
+        return testrunner_run_graph(runner, njobs);
+    }
+    testrunner_print_header(runner);
+    fflush(stdout);
+    if(runner->suite_count == 0) return testrunner_report(runner);
+    watchdog_start(runner);
+    // cases run side by side, peak RSS is no longer theirs alone
+    prof_set_shared(true);
+
+    SuitePool pool;
+    pool.runner = runner;
+    pool.progress = progress_create(runner->suite_count);
+    pool.order = order_suites(runner);
+    pool.next_suite = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    njobs = resolve_jobs(njobs, runner->suite_count);
+    pthread_t *workers = malloc(sizeof(pthread_t) * njobs);
+    int started = 0;
+    for(; started < njobs; ++started) {
+        if(pthread_create(&workers[started], NULL, &suite_worker, &pool)) {
+            break;
+        }
+    }
+    // no threads at all means we are on our own
+    if(started == 0) suite_worker(&pool);
+
+    progress_print(runner, pool.progress);
+    for(int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    free(pool.order);
+    progress_destroy(pool.progress);
+    pthread_mutex_destroy(&pool.lock);
+    watchdog_stop();
+    return testrunner_report(runner);
+}
+
+int testrunner_run_stealing(TestRunner *runner, int njobs) {
+    // deques dealt in registration order know nothing about dependencies
+    if(dependency_between_cases(runner)) {
+        return testrunner_run_graph(runner, njobs);
+    }
+    testrunner_print_header(runner);
+    fflush(stdout);
+
+    watchdog_start(runner);
+    prof_set_shared(true);
+
+    StealPool pool;
+    pool.runner = runner;
+    pool.progress = progress_create(runner->suite_count);
+    pool.gates = malloc(sizeof(SuiteGate) * (runner->suite_count + 1));
+    // flatten every suite's cases into one task array, in the order of the run
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        total += runner->suites[i]->test_count;
+    }
+    pool.tasks = malloc(sizeof(Task) * (total + 1));
+    int ntasks = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        SuiteGate *gate = &pool.gates[i];
+        pthread_mutex_init(&gate->lock, NULL);
+        pthread_cond_init(&gate->cond, NULL);
+        gate->state = GATE_IDLE;
+        gate->remaining = suite->test_count - suite->deselected;
+        // nothing of the suite to run here, not even its init/term pair
+        if(shard_skips_suite(suite)) {
+            progress_mark_done(pool.progress, i);
+            continue;
+        }
+        for(int j = 0; j < suite->test_count; ++j) {
+            if(suite->testcases[j]->status == CUF_TC_DESELECTED) continue;
+            pool.tasks[ntasks].suite_idx = i;
+            pool.tasks[ntasks].testcase = suite->testcases[j];
+            ++ntasks;
+        }
+        // empty suites still get their init/term pair, right here
+        if(suite->test_count == 0) {
+            if(suite->init) suite->init(suite);
+            if(suite->term) suite->term(suite);
+            testsuite_tally(suite);
+            progress_mark_done(pool.progress, i);
+        }
+    }
+
+    qsort(pool.tasks, ntasks, sizeof(Task), &compare_tasks);
+
+    // deal contiguous runs of tasks to each worker to keep suites together,
+    // or every njobs-th task when the order came from a history file
+    njobs = resolve_jobs(njobs, (ntasks > 0)? ntasks : 1);
+    pool.njobs = njobs;
+    pool.deques = malloc(sizeof(WorkDeque) * njobs);
+    StealWorker *args = malloc(sizeof(StealWorker) * njobs);
+    bool interleave = runner->history_path && njobs > 1;
+    Task *dealt = interleave? malloc(sizeof(Task) * (ntasks + 1)) : NULL;
+    int ndealt = 0;
+    for(int i = 0; i < njobs; ++i) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        if(interleave) {
+            pool.deques[i].top = ndealt;
+            for(int k = i; k < ntasks; k += njobs) {
+                dealt[ndealt++] = pool.tasks[k];
+            }
+            pool.deques[i].bottom = ndealt;
+        } else {
+            pool.deques[i].top = (int) ((long) ntasks * i / njobs);
+            pool.deques[i].bottom = (int) ((long) ntasks * (i + 1) / njobs);
+        }
+        args[i].pool = &pool;
+        args[i].id = i;
+    }
+    if(interleave) {
+        free(pool.tasks);
+        pool.tasks = dealt;
+    }
+
+    pthread_t *workers = malloc(sizeof(pthread_t) * njobs);
+    int started = 0;
+    for(; started < njobs; ++started) {
+        if(pthread_create(&workers[started], NULL, &steal_worker,
+                          &args[started])) {
+            break;
+        }
+    }
+    // anything not picked up by a thread gets stolen by this one
+    if(started == 0 && ntasks > 0) steal_worker(&args[0]);
+
+    progress_print(runner, pool.progress);
+    for(int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for(int i = 0; i < njobs; ++i) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    for(int i = 0; i < runner->suite_count; ++i) {
+        pthread_mutex_destroy(&pool.gates[i].lock);
+        pthread_cond_destroy(&pool.gates[i].cond);
+    }
+    free(workers);
+    free(args);
+    free(pool.deques);
+    free(pool.tasks);
+    free(pool.gates);
+    progress_destroy(pool.progress);
+    watchdog_stop();
+    return testrunner_report(runner);
+}
+
+int testrunner_run_graph(TestRunner *runner, int njobs) {
+    testrunner_print_header(runner);
+    fflush(stdout);
+
+    watchdog_start(runner);
+    prof_set_shared(true);
+
+    GraphPool pool;
+    pool.runner = runner;
+    pool.progress = progress_create(runner->suite_count);
+    pool.gates = malloc(sizeof(SuiteGate) * (runner->suite_count + 1));
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        SuiteGate *gate = &pool.gates[i];
+        pthread_mutex_init(&gate->lock, NULL);
+        pthread_cond_init(&gate->cond, NULL);
+        gate->state = GATE_IDLE;
+        gate->remaining = suite->test_count - suite->deselected;
+        if(shard_skips_suite(suite)) {
+            progress_mark_done(pool.progress, i);
+        } else if(suite->test_count == 0) {
+            if(suite->init) suite->init(suite);
+            if(suite->term) suite->term(suite);
+            testsuite_tally(suite);
+            progress_mark_done(pool.progress, i);
+        }
+    }
+    int nnodes = graph_build(&pool);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    pool.ready = malloc(sizeof(int) * (nnodes + 1));
+    pool.head = 0;
+    pool.tail = 0;
+    pool.unfinished = nnodes;
+    // whatever waits on nothing, and whatever is skipped already, in the
+    // order of the run
+    NodeRef *start = malloc(sizeof(NodeRef) * (nnodes + 1));
+    int nstart = 0;
+    for(int i = 0; i < nnodes; ++i) {
+        GraphNode *node = &pool.nodes[i];
+        if(node->waiting == 0 || node->testcase->skip_reason) {
+            start[nstart].testcase = node->testcase;
+            start[nstart].node = i;
+            ++nstart;
+        }
+    }
+    qsort(start, nstart, sizeof(NodeRef), &compare_run_order);
+    for(int i = 0; i < nstart; ++i) {
+        graph_push(&pool, start[i].node);
+    }
+    free(start);
+
+    njobs = resolve_jobs(njobs, (nnodes > 0)? nnodes : 1);
+    pthread_t *workers = malloc(sizeof(pthread_t) * njobs);
+    int started = 0;
+    for(; started < njobs; ++started) {
+        if(pthread_create(&workers[started], NULL, &graph_worker, &pool)) {
+            break;
+        }
+    }
+    if(started == 0 && nnodes > 0) graph_worker(&pool);
+
+    progress_print(runner, pool.progress);
+    for(int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for(int i = 0; i < runner->suite_count; ++i) {
+        pthread_mutex_destroy(&pool.gates[i].lock);
+        pthread_cond_destroy(&pool.gates[i].cond);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cond);
+    free(workers);
+    free(pool.ready);
+    free(pool.dependents);
+    free(pool.nodes);
+    free(pool.gates);
+    progress_destroy(pool.progress);
+    watchdog_stop();
+    return testrunner_report(runner);
+}
+
+static int resolve_jobs(int njobs, int max_jobs) {
+    if(njobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        njobs = (cpus > 0)? (int) cpus : 1;
+    }
+    if(njobs > max_jobs) njobs = max_jobs;
+    return njobs;
+}
+
+static Progress *progress_create(int suite_count) {
+    Progress *progress = malloc(sizeof(Progress));
+    pthread_mutex_init(&progress->lock, NULL);
+    pthread_cond_init(&progress->cond, NULL);
+    progress->done = calloc(suite_count + 1, sizeof(bool));
+    return progress;
+}
+
+static void progress_mark_done(Progress *progress, int suite_idx) {
+    pthread_mutex_lock(&progress->lock);
+    progress->done[suite_idx] = true;
+    pthread_cond_broadcast(&progress->cond);
+    pthread_mutex_unlock(&progress->lock);
+}
+
+static void progress_print(TestRunner *runner, Progress *progress) {
+    // print progress lines in registration order as the suites complete
+    for(int i = 0; i < runner->suite_count; ++i) {
+        pthread_mutex_lock(&progress->lock);
+        while(!progress->done[i]) {
+            pthread_cond_wait(&progress->cond, &progress->lock);
+        }
+        pthread_mutex_unlock(&progress->lock);
+
+        TestSuite *suite = runner->suites[i];
+        if(shard_skips_suite(suite) || order_skips_suite(suite)) continue;
+        printf("Test Suite: %s ", suite->name);
+        for(int j = 0; j < suite->test_count; ++j) {
+            testcase_print_progress(suite->testcases[j]);
+        }
+        testrunner_print_status(runner, suite);
+    }
+}
+
+static void progress_destroy(Progress *progress) {
+    pthread_mutex_destroy(&progress->lock);
+    pthread_cond_destroy(&progress->cond);
+    free(progress->done);
+    free(progress);
+}
+
+static void *suite_worker(void *arg) {
+    SuitePool *pool = arg;
+    while(true) {
+        pthread_mutex_lock(&pool->lock);
+        int next = pool->next_suite++;
+        pthread_mutex_unlock(&pool->lock);
+        if(next >= pool->runner->suite_count) break;
+
+        int idx = pool->order[next];
+        TestSuite *suite = pool->runner->suites[idx];
+        // a suite fail-fast stopped before it started doesn't init either
+        if(!shard_skips_suite(suite) && !order_stopped()) {
+            testsuite_exec(suite, false);
+        }
+        progress_mark_done(pool->progress, idx);
+    }
+    return NULL;
+}
+
+static void *steal_worker(void *arg) {
+    StealWorker *self = arg;
+    StealPool *pool = self->pool;
+    Task *task = NULL;
+    while(steal_next(pool, self->id, &task)) {
+        TestSuite *suite = pool->runner->suites[task->suite_idx];
+        SuiteGate *gate = &pool->gates[task->suite_idx];
+        // after a fail-fast stop the rest is only counted down
+        if(!order_stopped()) {
+            gate_enter(gate, suite);
+            testcase_run(suite, task->testcase);
+        }
+        if(gate_leave(gate)) {
+            // last case of the suite, wherever the others ran
+            if(gate->state != GATE_IDLE && suite->term) suite->term(suite);
+            testsuite_tally(suite);
+            progress_mark_done(pool->progress, task->suite_idx);
+        }
+    }
+    return NULL;
+}
+
+static bool steal_next(StealPool *pool, int id, Task **task) {
+    WorkDeque *own = &pool->deques[id];
+    while(true) {
+        pthread_mutex_lock(&own->lock);
+        if(own->top < own->bottom) {
+            *task = &pool->tasks[own->top++];
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        // out of work: pick the fullest victim and take its bottom half
+        int victim = -1;
+        int most = 0;
+        for(int i = 0; i < pool->njobs; ++i) {
+            if(i == id) continue;
+            pthread_mutex_lock(&pool->deques[i].lock);
+            int left = pool->deques[i].bottom - pool->deques[i].top;
+            pthread_mutex_unlock(&pool->deques[i].lock);
+            if(left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        // tasks are never added, so empty everywhere means we are done
+        if(victim < 0) return false;
+
+        // never hold two deque locks at once; the stolen range belongs to
+        // nobody for a moment, which is fine since only we will run it
+        WorkDeque *other = &pool->deques[victim];
+        pthread_mutex_lock(&other->lock);
+        int start = other->bottom;
+        int end = other->bottom;
+        int left = other->bottom - other->top;
+        if(left > 0) {
+            start = other->bottom - (left + 1) / 2;
+            other->bottom = start;
+        }
+        pthread_mutex_unlock(&other->lock);
+        pthread_mutex_lock(&own->lock);
+        own->top = start;
+        own->bottom = end;
+        pthread_mutex_unlock(&own->lock);
+    }
+}
+
+static void gate_enter(SuiteGate *gate, TestSuite *suite) {
+    pthread_mutex_lock(&gate->lock);
+    if(gate->state == GATE_IDLE) {
+        gate->state = GATE_INIT;
+        pthread_mutex_unlock(&gate->lock);
+        if(suite->init) suite->init(suite);
+        pthread_mutex_lock(&gate->lock);
+        gate->state = GATE_READY;
+        pthread_cond_broadcast(&gate->cond);
+    }
+    while(gate->state != GATE_READY) {
+        pthread_cond_wait(&gate->cond, &gate->lock);
+    }
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static bool gate_leave(SuiteGate *gate) {
+    pthread_mutex_lock(&gate->lock);
+    bool last = (--gate->remaining == 0);
+    pthread_mutex_unlock(&gate->lock);
+    return last;
+}
+
+static int graph_build(GraphPool *pool) {
+    TestRunner *runner = pool->runner;
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        total += runner->suites[i]->test_count;
+    }
+    pool->nodes = malloc(sizeof(GraphNode) * (total + 1));
+    NodeRef *refs = malloc(sizeof(NodeRef) * (total + 1));
+    int nnodes = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            if(c_case->status == CUF_TC_DESELECTED) continue;
+            // a dependency in another shard, say so before anything runs
+            if(dependency_state(c_case, NULL) == CUF_DEP_BLOCKED) {
+                dependency_state(c_case, &c_case->skip_reason);
+            }
+            GraphNode *node = &pool->nodes[nnodes];
+            node->suite_idx = i;
+            node->testcase = c_case;
+            node->waiting = 0;
+            node->first_dependent = 0;
+            node->dependent_count = 0;
+            node->decided = false;
+            refs[nnodes].testcase = c_case;
+            refs[nnodes].node = nnodes;
+            ++nnodes;
+        }
+    }
+    qsort(refs, nnodes, sizeof(NodeRef), &compare_refs);
+    // count the edges into each node, then lay the lists out back to back
+    for(int pass = 0; pass < 2; ++pass) {
+        for(int i = 0; i < nnodes; ++i) {
+            GraphNode *node = &pool->nodes[i];
+            Dependency *deps = node->testcase->deps;
+            if(!deps || node->testcase->skip_reason) continue;
+            for(int k = 0; k < deps->need_count; ++k) {
+                NodeRef find = {deps->needs[k].testcase, 0};
+                NodeRef *hit = bsearch(&find, refs, nnodes, sizeof(NodeRef),
+                                       &compare_refs);
+                GraphNode *from = &pool->nodes[hit->node];
+                if(pass == 0) {
+                    ++from->dependent_count;
+                    ++node->waiting;
+                } else {
+                    pool->dependents[from->first_dependent +
+                                     from->dependent_count++] = i;
+                }
+            }
+        }
+        if(pass == 1) break;
+        int edges = 0;
+        for(int i = 0; i < nnodes; ++i) {
+            pool->nodes[i].first_dependent = edges;
+            edges += pool->nodes[i].dependent_count;
+            pool->nodes[i].dependent_count = 0;
+        }
+        pool->dependents = malloc(sizeof(int) * (edges + 1));
+    }
+    free(refs);
+    return nnodes;
+}
+
+static int compare_refs(const void *a, const void *b) {
+    const NodeRef *ref_a = a;
+    const NodeRef *ref_b = b;
+    return (ref_a->testcase > ref_b->testcase) -
+           (ref_a->testcase < ref_b->testcase);
+}
+
+static int compare_tasks(const void *a, const void *b) {
+    const Task *task_a = a;
+    const Task *task_b = b;
+    return (task_a->testcase->run_order > task_b->testcase->run_order) -
+           (task_a->testcase->run_order < task_b->testcase->run_order);
+}
+
+static int compare_run_order(const void *a, const void *b) {
+    const NodeRef *ref_a = a;
+    const NodeRef *ref_b = b;
+    return (ref_a->testcase->run_order > ref_b->testcase->run_order) -
+           (ref_a->testcase->run_order < ref_b->testcase->run_order);
+}
+
+static void *graph_worker(void *arg) {
+    GraphPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while(true) {
+        while(pool->head == pool->tail && pool->unfinished > 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if(pool->head == pool->tail) break;
+        GraphNode *node = &pool->nodes[pool->ready[pool->head++]];
+        pthread_mutex_unlock(&pool->lock);
+
+        TestSuite *suite = pool->runner->suites[node->suite_idx];
+        SuiteGate *gate = &pool->gates[node->suite_idx];
+        if(!order_stopped()) {
+            gate_enter(gate, suite);
+            testcase_run(suite, node->testcase);
+        }
+        if(gate_leave(gate)) {
+            if(gate->state != GATE_IDLE && suite->term) suite->term(suite);
+            testsuite_tally(suite);
+            progress_mark_done(pool->progress, node->suite_idx);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        graph_finish(pool, node);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void graph_push(GraphPool *pool, int node) {
+    pool->nodes[node].decided = true;
+    pool->ready[pool->tail++] = node;
+}
+
+static void graph_finish(GraphPool *pool, GraphNode *node) {
+    bool passed = node->testcase->status == CUF_TC_PASS;
+    DepNeed need = {pool->runner->suites[node->suite_idx], node->testcase};
+    for(int k = 0; k < node->dependent_count; ++k) {
+        int idx = pool->dependents[node->first_dependent + k];
+        GraphNode *dependent = &pool->nodes[idx];
+        if(dependent->decided) continue;
+        --dependent->waiting;
+        if(!passed) {
+            // skip it now rather than when the rest of its dependencies end
+            dependent->testcase->skip_reason = dependency_blame(&need);
+            graph_push(pool, idx);
+        } else if(dependent->waiting == 0) {
+            graph_push(pool, idx);
+        }
+    }
+    --pool->unfinished;
+    pthread_cond_broadcast(&pool->cond);
+}
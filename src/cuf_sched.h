@@ -0,0 +1,57 @@
+/**
+ * @file cuf_sched.h
+ * @brief CUnitFramework (CUF): Parallel Scheduler Interface
+ * @details Alternative ways of running a TestRunner that spread the registered
+ * suites or testcases over a pool of worker threads. The report printed at the
+ * end is the same one `testrunner_run` prints, so they can be swapped freely.
+ * When some testcase depends on others (see cuf_dep.h), the parallel and
+ * stealing runners hand the run to `testrunner_run_graph()` instead.
+ */
+#ifndef __CUF_SCHED_H__
+#define __CUF_SCHED_H__
+
+#include "cuf.h"
+
+
+/**
+ * Run the given test runner on a pool of worker threads and print results to
+ * stdout. Each suite is handed to exactly one worker, so suites still see
+ * their init, setup, teardown and term functions called in the usual order,
+ * but different suites run at the same time. Progress lines are printed in
+ * registration order as suites finish, so the output matches `testrunner_run`.
+ *
+ * @param runner testrunner to run
+ * @param njobs number of worker threads; 0 or less uses one per online cpu
+ * @return 0 if no tests failed, 1 otherwise
+ */
+int testrunner_run_parallel(TestRunner *runner, int njobs);
+/**
+ * Run the given test runner with a testcase level work stealing scheduler and
+ * print results to stdout. Every suite's cases are dealt out to per worker
+ * deques, and workers that run dry steal half of the fullest deque, so one
+ * large suite no longer holds up the run. A suite's init function runs once
+ * before the first of its cases starts and its term function once after the
+ * last one finished; setup and teardown still wrap each case. Cases of one
+ * suite may run at the same time, so they must not share mutable state.
+ *
+ * @param runner testrunner to run
+ * @param njobs number of worker threads; 0 or less uses one per online cpu
+ * @return 0 if no tests failed, 1 otherwise
+ */
+int testrunner_run_stealing(TestRunner *runner, int njobs);
+/**
+ * Run the given test runner on a pool of worker threads, starting each
+ * testcase as soon as every testcase it depends on has passed, and print
+ * results to stdout. Cases that don't depend on each other run at the same
+ * time, in registration order as far as their dependencies allow; when one
+ * fails, the cases depending on it are skipped right away, without waiting
+ * for their turn. Suites get their init and term functions called around
+ * their cases like with `testrunner_run_stealing()`.
+ *
+ * @param runner testrunner to run
+ * @param njobs number of worker threads; 0 or less uses one per online cpu
+ * @return 0 if no tests failed, 1 otherwise
+ */
+int testrunner_run_graph(TestRunner *runner, int njobs);
+
+#endif
@@ -0,0 +1,300 @@
+/**
+ * @file cuf_shard.c
+ * @brief CUnitFramework (CUF): Sharding Implementation
+ * @details The balanced split is the classic longest processing time first
+ * heuristic: sort the cases by cost, longest first, and give each to the
+ * shard with the least total so far. Ties are broken by registration order
+ * and by shard index, so every shard comes up with the same split. Cases
+ * tied together by dependencies are dealt as one, costing their total.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuf_escape.h"
+#include "cuf_shard.h"
+
+
+/**
+ * recorded duration of one testcase, from the timing file
+ */
+typedef struct {
+    char *suite;           /**< name of the suite */
+    char *name;            /**< name of the testcase */
+    uint64_t ns;           /**< nanoseconds from setup to teardown */
+} TimingEntry;
+
+/**
+ * a testcase to deal out to a shard
+ */
+typedef struct {
+    TestSuite *suite;      /**< suite the case belongs to */
+    TestCase *testcase;    /**< the case */
+    int order;             /**< position in registration order */
+    uint64_t cost;         /**< expected nanoseconds, recorded or guessed */
+} ShardCase;
+
+static TimingEntry *load_timings(const char *path, int *count);
+static void free_timings(TimingEntry *entries, int count);
+static int compare_timings(const void *a, const void *b);
+static int compare_cost(const void *a, const void *b);
+static const char *status_name(const TestCase *testcase);
+
+
+int testrunner_set_shard(TestRunner *runner, int index, int count) {
+    if(count < 1 || index < 1 || index > count) return -1;
+    runner->shard_index = index;
+    runner->shard_count = count;
+    return 0;
+}
+
+void testrunner_set_shard_timings(TestRunner *runner, const char *path) {
+    free(runner->shard_timings);
+    runner->shard_timings = path? strdup(path) : NULL;
+}
+
+void testrunner_set_results_file(TestRunner *runner, const char *path) {
+    free(runner->results_path);
+    runner->results_path = path? strdup(path) : NULL;
+}
+
+void shard_select(TestRunner *runner) {
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        suite->deselected = 0;
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            if(c_case->status == CUF_TC_DESELECTED) {
+                c_case->status = CUF_TC_PASS;
+            }
+        }
+        total += suite->test_count;
+    }
+    if(runner->shard_count <= 1 || total == 0) return;
+
+    ShardCase *cases = malloc(sizeof(ShardCase) * total);
+    int ntimings = 0;
+    TimingEntry *timings = NULL;
+    if(runner->shard_timings) {
+        timings = load_timings(runner->shard_timings, &ntimings);
+    }
+    int known = 0;
+    uint64_t known_ns = 0;
+    int order = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++order) {
+            ShardCase *c_case = &cases[order];
+            c_case->suite = suite;
+            c_case->testcase = suite->testcases[j];
+            c_case->order = order;
+            c_case->cost = 0;
+            if(!ntimings) continue;
+            TimingEntry find = {suite->name, c_case->testcase->test_name, 0};
+            TimingEntry *hit = bsearch(&find, timings, ntimings,
+                                       sizeof(TimingEntry), &compare_timings);
+            if(!hit) continue;
+            c_case->cost = hit->ns + CUF_SHARD_CASE_NS;
+            known_ns += hit->ns;
+            ++known;
+        }
+    }
+    free_timings(timings, ntimings);
+
+    // a case and the cases it depends on go to one shard as a single unit,
+    // led by its first case in registration order
+    int *group = malloc(sizeof(int) * total);
+    dependency_groups(runner, group);
+    int *owner = malloc(sizeof(int) * total);
+    int shard = runner->shard_index - 1;
+    if(known == 0) {
+        // no history at all, deal them out like cards
+        int units = 0;
+        for(int i = 0; i < total; ++i) {
+            if(group[i] == i) owner[i] = units++ % runner->shard_count;
+        }
+    } else {
+        uint64_t guess = known_ns / known + CUF_SHARD_CASE_NS;
+        for(int i = 0; i < total; ++i) {
+            if(!cases[i].cost) cases[i].cost = guess;
+        }
+        for(int i = 0; i < total; ++i) {
+            if(group[i] != i) cases[group[i]].cost += cases[i].cost;
+        }
+        int units = 0;
+        for(int i = 0; i < total; ++i) {
+            if(group[i] == i) cases[units++] = cases[i];
+        }
+        qsort(cases, units, sizeof(ShardCase), &compare_cost);
+        uint64_t *loads = calloc(runner->shard_count, sizeof(uint64_t));
+        for(int i = 0; i < units; ++i) {
+            int least = 0;
+            for(int k = 1; k < runner->shard_count; ++k) {
+                if(loads[k] < loads[least]) least = k;
+            }
+            loads[least] += cases[i].cost;
+            owner[cases[i].order] = least;
+        }
+        free(loads);
+    }
+    order = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j, ++order) {
+            if(owner[group[order]] == shard) continue;
+            suite->testcases[j]->status = CUF_TC_DESELECTED;
+            ++(suite->deselected);
+        }
+    }
+    free(owner);
+    free(group);
+    free(cases);
+}
+
+bool shard_skips_suite(const TestSuite *suite) {
+    return suite->test_count > 0 && suite->deselected == suite->test_count;
+}
+
+int shard_write_results(TestRunner *runner) {
+    // write next to the old file and swap, so a crash can't leave half of it
+    size_t len = strlen(runner->results_path) + 5;
+    char *tmp_path = malloc(len);
+    snprintf(tmp_path, len, "%s.tmp", runner->results_path);
+    FILE *out = fopen(tmp_path, "w");
+    if(!out) {
+        free(tmp_path);
+        return -1;
+    }
+    int total = 0;
+    for(int i = 0; i < runner->suite_count; ++i) {
+        total += runner->suites[i]->test_count;
+    }
+    fprintf(out, CUF_RESULTS_HEADER, runner->shard_index, runner->shard_count,
+            total);
+    for(int i = 0; i < runner->suite_count; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count; ++j) {
+            TestCase *c_case = suite->testcases[j];
+            // deselected cases, or an aborted run's leftovers
+            if(!c_case->done) continue;
+            CaseTimes *times = &c_case->times;
+            fprintf(out, "%d\t%d\t", i, j);
+            cuf_write_escaped(out, suite->name);
+            fputc('\t', out);
+            cuf_write_escaped(out, c_case->test_name);
+            fprintf(out, "\t%s\t%llu\t", status_name(c_case),
+                    (unsigned long long) (times->setup_ns + times->wall_ns +
+                                          times->teardown_ns));
+            if(c_case->failures) {
+                char *text = NULL;
+                size_t size = 0;
+                FILE *mem = open_memstream(&text, &size);
+                if(mem) {
+                    testcase_print_failures(mem, c_case);
+                    fclose(mem);
+                    cuf_write_escaped(out, text);
+                }
+                free(text);
+            } else if(c_case->status == CUF_TC_SKIP && c_case->skip_reason) {
+                cuf_write_escaped(out, c_case->skip_reason);
+            }
+            fputc('\n', out);
+        }
+    }
+    int ret = fclose(out)? -1 : rename(tmp_path, runner->results_path);
+    free(tmp_path);
+    return ret? -1 : 0;
+}
+
+static TimingEntry *load_timings(const char *path, int *count) {
+    *count = 0;
+    FILE *in = fopen(path, "r");
+    // no file yet just means no history to balance with
+    if(!in) return NULL;
+    TimingEntry *entries = NULL;
+    int size = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while(getline(&line, &cap, in) > 0) {
+        if(line[0] == '#') continue;
+        char *save = NULL;
+        char *suite_idx = strtok_r(line, "\t", &save);
+        char *case_idx = strtok_r(NULL, "\t", &save);
+        char *suite = strtok_r(NULL, "\t", &save);
+        char *name = strtok_r(NULL, "\t", &save);
+        char *status = strtok_r(NULL, "\t", &save);
+        char *ns = strtok_r(NULL, "\t\n", &save);
+        if(!suite_idx || !case_idx || !suite || !name || !status || !ns) {
+            continue;
+        }
+        // a cached or skipped case says nothing about how long it takes
+        if(strcmp(status, "pass") && strcmp(status, "fail")) continue;
+        if(*count == size) {
+            size = size? size * 2 : 64;
+            entries = realloc(entries, sizeof(TimingEntry) * size);
+        }
+        cuf_unescape(suite);
+        cuf_unescape(name);
+        entries[*count].suite = strdup(suite);
+        entries[*count].name = strdup(name);
+        entries[*count].ns = strtoull(ns, NULL, 10);
+        ++(*count);
+    }
+    free(line);
+    fclose(in);
+    if(*count == 0) return entries;
+    qsort(entries, *count, sizeof(TimingEntry), &compare_timings);
+    // cases registered twice under one name share the longer time
+    int kept = 1;
+    for(int i = 1; i < *count; ++i) {
+        TimingEntry *last = &entries[kept - 1];
+        if(compare_timings(last, &entries[i]) == 0) {
+            if(entries[i].ns > last->ns) last->ns = entries[i].ns;
+            free(entries[i].suite);
+            free(entries[i].name);
+        } else {
+            entries[kept++] = entries[i];
+        }
+    }
+    *count = kept;
+    return entries;
+}
+
+static void free_timings(TimingEntry *entries, int count) {
+    for(int i = 0; i < count; ++i) {
+        free(entries[i].suite);
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+static int compare_timings(const void *a, const void *b) {
+    const TimingEntry *entry_a = a;
+    const TimingEntry *entry_b = b;
+    int diff = strcmp(entry_a->suite, entry_b->suite);
+    return diff? diff : strcmp(entry_a->name, entry_b->name);
+}
+
+static int compare_cost(const void *a, const void *b) {
+    const ShardCase *case_a = a;
+    const ShardCase *case_b = b;
+    // longest first, then registration order
+    if(case_a->cost != case_b->cost) {
+        return case_a->cost < case_b->cost? 1 : -1;
+    }
+    return (case_a->order > case_b->order) - (case_a->order < case_b->order);
+}
+
+static const char *status_name(const TestCase *testcase) {
+    switch(testcase->status) {
+        case CUF_TC_PASS:
+            return testcase->cached? "cached" : "pass";
+        case CUF_TC_FAIL:
+            return "fail";
+        default:
+            return "skip";
+    }
+}
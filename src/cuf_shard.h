@@ -0,0 +1,103 @@
+/**
+ * @file cuf_shard.h
+ * @brief CUnitFramework (CUF): Sharding Interface
+ * @details Splitting one run over several processes or machines. Every shard
+ * runs the same test binary with `--shard=i/n` and picks its share of the
+ * testcases on its own, without talking to the others, so the split only
+ * depends on what was registered and on the timing file, never on the host
+ * or the clock. Give every shard the same timing file.
+ *
+ * The timing file is the results file of an earlier run (see below), usually
+ * the one `cufmerge -o` wrote for the last run of all the shards. With it,
+ * testcases are dealt out longest first, each to the shard with the least
+ * work so far, which evens the shards out to within a few percent once there
+ * are many more cases than shards. Cases the file doesn't know are taken to
+ * be as long as the average one it does. Without a timing file, or with one
+ * that knows none of the cases, they are dealt round-robin in registration
+ * order.
+ *
+ * A testcase always lands in the same shard as the testcases it depends on
+ * and the ones depending on it (see cuf_dep.h), so a chain of dependent
+ * cases counts as one long case.
+ *
+ * Cases left to the other shards get the `CUF_TC_DESELECTED` status and are
+ * left out of the progress lines and the report; suites left with no case at
+ * all are not even initialized.
+ *
+ * A results file has one line per testcase that ran, with tab separated
+ * fields: suite index, case index, suite name, case name, status (`pass`,
+ * `cached`, `fail` or `skip`), nanoseconds taken from setup to teardown and
+ * the case's part of the FAILURES section, or for a skipped case why it was
+ * skipped, empty for missing test files. Backslashes, tabs and newlines in
+ * the names and the failures are written as `\\`, `\t` and `\n`. The first
+ * line names the shard and the number of registered testcases, so the
+ * `cufmerge` tool (src/cuf_merge.c) can check that the files it is given
+ * cover a whole run before printing their combined FAILURES, SKIPPED TESTS
+ * and RESULTS sections.
+ */
+#ifndef __CUF_SHARD_H__
+#define __CUF_SHARD_H__
+
+#include <stdbool.h>
+
+#include "cuf.h"
+
+// first line of a results file: shard index, shard count and testcase count
+#define CUF_RESULTS_HEADER "# cuf results, shard %d/%d of %d tests\n"
+// time charged to every testcase on top of its recorded one, so a pile of
+// cases recorded as instant still gets spread over the shards
+#define CUF_SHARD_CASE_NS 10000
+
+
+/**
+ * Only run one shard of the registered testcases, see the file description.
+ *
+ * @param runner testrunner to configure
+ * @param index shard to run, from 1 to `count`
+ * @param count number of shards, 1 to run every testcase
+ * @return 0 on success, -1 if `index` or `count` is out of range
+ */
+int testrunner_set_shard(TestRunner *runner, int index, int count);
+/**
+ * Balance the shards with the durations recorded in a results file. The file
+ * is read when the run starts; if it doesn't exist the shards are dealt
+ * round-robin.
+ *
+ * @param runner testrunner to configure
+ * @param path results file of an earlier run, NULL for round-robin
+ */
+void testrunner_set_shard_timings(TestRunner *runner, const char *path);
+/**
+ * Write the results of every testcase that ran to a file when the report is
+ * printed, for `cufmerge` or as the timing file of a later run.
+ *
+ * @param runner testrunner to configure
+ * @param path file to write, NULL to not write one
+ */
+void testrunner_set_results_file(TestRunner *runner, const char *path);
+/**
+ * Mark the testcases that aren't in the runner's shard as
+ * `CUF_TC_DESELECTED`, and clear marks left by an earlier run. Internal use
+ * function.
+ *
+ * @param runner testrunner about to be run
+ */
+void shard_select(TestRunner *runner);
+/**
+ * Whether a suite has testcases, none of them in this shard. Internal use
+ * function.
+ *
+ * @param suite suite to check
+ * @return true if the runners should leave the suite out entirely
+ */
+bool shard_skips_suite(const TestSuite *suite);
+/**
+ * Write the results file set with `testrunner_set_results_file()`. Internal
+ * use function.
+ *
+ * @param runner testrunner that has finished running
+ * @return 0 on success, -1 if writing failed
+ */
+int shard_write_results(TestRunner *runner);
+
+#endif
@@ -4,8 +4,185 @@
  * @details Misc utilities for the CUF library, including some cleanup functions
  * and other bits and bobs for easier test writing
  */
+// RUSAGE_THREAD is a linux extension
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "cuf_util.h"
 
+
+/**
+ * mapping between a signal number and its name
+ */
+typedef struct {
+    int sig;               /**< signal number */
+    const char *name;      /**< name of the signal */
+} SignalName;
+
+static void array_msgs_free(void *msgs);
+static void array_msgs_key_create(void);
+
+// error buffer of the array comparisons run on this thread
+static _Thread_local ArrayMsgs array_msgs = {NULL, 0, 0};
+static pthread_key_t array_msgs_key;
+static pthread_once_t array_msgs_once = PTHREAD_ONCE_INIT;
+
+static const SignalName signal_names[] = {
+    {SIGABRT, "SIGABRT"}, {SIGALRM, "SIGALRM"}, {SIGBUS, "SIGBUS"},
+    {SIGFPE, "SIGFPE"},   {SIGHUP, "SIGHUP"},   {SIGILL, "SIGILL"},
+    {SIGINT, "SIGINT"},   {SIGKILL, "SIGKILL"}, {SIGPIPE, "SIGPIPE"},
+    {SIGQUIT, "SIGQUIT"}, {SIGSEGV, "SIGSEGV"}, {SIGSYS, "SIGSYS"},
+    {SIGTERM, "SIGTERM"}, {SIGTRAP, "SIGTRAP"}, {SIGUSR1, "SIGUSR1"},
+    {SIGUSR2, "SIGUSR2"}, {SIGXCPU, "SIGXCPU"}, {SIGXFSZ, "SIGXFSZ"}
+};
+
+uint64_t cuf_now_ns(void) {
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void cuf_format_ns(char *buf, size_t size, double ns) {
+    if(ns < 1e3) {
+        snprintf(buf, size, "%.2f ns", ns);
+    } else if(ns < 1e6) {
+        snprintf(buf, size, "%.2f us", ns / 1e3);
+    } else if(ns < 1e9) {
+        snprintf(buf, size, "%.2f ms", ns / 1e6);
+    } else {
+        snprintf(buf, size, "%.2f s", ns / 1e9);
+    }
+}
+
+void cuf_format_bytes(char *buf, size_t size, double bytes) {
+    if(bytes < 1024) {
+        snprintf(buf, size, "%.0f B", bytes);
+    } else if(bytes < 1024 * 1024) {
+        snprintf(buf, size, "%.2f KiB", bytes / 1024);
+    } else if(bytes < 1024 * 1024 * 1024) {
+        snprintf(buf, size, "%.2f MiB", bytes / (1024 * 1024));
+    } else {
+        snprintf(buf, size, "%.2f GiB", bytes / (1024 * 1024 * 1024));
+    }
+}
+
+void cuf_cpu_ns(uint64_t *user_ns, uint64_t *sys_ns) {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    *user_ns = (uint64_t) usage.ru_utime.tv_sec * 1000000000u +
+               (uint64_t) usage.ru_utime.tv_usec * 1000u;
+    *sys_ns = (uint64_t) usage.ru_stime.tv_sec * 1000000000u +
+              (uint64_t) usage.ru_stime.tv_usec * 1000u;
+}
+
+uint64_t cuf_rss_bytes(bool peak) {
+    const char *key = peak? "VmHWM:" : "VmRSS:";
+    // plain read() so nothing is allocated while a testcase is measured
+    char buf[4096];
+    ssize_t len = -1;
+    int fd = open("/proc/self/status", O_RDONLY);
+    if(fd >= 0) {
+        len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+    }
+    if(len > 0) {
+        buf[len] = '\0';
+        char *line = strstr(buf, key);
+        if(line) return strtoull(line + strlen(key), NULL, 10) * 1024;
+    }
+    if(!peak) return 0;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t) usage.ru_maxrss * 1024;
+}
+
+bool cuf_rss_reset_peak(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if(fd < 0) return false;
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+const char *cuf_signal_name(int sig) {
+    for(size_t i = 0; i < sizeof(signal_names) / sizeof(SignalName); ++i) {
+        if(signal_names[i].sig == sig) return signal_names[i].name;
+    }
+    return "unknown signal";
+}
+
+void cuf_array_msg(char **emsgs, size_t *eused, size_t *esize,
+                   const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if(len <= 0) return;
+    // snprintf style writers count what didn't fit too
+    if(*eused > *esize) *eused = *esize;
+    while(*esize - *eused <= (size_t) len) {
+        CUF_ARRAY_EXPAND(*emsgs, *esize, 2, char*);
+    }
+    va_start(ap, fmt);
+    vsnprintf(*emsgs + *eused, *esize - *eused, fmt, ap);
+    va_end(ap);
+    *eused += len;
+}
+
+const char *cuf_array_msg_end(char **emsgs, size_t *eused, size_t *esize) {
+    if(*esize == 0) {
+        *eused = 0;
+        CUF_ARRAY_EXPAND(*emsgs, *esize, 2, char*);
+    }
+    // snprintf style writers count what didn't fit too
+    if(*eused >= *esize) *eused = *esize - 1;
+    (*emsgs)[*eused] = '\0';
+    return *emsgs;
+}
+
+ArrayMsgs *cuf_array_msgs(void) {
+    if(!array_msgs.msgs) {
+        pthread_once(&array_msgs_once, &array_msgs_key_create);
+        // the error buffer is ours, keep it out of the testcase's heap usage
+        alloc_pause();
+        array_msgs.msgs = malloc(CUF_BUF_SIZE);
+        alloc_resume();
+        array_msgs.size = CUF_BUF_SIZE;
+        array_msgs.used = 0;
+        pthread_setspecific(array_msgs_key, &array_msgs);
+    }
+    return &array_msgs;
+}
+
+void cuf_array_msgs_reset(void) {
+    array_msgs.used = 0;
+}
+
+const char *cuf_array_msgs_end(const char *comp_func) {
+    ArrayMsgs *array = cuf_array_msgs();
+    const char *text = cuf_array_msg_end(&array->msgs, &array->used,
+                                         &array->size);
+    bool open = array->used > 0 && text[array->used - 1] != '\n';
+    cuf_array_msg(&array->msgs, &array->used, &array->size,
+                  "%sComparison function: `%s`", open? "\n" : "", comp_func);
+    return cuf_array_msg_end(&array->msgs, &array->used, &array->size);
+}
+
 SUITE_TERM_FUNC(term_cleanup_deps) {
     for(int i = 0; i < suite->test_count; ++i) {
         if(suite->testcases[i]->deps) {
@@ -23,3 +200,15 @@ SUITE_TERM_FUNC(term_cleanup_args) {
         }
     }
 }
+
+
+static void array_msgs_free(void *msgs) {
+    ArrayMsgs *array = msgs;
+    free(array->msgs);
+    array->msgs = NULL;
+    array->size = 0;
+}
+
+static void array_msgs_key_create(void) {
+    pthread_key_create(&array_msgs_key, &array_msgs_free);
+}
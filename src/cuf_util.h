@@ -7,9 +7,12 @@
 #ifndef __CUF_UTIL_H__
 #define __CUF_UTIL_H__
 
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "cuf.h"
+#include "cuf_alloc.h"
 
 /**
  * Declare a variable as unused to suppress warnings
@@ -17,7 +20,11 @@
 #define CUF_UNUSED(a) (void)(a);
 
 /**
- * Declare a array comparison function for use with the assertions
+ * Declare a array comparison function for use with the assertions. It is
+ * called once per element and returns whether the elements match; on a
+ * mismatch it writes a message to the error buffer, which holds at least
+ * `CUF_BUF_SIZE` bytes, either with `cuf_array_msg()` or by growing it with
+ * `CUF_ARRAY_EXPAND()` as needed and writing to it itself.
  * 
  * @param name name of function
  * @param T type of array elemts being compared
@@ -27,7 +34,10 @@
                                          size_t* esize)
 
 /**
- * Expand dynamically reallocated array
+ * Expand dynamically reallocated array. An array of size 0 (not allocated
+ * yet) is grown to `CUF_BUF_SIZE`. Meant for the framework's own buffers,
+ * such as the error buffer of an array comparison: the allocation isn't
+ * charged to the testcase's heap usage (see cuf_alloc.h).
  * 
  * @param a dynamic array to expand
  * @param n size of a
@@ -35,10 +45,128 @@
  * @param t type of the elements of a
  */
 #define CUF_ARRAY_EXPAND(a, n, factor, t) do {\
-    n *= factor;\
+    n = (n)? (n) * (factor) : CUF_BUF_SIZE;\
+    alloc_pause();\
     a = (t) realloc(a, n*sizeof(t));\
+    alloc_resume();\
 } while(0)
 
+/**
+ * Error buffer of an array comparison, see `ASSERT_ARRAY`. Internal use.
+ */
+typedef struct {
+    char *msgs;            /**< the buffer, NULL until first used */
+    size_t used;           /**< bytes used in `msgs` */
+    size_t size;           /**< bytes allocated for `msgs` */
+} ArrayMsgs;
+
+/**
+ * Append a printf formatted message to the error buffer of an array
+ * comparison function, growing the buffer as needed.
+ *
+ * @param emsgs in/out error buffer, may point to NULL
+ * @param eused in/out number of bytes used in the buffer
+ * @param esize in/out size of the buffer
+ * @param fmt printf format of the message
+ */
+void cuf_array_msg(char **emsgs, size_t *eused, size_t *esize,
+                   const char *fmt, ...);
+/**
+ * Terminate the error buffer filled by an array comparison, allocating it if
+ * nothing was written. Tolerates comparison functions that counted more
+ * bytes than fit by cutting the text short. Internal use function.
+ *
+ * @param emsgs in/out error buffer, may point to NULL
+ * @param eused in/out number of bytes used in the buffer
+ * @param esize in/out size of the buffer
+ * @return the terminated text in the buffer
+ */
+const char *cuf_array_msg_end(char **emsgs, size_t *eused, size_t *esize);
+/**
+ * Get the calling thread's array comparison error buffer, allocating
+ * `CUF_BUF_SIZE` bytes for it on the thread's first use. The buffer is kept
+ * for the next comparison, and freed when the thread exits, so only that
+ * first use allocates. It lives outside the test function's stack, so a
+ * crash in the middle of a comparison doesn't lose it (see cuf_guard.h).
+ * Internal use function.
+ *
+ * @return the calling thread's buffer, empty unless a comparison is running
+ */
+ArrayMsgs *cuf_array_msgs(void);
+/**
+ * Empty the calling thread's array comparison error buffer for the next
+ * comparison. Internal use function.
+ */
+void cuf_array_msgs_reset(void);
+/**
+ * Terminate the calling thread's array comparison error buffer after a
+ * failed comparison, naming the comparison function on a line of its own
+ * below the messages. Internal use function.
+ *
+ * @param comp_func name of the comparison function
+ * @return the terminated text in the buffer
+ */
+const char *cuf_array_msgs_end(const char *comp_func);
+
+/**
+ * Read a monotonic clock that isn't slewed by NTP (`CLOCK_MONOTONIC_RAW`
+ * where available), for timing code.
+ *
+ * @return current time in nanoseconds from an arbitrary starting point
+ */
+uint64_t cuf_now_ns(void);
+
+/**
+ * Format a duration with a unit that keeps it readable, e.g. "1.50 ms".
+ *
+ * @param buf buffer to write to
+ * @param size size of `buf`, 32 bytes is always enough
+ * @param ns duration in nanoseconds
+ */
+void cuf_format_ns(char *buf, size_t size, double ns);
+/**
+ * Format a size in bytes with a binary unit, e.g. "12.50 MiB".
+ *
+ * @param buf buffer to write to
+ * @param size size of `buf`, 32 bytes is always enough
+ * @param bytes size in bytes
+ */
+void cuf_format_bytes(char *buf, size_t size, double bytes);
+
+/**
+ * Read the user and system cpu time used so far by the calling thread, or by
+ * the whole process where per thread times are not available.
+ *
+ * @param user_ns out user cpu time in nanoseconds
+ * @param sys_ns out system cpu time in nanoseconds
+ */
+void cuf_cpu_ns(uint64_t *user_ns, uint64_t *sys_ns);
+
+/**
+ * Read the resident set size of the process, from /proc/self/status where
+ * available. Without it the current size is unknown (0) and the peak is the
+ * one `getrusage()` reports.
+ *
+ * @param peak whether to read the peak (VmHWM) instead of the current size
+ * @return size in bytes
+ */
+uint64_t cuf_rss_bytes(bool peak);
+/**
+ * Reset the peak resident set size of the process to its current size, so
+ * `cuf_rss_bytes(true)` measures from now on. Needs Linux 4.0 or later.
+ *
+ * @return true if the peak was reset
+ */
+bool cuf_rss_reset_peak(void);
+
+/**
+ * Get the symbolic name of a signal, e.g. "SIGSEGV" for SIGSEGV.
+ *
+ * @param sig signal number
+ * @return static string naming the signal, or "unknown signal"
+ */
+const char *cuf_signal_name(int sig);
+
 /**
  * Helpful dependency cleanup function to run after suite terminates
  * 
@@ -0,0 +1,91 @@
+/**
+ * @file cuf_value.c
+ * @brief CUnitFramework (CUF): Captured Values Implementation
+ * @details Mixed kind comparison and printing of captured assertion operands.
+ */
+#include <inttypes.h>
+#include <math.h>
+
+#include "cuf_value.h"
+
+
+// -1, 0 or 1 depending on how a and b are ordered
+#define CUF_SIGN(a, b) (((a) > (b)) - ((a) < (b)))
+
+static int compare_i64_u64(int64_t i, uint64_t u);
+static int compare_f64_i64(double f, int64_t i);
+static int compare_f64_u64(double f, uint64_t u);
+
+
+int value_compare(CufValue a, CufValue b) {
+    if(a.kind == CUF_VAL_NONE || b.kind == CUF_VAL_NONE) {
+        return CUF_VALUE_UNORDERED;
+    }
+    if((a.kind == CUF_VAL_F64 && isnan(a.f)) ||
+       (b.kind == CUF_VAL_F64 && isnan(b.f))) {
+        return CUF_VALUE_UNORDERED;
+    }
+    // pointers are just unsigned addresses from here on
+    if(a.kind == CUF_VAL_PTR) a = value_from_u64((uintptr_t) a.p);
+    if(b.kind == CUF_VAL_PTR) b = value_from_u64((uintptr_t) b.p);
+
+    switch(a.kind) {
+        case CUF_VAL_I64:
+            if(b.kind == CUF_VAL_I64) return CUF_SIGN(a.i, b.i);
+            if(b.kind == CUF_VAL_U64) return compare_i64_u64(a.i, b.u);
+            return -compare_f64_i64(b.f, a.i);
+        case CUF_VAL_U64:
+            if(b.kind == CUF_VAL_I64) return -compare_i64_u64(b.i, a.u);
+            if(b.kind == CUF_VAL_U64) return CUF_SIGN(a.u, b.u);
+            return -compare_f64_u64(b.f, a.u);
+        default:
+            if(b.kind == CUF_VAL_I64) return compare_f64_i64(a.f, b.i);
+            if(b.kind == CUF_VAL_U64) return compare_f64_u64(a.f, b.u);
+            return CUF_SIGN(a.f, b.f);
+    }
+}
+
+void value_print(FILE *out, CufValue val) {
+    switch(val.kind) {
+        case CUF_VAL_I64:
+            fprintf(out, "%" PRId64, val.i);
+            break;
+        case CUF_VAL_U64:
+            fprintf(out, "%" PRIu64, val.u);
+            break;
+        case CUF_VAL_F64:
+            fprintf(out, "%.17g", val.f);
+            break;
+        case CUF_VAL_PTR:
+            fprintf(out, "%p", val.p);
+            break;
+        default:
+            fprintf(out, "?");
+    }
+}
+
+
+static int compare_i64_u64(int64_t i, uint64_t u) {
+    if(i < 0) return -1;
+    return CUF_SIGN((uint64_t) i, u);
+}
+
+static int compare_f64_i64(double f, int64_t i) {
+    // +-2^63 are exact as doubles, anything outside can't be an int64
+    if(f < -9223372036854775808.0) return -1;
+    if(f >= 9223372036854775808.0) return 1;
+    // in range, so truncating is exact and orders f the same way against i
+    int64_t whole = (int64_t) f;
+    if(whole != i) return CUF_SIGN(whole, i);
+    double frac = f - (double) whole;
+    return CUF_SIGN(frac, 0.0);
+}
+
+static int compare_f64_u64(double f, uint64_t u) {
+    if(f < 0.0) return -1;
+    if(f >= 18446744073709551616.0) return 1;
+    uint64_t whole = (uint64_t) f;
+    if(whole != u) return CUF_SIGN(whole, u);
+    double frac = f - (double) whole;
+    return CUF_SIGN(frac, 0.0);
+}
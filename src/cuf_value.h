@@ -0,0 +1,130 @@
+/**
+ * @file cuf_value.h
+ * @brief CUnitFramework (CUF): Captured Values Interface
+ * @details Typed capture of assertion operands. `CUF_VALUE()` uses C11
+ * `_Generic` to evaluate an operand exactly once into a tagged CufValue, which
+ * can then be compared against another captured value and kept in a failure
+ * record to show what the operands actually were.
+ */
+#ifndef __CUF_VALUE_H__
+#define __CUF_VALUE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+// result of `value_compare()` for operands that have no order, i.e. NaN
+#define CUF_VALUE_UNORDERED 2
+
+/**
+ * Capture the value of an expression, evaluating it exactly once. Integers,
+ * floating point values and pointers are supported; anything else fails to
+ * compile.
+ *
+ * @param x expression to capture
+ */
+#define CUF_VALUE(x) _Generic((x),\
+    _Bool: value_from_u64,\
+    char: value_from_i64,\
+    signed char: value_from_i64,\
+    unsigned char: value_from_u64,\
+    short: value_from_i64,\
+    unsigned short: value_from_u64,\
+    int: value_from_i64,\
+    unsigned int: value_from_u64,\
+    long: value_from_i64,\
+    unsigned long: value_from_u64,\
+    long long: value_from_i64,\
+    unsigned long long: value_from_u64,\
+    float: value_from_f64,\
+    double: value_from_f64,\
+    long double: value_from_f64,\
+    default: value_from_ptr)(x)
+
+
+/**
+ * listing of the kinds of value a CufValue can hold
+ */
+enum cuf_value_kinds {
+    CUF_VAL_NONE,          /**< nothing was captured */
+    CUF_VAL_I64,           /**< a signed integer */
+    CUF_VAL_U64,           /**< an unsigned integer */
+    CUF_VAL_F64,           /**< a floating point value */
+    CUF_VAL_PTR            /**< a pointer */
+};
+
+/**
+ * A captured operand of an assertion.
+ */
+typedef struct cuf_value_t {
+    int kind;              /**< one of the `cuf_value_kinds` */
+    union {
+        int64_t i;         /**< value of a `CUF_VAL_I64` */
+        uint64_t u;        /**< value of a `CUF_VAL_U64` */
+        double f;          /**< value of a `CUF_VAL_F64` */
+        const void *p;     /**< value of a `CUF_VAL_PTR` */
+    };
+} CufValue;
+
+
+/**
+ * Capture a signed integer. Internal use function; use `CUF_VALUE()`.
+ *
+ * @param x value to capture
+ * @return the captured value
+ */
+static inline CufValue value_from_i64(int64_t x) {
+    CufValue val = {.kind = CUF_VAL_I64, .i = x};
+    return val;
+}
+/**
+ * Capture an unsigned integer. Internal use function; use `CUF_VALUE()`.
+ *
+ * @param x value to capture
+ * @return the captured value
+ */
+static inline CufValue value_from_u64(uint64_t x) {
+    CufValue val = {.kind = CUF_VAL_U64, .u = x};
+    return val;
+}
+/**
+ * Capture a floating point value. Internal use function; use `CUF_VALUE()`.
+ *
+ * @param x value to capture
+ * @return the captured value
+ */
+static inline CufValue value_from_f64(double x) {
+    CufValue val = {.kind = CUF_VAL_F64, .f = x};
+    return val;
+}
+/**
+ * Capture a pointer. Internal use function; use `CUF_VALUE()`.
+ *
+ * @param x value to capture
+ * @return the captured value
+ */
+static inline CufValue value_from_ptr(const void *x) {
+    CufValue val = {.kind = CUF_VAL_PTR, .p = x};
+    return val;
+}
+
+/**
+ * Compare two captured values by their mathematical value, regardless of
+ * their kinds: -1 is less than 0u, and 2^53 + 1 is not equal to 2.0^53.
+ * Pointers compare as unsigned addresses.
+ *
+ * @param a LHS of comparison
+ * @param b RHS of comparison
+ * @return -1, 0 or 1 if `a` is less than, equal to or greater than `b`, or
+ *         `CUF_VALUE_UNORDERED` if either is NaN
+ */
+int value_compare(CufValue a, CufValue b);
+/**
+ * Print a captured value.
+ *
+ * @param out stream to print to
+ * @param val value to print
+ */
+void value_print(FILE *out, CufValue val);
+
+#endif
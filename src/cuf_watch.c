@@ -0,0 +1,191 @@
+/**
+ * @file cuf_watch.c
+ * @brief CUnitFramework (CUF): Timeout Watchdog Implementation
+ * @details One watchdog thread per run sleeps until the earliest deadline of
+ * the armed testcases. Arming and disarming only take a mutex, and nothing
+ * is started at all for runs without timeouts. When a case times out the
+ * watchdog keeps the mutex until the process exits, which is what parks the
+ * worker threads in `watchdog_hold()`.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cuf_watch.h"
+
+
+/**
+ * a testcase being watched
+ */
+typedef struct {
+    TestSuite *suite;      /**< suite of the testcase */
+    TestCase *testcase;    /**< the testcase, NULL if the slot is free */
+    uint64_t deadline;     /**< CLOCK_MONOTONIC time the case times out at */
+} WatchSlot;
+
+/**
+ * state of the watchdog
+ */
+typedef struct {
+    pthread_mutex_t lock;  /**< protects everything below */
+    pthread_cond_t cond;   /**< signalled when slots or `running` change */
+    pthread_t thread;      /**< the watchdog thread */
+    bool running;          /**< whether the thread is (to be) running */
+    TestRunner *runner;    /**< runner being watched */
+    WatchSlot *slots;      /**< one slot per testcase being run */
+    int size;              /**< number of slots */
+} Watchdog;
+
+static uint64_t monotonic_ns(void);
+static void *watchdog_main(void *arg);
+static void watchdog_expire(WatchSlot *slot);
+
+static Watchdog watch = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                         0, false, NULL, NULL, 0};
+// set once a case timed out and the run is being aborted
+static atomic_bool aborted = false;
+
+
+void watchdog_start(TestRunner *runner) {
+    bool any = false;
+    for(int i = 0; i < runner->suite_count && !any; ++i) {
+        TestSuite *suite = runner->suites[i];
+        for(int j = 0; j < suite->test_count && !any; ++j) {
+            any = testcase_get_timeout(suite, suite->testcases[j]) > 0;
+        }
+    }
+    if(!any) return;
+    // deadlines are CLOCK_MONOTONIC, so the waits have to be too
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&watch.cond);
+    pthread_cond_init(&watch.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    watch.runner = runner;
+    watch.running = true;
+    if(pthread_create(&watch.thread, NULL, &watchdog_main, NULL)) {
+        watch.running = false;
+    }
+}
+
+void watchdog_stop(void) {
+    pthread_mutex_lock(&watch.lock);
+    bool running = watch.running;
+    watch.running = false;
+    pthread_cond_signal(&watch.cond);
+    pthread_mutex_unlock(&watch.lock);
+    if(running) pthread_join(watch.thread, NULL);
+    free(watch.slots);
+    watch.slots = NULL;
+    watch.size = 0;
+    watch.runner = NULL;
+}
+
+int watchdog_arm(TestSuite *suite, TestCase *testcase) {
+    double timeout = testcase_get_timeout(suite, testcase);
+    if(timeout <= 0) return -1;
+    pthread_mutex_lock(&watch.lock);
+    if(!watch.running) {
+        pthread_mutex_unlock(&watch.lock);
+        return -1;
+    }
+    int handle = 0;
+    while(handle < watch.size && watch.slots[handle].testcase) ++handle;
+    if(handle == watch.size) {
+        watch.size = watch.size? watch.size * 2 : CUF_ARRAY_SIZE;
+        watch.slots = realloc(watch.slots, sizeof(WatchSlot) * watch.size);
+        for(int i = handle; i < watch.size; ++i) {
+            watch.slots[i].testcase = NULL;
+        }
+    }
+    watch.slots[handle].suite = suite;
+    watch.slots[handle].testcase = testcase;
+    watch.slots[handle].deadline = monotonic_ns() + (uint64_t) (timeout * 1e9);
+    pthread_cond_signal(&watch.cond);
+    pthread_mutex_unlock(&watch.lock);
+    return handle;
+}
+
+void watchdog_disarm(int handle) {
+    if(handle < 0) return;
+    pthread_mutex_lock(&watch.lock);
+    watch.slots[handle].testcase = NULL;
+    pthread_mutex_unlock(&watch.lock);
+}
+
+bool watchdog_aborted(void) {
+    return atomic_load(&aborted);
+}
+
+void watchdog_hold(void) {
+    if(!atomic_load(&aborted)) return;
+    // held by the watchdog until it exits the process, so this never returns
+    pthread_mutex_lock(&watch.lock);
+}
+
+void testcase_record_timeout(TestSuite *suite, TestCase *testcase) {
+    char msg[CUF_BUF_SIZE];
+    snprintf(msg, CUF_BUF_SIZE, "Timeout: testcase timed out after %gs\nIn "
+             "TestCase: %s", testcase_get_timeout(suite, testcase),
+             testcase->test_name);
+    testcase_record_fail(testcase, msg);
+}
+
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static void *watchdog_main(void *arg) {
+    (void) arg;
+    pthread_mutex_lock(&watch.lock);
+    while(watch.running) {
+        WatchSlot *first = NULL;
+        for(int i = 0; i < watch.size; ++i) {
+            if(!watch.slots[i].testcase) continue;
+            if(!first || watch.slots[i].deadline < first->deadline) {
+                first = &watch.slots[i];
+            }
+        }
+        if(!first) {
+            pthread_cond_wait(&watch.cond, &watch.lock);
+            continue;
+        }
+        if(monotonic_ns() >= first->deadline) watchdog_expire(first);
+        struct timespec until;
+        until.tv_sec = first->deadline / 1000000000u;
+        until.tv_nsec = first->deadline % 1000000000u;
+        pthread_cond_timedwait(&watch.cond, &watch.lock, &until);
+    }
+    pthread_mutex_unlock(&watch.lock);
+    return NULL;
+}
+
+static void watchdog_expire(WatchSlot *slot) {
+    // the lock stays held: cases finishing meanwhile block instead of racing
+    TestRunner *runner = watch.runner;
+    testcase_record_timeout(slot->suite, slot->testcase);
+    slot->testcase->done = true;
+    // from here on workers stop at their next case or result, see
+    // `watchdog_hold()`, so the report isn't changed while it's printed
+    atomic_store(&aborted, true);
+    printf("\n\nTimeout: testcase %s of suite %s timed out after %gs, "
+           "aborting the run\n", slot->testcase->test_name, slot->suite->name,
+           testcase_get_timeout(slot->suite, slot->testcase));
+    for(int i = 0; i < runner->suite_count; ++i) {
+        testsuite_tally(runner->suites[i]);
+    }
+    testrunner_report(runner);
+    fflush(stdout);
+    fflush(stderr);
+    // the hung case still owns its thread, so there is no clean way out
+    _exit(1);
+}
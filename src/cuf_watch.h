@@ -0,0 +1,70 @@
+/**
+ * @file cuf_watch.h
+ * @brief CUnitFramework (CUF): Timeout Watchdog Interface
+ * @details Timeouts for the runners that run testcases in the calling process
+ * (`testrunner_run()` and the thread pool runners). A hung testcase can't be
+ * stopped from another thread without leaving the process in an unknown
+ * state, so when a case overruns its timeout the watchdog thread records the
+ * timeout, prints the report of everything that finished so far, and exits
+ * the process with a failing status. Worker threads still running stop at
+ * their next testcase or result, and the cache, history, baseline and results
+ * files are left as they were, since the run never finished. The isolated
+ * runners enforce timeouts themselves by killing the case's process, and keep
+ * going.
+ */
+#ifndef __CUF_WATCH_H__
+#define __CUF_WATCH_H__
+
+#include <stdbool.h>
+
+#include "cuf.h"
+
+
+/**
+ * Start watching the testcases of a run, if any of them has a timeout.
+ * Internal use function; called by the in-process runners.
+ *
+ * @param runner testrunner about to be run
+ */
+void watchdog_start(TestRunner *runner);
+/**
+ * Stop the watchdog started by `watchdog_start()`. Internal use function.
+ */
+void watchdog_stop(void);
+/**
+ * Start the clock on a testcase about to run on the calling thread.
+ * Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase about to run
+ * @return handle for `watchdog_disarm()`, -1 if the case isn't watched
+ */
+int watchdog_arm(TestSuite *suite, TestCase *testcase);
+/**
+ * Stop the clock on a testcase that finished. Internal use function.
+ *
+ * @param handle value returned by `watchdog_arm()`
+ */
+void watchdog_disarm(int handle);
+/**
+ * Whether a timeout is aborting the run. Internal use function, safe to call
+ * from multiple threads.
+ *
+ * @return true once a testcase has timed out
+ */
+bool watchdog_aborted(void);
+/**
+ * Park the calling thread for good if a timeout is aborting the run, so it
+ * neither starts a testcase nor records a result while the report is
+ * printed. Internal use function, returns right away otherwise.
+ */
+void watchdog_hold(void);
+/**
+ * Record to a testcase that it ran out of time. Internal use function.
+ *
+ * @param suite suite the testcase belongs to
+ * @param testcase testcase that timed out
+ */
+void testcase_record_timeout(TestSuite *suite, TestCase *testcase);
+
+#endif
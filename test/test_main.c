@@ -0,0 +1,248 @@
+/**
+ * @file test_main.c
+ * @brief CUnitFramework (CUF): Self Tests
+ * @details Tests and benchmarks of the framework itself, built into the
+ * `testrunner` binary by the sample Makefile. Takes the command line options
+ * of `testrunner_parse_args()`.
+ *
+ * The allocation checks only count anything in a `make ALLOC_WRAP=1` build
+ * (see cuf_alloc.h); otherwise they always pass.
+ */
+// mkstemp() and fdopen() need POSIX
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cuf_arena.h"
+#include "cuf_meta.h"
+
+// number of elements in the arrays compared by the ASSERT_ARRAY cases
+#define ARRAY_LEN 1024
+
+// message recorded by the failure record benchmarks
+#define RECORD_MSG "Assertion failure: value of `frame->crc` should match"
+// records the failure record benchmarks spread over the sites of a case
+#define RECORD_BATCH (16 * CUF_ERR_LIMIT)
+
+static TestSuite *array_suite(void);
+static TestSuite *record_suite(void);
+static TestSuite *order_suite(void);
+static SUITE_INIT_FUNC(array_init);
+static ARRAY_COMP_FUNC(int_equal, const int *);
+static void record_malloc(TestCase *c_case, const char *file, int line,
+                          const FailureMsg *msg);
+static void free_records(TestCase *c_case);
+
+static int array_actual[ARRAY_LEN];
+static int array_expected[ARRAY_LEN];
+
+
+/**
+ * An all-equal ASSERT_ARRAY makes no heap allocation.
+ */
+TESTCASE(array_pass_no_allocs) {
+    CUF_UNUSED(uut);
+    ASSERT_NO_ALLOCS {
+        ASSERT_ARRAY(array_actual, array_expected, int_equal, ARRAY_LEN);
+    }
+}
+
+/**
+ * Throughput of the ASSERT_ARRAY pass path, which stays free of heap
+ * allocations however often it runs.
+ */
+BENCHMARK(array_pass_bench) {
+    CUF_UNUSED(uut);
+    ASSERT_NO_ALLOCS {
+        for(size_t k = 0; k < iters; ++k) {
+            ASSERT_ARRAY(array_actual, array_expected, int_equal, ARRAY_LEN);
+        }
+    }
+}
+
+/**
+ * Throughput of `testcase_record()` with every record stored: each site takes
+ * `CUF_ERR_LIMIT` of them, then the next site is used. The records go to a
+ * case of their own, so this one still passes, and are rewound from the
+ * thread's arena after every `RECORD_BATCH` of them.
+ */
+BENCHMARK(record_fail_bench) {
+    CUF_UNUSED(uut);
+    CUF_UNUSED(suite);
+    Arena *arena = arena_local();
+    ArenaMark mark = arena_mark(arena);
+    TestCase *scratch = testcase_create(NULL, "scratch", NULL, NULL);
+    FailureMsg msg = {.detail = RECORD_MSG};
+    for(size_t k = 0; k < iters; ++k) {
+        // every site is full, start over with none
+        if(k % RECORD_BATCH == 0) {
+            arena_rewind(arena, mark);
+            scratch->failures = NULL;
+            scratch->last_failure = NULL;
+        }
+        int line = (int) (k % RECORD_BATCH / CUF_ERR_LIMIT) + 1;
+        testcase_record(scratch, __FILE__, line, &msg);
+    }
+    testcase_destroy(scratch);
+    arena_rewind(arena, mark);
+}
+
+/**
+ * Baseline for `record_fail_bench`: the same records, stored with a malloc
+ * and strcpy each, as they were before the arena, and freed after every
+ * `RECORD_BATCH` of them.
+ */
+BENCHMARK(record_malloc_bench) {
+    CUF_UNUSED(uut);
+    CUF_UNUSED(suite);
+    Arena *arena = arena_local();
+    ArenaMark mark = arena_mark(arena);
+    TestCase *scratch = testcase_create(NULL, "scratch", NULL, NULL);
+    FailureMsg msg = {.detail = RECORD_MSG};
+    for(size_t k = 0; k < iters; ++k) {
+        if(k % RECORD_BATCH == 0) {
+            free_records(scratch);
+            arena_rewind(arena, mark);
+        }
+        int line = (int) (k % RECORD_BATCH / CUF_ERR_LIMIT) + 1;
+        record_malloc(scratch, __FILE__, line, &msg);
+    }
+    free_records(scratch);
+    testcase_destroy(scratch);
+    arena_rewind(arena, mark);
+}
+
+/**
+ * A failure in the history doesn't move a case before the case it depends
+ * on, nor a suite before the suite it depends on, where it would only be
+ * skipped, run after run.
+ */
+TESTCASE(history_keeps_deps_first) {
+    CUF_UNUSED(uut);
+    char path[] = "/tmp/cuf_historyXXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE_NE(fd, -1);
+    FILE *out = fdopen(fd, "w");
+    fputs(CUF_HISTORY_HEADER "api\tfetch\t0\tf\t1000\n"
+          "db\tquery\t0\tf\t1000\n", out);
+    fclose(out);
+
+    TestRunner *runner = testrunner_create();
+    testrunner_set_history_file(runner, path);
+    TestSuite *api = testsuite_create("api", NULL, NULL, NULL, NULL);
+    testsuite_reg_case(api, NULL, dependency_reg_suite(dependency_create(),
+                       "db"), "fetch", NULL);
+    TestSuite *db = testsuite_create("db", NULL, NULL, NULL, NULL);
+    testsuite_reg_case(db, NULL, NULL, "migrate", NULL);
+    testsuite_reg_case(db, NULL, dependency_reg_case(dependency_create(),
+                       "db", "migrate"), "query", NULL);
+    testrunner_reg_suite(runner, &api);
+    testrunner_reg_suite(runner, &db);
+    dependency_resolve(runner);
+    order_number(runner);
+    ASSERT_LT(db->testcases[0]->run_order, db->testcases[1]->run_order);
+    ASSERT_LT(db->testcases[1]->run_order, api->testcases[0]->run_order);
+
+    term_cleanup_deps(api);
+    term_cleanup_deps(db);
+    testrunner_destroy(runner);
+    unlink(path);
+}
+
+int main(int argc, char **argv) {
+    TestRunner *runner = testrunner_create();
+    if(testrunner_parse_args(runner, argc, argv)) {
+        testrunner_destroy(runner);
+        return 2;
+    }
+    TestSuite *suite = array_suite();
+    testrunner_reg_suite(runner, &suite);
+    suite = record_suite();
+    testrunner_reg_suite(runner, &suite);
+    suite = order_suite();
+    testrunner_reg_suite(runner, &suite);
+    int ret = testrunner_run(runner);
+    testrunner_destroy(runner);
+    return ret;
+}
+
+
+static TestSuite *array_suite(void) {
+    TestSuite *suite = testsuite_create("array", NULL, NULL, &array_init,
+                                        NULL);
+    testsuite_reg_case(suite, &array_pass_no_allocs, NULL,
+                       "array_pass_no_allocs", NULL);
+    testsuite_reg_bench(suite, &array_pass_bench, NULL, "array_pass_bench",
+                        NULL);
+    return suite;
+}
+
+static TestSuite *record_suite(void) {
+    TestSuite *suite = testsuite_create("record", NULL, NULL, NULL, NULL);
+    testsuite_reg_bench(suite, &record_fail_bench, NULL, "record_fail_bench",
+                        NULL);
+    testsuite_reg_bench(suite, &record_malloc_bench, NULL,
+                        "record_malloc_bench", NULL);
+    return suite;
+}
+
+static TestSuite *order_suite(void) {
+    TestSuite *suite = testsuite_create("order", NULL, NULL, NULL, NULL);
+    testsuite_reg_case(suite, &history_keeps_deps_first, NULL,
+                       "history_keeps_deps_first", NULL);
+    return suite;
+}
+
+static SUITE_INIT_FUNC(array_init) {
+    CUF_UNUSED(suite);
+    for(int i = 0; i < ARRAY_LEN; ++i) {
+        array_actual[i] = i * 7;
+        array_expected[i] = i * 7;
+    }
+}
+
+static ARRAY_COMP_FUNC(int_equal, const int *) {
+    if(*a == *b) return true;
+    cuf_array_msg(emsgs, eused, esize, "[%d] %d != %d\n", i, *a, *b);
+    return false;
+}
+
+static void record_malloc(TestCase *c_case, const char *file, int line,
+                          const FailureMsg *msg) {
+    c_case->status = CUF_TC_FAIL;
+    Failure *site = testcase_fail_site(c_case, file, line);
+    ++(site->count);
+    ++(c_case->err_msg_count);
+    if(site->stored >= CUF_ERR_LIMIT) return;
+    FailureMsg *copy = malloc(sizeof(FailureMsg));
+    *copy = *msg;
+    copy->next = NULL;
+    if(msg->detail) {
+        char *detail = malloc(strlen(msg->detail) + 1);
+        strcpy(detail, msg->detail);
+        copy->detail = detail;
+    }
+    if(site->last_msg) {
+        site->last_msg->next = copy;
+    } else {
+        site->msgs = copy;
+    }
+    site->last_msg = copy;
+    ++(site->stored);
+}
+
+static void free_records(TestCase *c_case) {
+    for(Failure *site = c_case->failures; site; site = site->next) {
+        FailureMsg *msg = site->msgs;
+        while(msg) {
+            FailureMsg *next = msg->next;
+            free((char *) msg->detail);
+            free(msg);
+            msg = next;
+        }
+    }
+    c_case->failures = NULL;
+    c_case->last_failure = NULL;
+}